@@ -31,18 +31,105 @@
 #include <linux/version.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
 #include <linux/uio.h>
+#include <linux/poll.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+#include <linux/io_uring/cmd.h>
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+#include <linux/io_uring.h>
+#endif
+
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+#include <linux/kref.h>
+#include <linux/capability.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,10,0) && defined(CONFIG_MMU_NOTIFIER)
+#include <linux/mmu_notifier.h>
+#define CDEV_BUF_MMU_NOTIFIER
 #endif
 
 #include "qdma_mod.h"
+#include "qdma_cdev.h"
 
+/*
+ * aio/io_uring: the request is handed to libqdma with fp_done set and
+ * completed from the libqdma completion context, no thread is blocked for
+ * the duration of the dma.
+ */
 struct cdev_async_io {
 	struct kiocb *iocb;
+	struct qdma_cdev_file *xcf;
 	struct qdma_io_cb qiocb;
 	bool write;
-	bool cancel;
-	spinlock_t lock;
-	struct work_struct wrk_itm;
-	struct cdev_async_io *next;
+	struct work_struct wrk_itm;	/* c2h: release of the user pages */
+};
+
+/*
+ * per open file: any # of readers and writers may share a queue, the # of
+ * i/o in flight per direction can be limited per file (ioctl)
+ */
+struct qdma_cdev_file {
+	struct qdma_cdev *xcdev;
+	unsigned int inflight_max;	/* 0: no limit */
+	atomic_t inflight[2];		/* [write] */
+	wait_queue_head_t wq;
+
+	spinlock_t lock;		/* protects buf_list, stripe_* */
+	struct list_head buf_list;	/* registered user buffers */
+	u32 buf_handle;			/* last handle given out */
+
+	/* mm striping: the queues large i/o is spread over, 0: off */
+	unsigned int stripe_qcnt;
+	unsigned int stripe_chunk;
+	u16 stripe_qidx[QDMA_CDEV_STRIPE_QMAX];
+
+	struct qdma_cdev_bypass *bypass; /* kernel bypass, if the owner */
+};
+
+/*
+ * kernel bypass: the queues of the cdev are started with their data path in
+ * user space by one open file. The file and every mapping of the queue
+ * memory hold a reference, the queues are stopped with the last one.
+ */
+struct qdma_cdev_bypass {
+	struct kref ref;
+	struct qdma_cdev *xcdev;
+	unsigned long dev_hndl;
+	unsigned long qhndl[2];		/* [c2h] */
+	bool started[2];
+	/* registered buffers of the closed owner, freed after the stop */
+	struct list_head buf_list;
+};
+
+/* mmap() offset, in pages, of a bypass region: [c2h][region] */
+#define CDEV_BYPASS_PGOFF(c2h, region)	\
+	((c2h) * QDMA_QUEUE_USER_REGION_MAX + (region))
+
+/*
+ * user buffer registered via ioctl: pinned and dma mapped once, any
+ * read/write that falls within the buffer uses it with no per i/o pinning
+ * and mapping (qdma_request.dma_mapped = 1).
+ */
+struct qdma_cdev_buf {
+	struct list_head list;
+	struct qdma_cdev_file *xcf;
+	struct device *dev;
+	u32 handle;
+	bool invalid;			/* user mapping changed */
+	atomic_t users;			/* i/o in flight using the buffer */
+	enum dma_data_direction dir;	/* DMA_TO_DEVICE: h2c only */
+	unsigned long addr;
+	size_t len;
+	unsigned int pages_nr;
+	struct page **pages;
+	dma_addr_t *dma_addr;		/* per page */
+#ifdef CDEV_BUF_MMU_NOTIFIER
+	struct mmu_interval_notifier notifier;
+#endif
 };
 
 struct class *qdma_class;
@@ -52,95 +139,666 @@ static ssize_t cdev_gen_read_write(struct file *file, char __user *buf,
 		size_t count, loff_t *pos, bool write);
 static void unmap_user_buf(struct qdma_io_cb *iocb, bool write);
 static inline void iocb_release(struct qdma_io_cb *iocb);
+static long cdev_mm_xfer(struct qdma_cdev_file *xcf, unsigned long arg,
+			bool wait);
+
+/*
+ * a sg entry covers at most 1GB, well within the 32 bit sg->len and
+ * qdma_request.count
+ */
+#define CDEV_SG_PAGES_MAX	((1UL << 30) >> PAGE_SHIFT)
+
+/* no more i/o allowed in this direction until one completes */
+static inline bool cdev_inflight_full(struct qdma_cdev_file *xcf, bool write)
+{
+	unsigned int max = READ_ONCE(xcf->inflight_max);
+
+	return max && atomic_read(&xcf->inflight[write]) >= max;
+}
+
+static inline bool cdev_page_next(struct page *prev, struct page *pg)
+{
+	return page_to_pfn(pg) == page_to_pfn(prev) + 1;
+}
+
+static inline struct page **cdev_pages_alloc(unsigned int pages_nr)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0)
+	return kvmalloc_array(pages_nr, sizeof(struct page *), GFP_KERNEL);
+#else
+	return kmalloc_array(pages_nr, sizeof(struct page *), GFP_KERNEL);
+#endif
+}
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
-static int caio_cancel(struct kiocb *iocb)
+static inline void cdev_pages_free(struct page **pages)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0)
+	kvfree(pages);
 #else
-static int caio_cancel(struct kiocb *iocb, struct io_event *e)
+	kfree(pages);
 #endif
+}
+
+static int cdev_inflight_get(struct qdma_cdev_file *xcf, bool write,
+				bool wait)
 {
-	struct cdev_async_io *caio = iocb->private;
+	atomic_t *cnt = &xcf->inflight[write];
+	int rv;
 
-	spin_lock(&caio->lock);
-	caio->cancel = true;
-	spin_unlock(&caio->lock);
+	while (atomic_inc_return(cnt) > READ_ONCE(xcf->inflight_max) &&
+		READ_ONCE(xcf->inflight_max)) {
+		atomic_dec(cnt);
+		if (!wait)
+			return -EAGAIN;
+		rv = wait_event_interruptible(xcf->wq,
+				!READ_ONCE(xcf->inflight_max) ||
+				atomic_read(cnt) < READ_ONCE(xcf->inflight_max));
+		if (rv)
+			return rv;
+	}
 
 	return 0;
 }
 
-static void requeue_aio_work(struct cdev_async_io *caio)
+static void cdev_inflight_put(struct qdma_cdev_file *xcf, bool write)
 {
-	struct qdma_cdev *xcdev;
+	atomic_dec(&xcf->inflight[write]);
+	if (READ_ONCE(xcf->inflight_max))
+		wake_up(&xcf->wq);
+}
 
-	xcdev = (struct qdma_cdev *)caio->iocb->ki_filp->private_data;
-	if (NULL == xcdev) {
-		pr_err("Invalid xcdev\n");
-		return;
+/*
+ * registered user buffers
+ */
+#ifdef CDEV_BUF_MMU_NOTIFIER
+/*
+ * the user mapping of the buffer changed (munmap, mremap, ...): the pages
+ * stay pinned and mapped until the buffer is unregistered, but from now on
+ * i/o to this address range goes through get_user_pages() again.
+ */
+static bool cdev_buf_invalidate(struct mmu_interval_notifier *mni,
+				const struct mmu_notifier_range *range,
+				unsigned long cur_seq)
+{
+	struct qdma_cdev_buf *buf = container_of(mni, struct qdma_cdev_buf,
+						notifier);
+
+	/* pte protection changes do not move the pages */
+	if (range->event == MMU_NOTIFY_PROTECTION_VMA ||
+	    range->event == MMU_NOTIFY_PROTECTION_PAGE ||
+	    range->event == MMU_NOTIFY_SOFT_DIRTY)
+		return true;
+
+	mmu_interval_set_seq(mni, cur_seq);
+	WRITE_ONCE(buf->invalid, true);
+	return true;
+}
+
+static const struct mmu_interval_notifier_ops cdev_buf_mni_ops = {
+	.invalidate = cdev_buf_invalidate,
+};
+#endif
+
+static void cdev_buf_free(struct qdma_cdev_buf *buf)
+{
+	unsigned int i;
+
+#ifdef CDEV_BUF_MMU_NOTIFIER
+	if (buf->notifier.mm)
+		mmu_interval_notifier_remove(&buf->notifier);
+#endif
+	for (i = 0; i < buf->pages_nr; i++) {
+		/*
+		 * each i/o the device wrote was synced for the cpu already,
+		 * the cpu may have written the pages since (i.e., st c2h).
+		 */
+		if (buf->dma_addr && buf->dma_addr[i])
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+			dma_unmap_page_attrs(buf->dev, buf->dma_addr[i],
+					PAGE_SIZE, buf->dir,
+					DMA_ATTR_SKIP_CPU_SYNC);
+#else
+			dma_unmap_page(buf->dev, buf->dma_addr[i], PAGE_SIZE,
+					buf->dir);
+#endif
+		if (buf->pages[i]) {
+			if (buf->dir != DMA_TO_DEVICE)
+				set_page_dirty_lock(buf->pages[i]);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+			unpin_user_page(buf->pages[i]);
+#else
+			put_page(buf->pages[i]);
+#endif
+		}
 	}
 
-	queue_work(xcdev->aio_wq, &caio->wrk_itm);
+	kfree(buf->dma_addr);
+	kfree(buf->pages);
+	kfree(buf);
 }
 
-static void async_io_handler(struct work_struct *work)
+static int cdev_buf_register(struct qdma_cdev_file *xcf,
+				struct qdma_cdev_buf_reg *breg)
 {
-	struct qdma_cdev *xcdev;
-	struct cdev_async_io *caio = container_of(work, struct cdev_async_io, wrk_itm);
-	ssize_t numbytes = 0;
-	int lock_stat;
-	unsigned long qhndl;
-	spinlock_t *aio_lock;
+	struct qdma_cdev_buf *buf;
+	unsigned long addr = breg->addr;
+	unsigned long len = breg->len;
+	unsigned long pages_nr;
+	bool h2c_only = breg->flags & QDMA_CDEV_BUF_F_H2C_ONLY;
+	unsigned int i;
+	int rv;
 
-	if (NULL == caio) {
-		pr_err("Invalid work struct\n");
-		return;
+	if (!len || addr + len < addr ||
+	    (breg->flags & ~QDMA_CDEV_BUF_F_H2C_ONLY))
+		return -EINVAL;
+
+	pages_nr = (PAGE_ALIGN(addr + len) - (addr & PAGE_MASK)) >> PAGE_SHIFT;
+	if (pages_nr > UINT_MAX / sizeof(dma_addr_t))
+		return -EINVAL;
+
+	buf = kzalloc(sizeof(struct qdma_cdev_buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	buf->xcf = xcf;
+	buf->dev = &xcf->xcdev->xcb->xpdev->pdev->dev;
+	buf->addr = addr;
+	buf->len = len;
+	buf->dir = h2c_only ? DMA_TO_DEVICE : DMA_BIDIRECTIONAL;
+	atomic_set(&buf->users, 0);
+
+	buf->pages = kcalloc(pages_nr, sizeof(struct page *), GFP_KERNEL);
+	buf->dma_addr = kcalloc(pages_nr, sizeof(dma_addr_t), GFP_KERNEL);
+	if (!buf->pages || !buf->dma_addr) {
+		pr_err("%s, buf pages %lu OOM.\n", xcf->xcdev->name, pages_nr);
+		rv = -ENOMEM;
+		goto err_out;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+	rv = pin_user_pages_fast(addr & PAGE_MASK, pages_nr,
+				(h2c_only ? 0 : FOLL_WRITE) | FOLL_LONGTERM,
+				buf->pages);
+#else
+	rv = get_user_pages_fast(addr & PAGE_MASK, pages_nr, !h2c_only,
+				buf->pages);
+#endif
+	if (rv < 0) {
+		pr_err("%s, unable to pin down %lu user pages, %d.\n",
+			xcf->xcdev->name, pages_nr, rv);
+		goto err_out;
 	}
-	/* Safeguarding for cancel requests */
-	lock_stat = spin_trylock(&caio->lock);
-	if (!lock_stat) {
-		pr_warn("caio lock not acquired\n");
-		goto requeue;
+	buf->pages_nr = rv;
+	if (rv != pages_nr) {
+		pr_err("%s, unable to pin down all %lu user pages, %d.\n",
+			xcf->xcdev->name, pages_nr, rv);
+		rv = -EFAULT;
+		goto err_out;
 	}
 
-	if (false != caio->cancel) {
-		pr_err("skipping aio\n");
-		goto skip_tran;
+	for (i = 0; i < pages_nr; i++) {
+		dma_addr_t dma = dma_map_page(buf->dev, buf->pages[i], 0,
+					PAGE_SIZE, buf->dir);
+
+		if (dma_mapping_error(buf->dev, dma)) {
+			pr_err("%s, map page %u/%lu failed.\n",
+				xcf->xcdev->name, i, pages_nr);
+			rv = -EFAULT;
+			goto err_out;
+		}
+		buf->dma_addr[i] = dma;
 	}
 
-	xcdev = (struct qdma_cdev *)caio->iocb->ki_filp->private_data;
-	if (NULL == xcdev) {
-		pr_err("Invalid xcdev\n");
-		return;
+#ifdef CDEV_BUF_MMU_NOTIFIER
+	rv = mmu_interval_notifier_insert(&buf->notifier, current->mm, addr,
+					len, &cdev_buf_mni_ops);
+	if (rv < 0) {
+		buf->notifier.mm = NULL;
+		goto err_out;
+	}
+#endif
+
+	spin_lock(&xcf->lock);
+	buf->handle = ++xcf->buf_handle;
+	list_add_tail(&buf->list, &xcf->buf_list);
+	spin_unlock(&xcf->lock);
+
+	breg->handle = buf->handle;
+	pr_debug("%s, buf %u, 0x%lx,%lu, %lu pages.\n",
+		xcf->xcdev->name, buf->handle, addr, len, pages_nr);
+	return 0;
+
+err_out:
+	cdev_buf_free(buf);
+	return rv;
+}
+
+static int cdev_buf_unregister(struct qdma_cdev_file *xcf, u32 handle)
+{
+	struct qdma_cdev_buf *buf;
+	bool found = false;
+
+	spin_lock(&xcf->lock);
+	list_for_each_entry(buf, &xcf->buf_list, list) {
+		if (buf->handle == handle) {
+			list_del(&buf->list);
+			found = true;
+			break;
+		}
 	}
-	aio_lock = caio->write ? &xcdev->h2c_lock : &xcdev->c2h_lock;
-	/* use try_lock so that kthread_stop is handled ASAP */
-	lock_stat = spin_trylock(aio_lock);
-	if (!lock_stat) {
-		spin_unlock(&caio->lock);
-		goto requeue; /* allowing only 1 aio request per dir of cdev */
+	spin_unlock(&xcf->lock);
+
+	if (!found)
+		return -EINVAL;
+
+	/* no new user can find it, wait for the i/o in flight */
+	wait_event(xcf->wq, !atomic_read(&buf->users));
+	cdev_buf_free(buf);
+	return 0;
+}
+
+static struct qdma_cdev_buf *cdev_buf_get(struct qdma_cdev_file *xcf,
+				unsigned long addr, size_t len, bool write)
+{
+	struct qdma_cdev_buf *buf;
+
+	if (!len || list_empty(&xcf->buf_list))
+		return NULL;
+
+	spin_lock(&xcf->lock);
+	list_for_each_entry(buf, &xcf->buf_list, list) {
+		if (READ_ONCE(buf->invalid) ||
+		    (!write && buf->dir == DMA_TO_DEVICE))
+			continue;
+		if (addr >= buf->addr && addr + len <= buf->addr + buf->len) {
+			atomic_inc(&buf->users);
+			spin_unlock(&xcf->lock);
+			return buf;
+		}
 	}
+	spin_unlock(&xcf->lock);
 
+	return NULL;
+}
 
-	qhndl = caio->write ? xcdev->h2c_qhndl : xcdev->c2h_qhndl;
+static void cdev_buf_put(struct qdma_cdev_buf *buf)
+{
+	if (atomic_dec_and_test(&buf->users))
+		wake_up(&buf->xcf->wq);
+}
 
-	numbytes = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl,
-	                        qhndl,
-				&(caio->qiocb.req));
+/*
+ * build the (already dma mapped) sgl of an i/o within a registered buffer,
+ * pages contiguous both physically and in the dma address space share one
+ * sg entry
+ */
+static int map_user_buf_reg(struct qdma_io_cb *iocb, struct qdma_cdev_buf *buf,
+				bool write, bool st)
+{
+	unsigned long addr = (unsigned long)iocb->buf;
+	unsigned long len = iocb->len;
+	unsigned int pg_idx = (addr >> PAGE_SHIFT) - (buf->addr >> PAGE_SHIFT);
+	unsigned int pages_nr = (PAGE_ALIGN(addr + len) - (addr & PAGE_MASK))
+				>> PAGE_SHIFT;
+	unsigned int sg_pages = 0;
+	struct qdma_sw_sg *sg;
+	unsigned int i;
+
+	sg = kcalloc(pages_nr, sizeof(struct qdma_sw_sg), GFP_KERNEL);
+	if (!sg) {
+		pr_err("sgl %u OOM.\n", pages_nr);
+		return -ENOMEM;
+	}
+	iocb->sgl = sg;
+
+	for (i = 0; i < pages_nr; i++, pg_idx++) {
+		unsigned int offset = offset_in_page(addr);
+		unsigned int nbytes = min_t(unsigned long, PAGE_SIZE - offset,
+						len);
+
+		if (i && (sg_pages == CDEV_SG_PAGES_MAX ||
+		    !cdev_page_next(buf->pages[pg_idx - 1], buf->pages[pg_idx]) ||
+		    buf->dma_addr[pg_idx] !=
+				buf->dma_addr[pg_idx - 1] + PAGE_SIZE)) {
+			sg->next = sg + 1;
+			sg++;
+			sg_pages = 0;
+		}
+		if (!sg_pages) {
+			sg->pg = buf->pages[pg_idx];
+			sg->offset = offset;
+			sg->dma_addr = buf->dma_addr[pg_idx] + offset;
+		}
+		sg->len += nbytes;
+		sg_pages++;
+
+		addr += nbytes;
+		len -= nbytes;
+	}
+	sg->next = NULL;
+	iocb->sgcnt = sg - iocb->sgl + 1;
+
+	/* st c2h data is copied in by the cpu, the device does not touch it */
+	if (write)
+		iocb->rbuf_dir = DMA_TO_DEVICE;
+	else
+		iocb->rbuf_dir = st ? DMA_NONE : DMA_FROM_DEVICE;
+	for (i = 0, sg = iocb->sgl; iocb->rbuf_dir != DMA_NONE &&
+	     i < iocb->sgcnt; i++, sg++)
+		dma_sync_single_for_device(buf->dev, sg->dma_addr, sg->len,
+					iocb->rbuf_dir);
+
+	iocb->rbuf = buf;
+	return 0;
+}
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0)
-	caio->iocb->ki_complete(caio->iocb, numbytes, 0);
+static inline void caio_complete(struct kiocb *iocb, ssize_t res)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,16,0)
+	iocb->ki_complete(iocb, res);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0)
+	iocb->ki_complete(iocb, res, 0);
 #else
-	aio_complete(caio->iocb, numbytes, 0);
+	aio_complete(iocb, res, 0);
 #endif
-	unmap_user_buf(&(caio->qiocb), caio->write);
+}
+
+static void caio_release(struct cdev_async_io *caio)
+{
+	unmap_user_buf(&caio->qiocb, caio->write);
 	iocb_release(&caio->qiocb);
-	spin_unlock(aio_lock);
+	kmem_cache_free(cdev_cache, caio);
+}
+
+static void async_io_handler(struct work_struct *work)
+{
+	struct cdev_async_io *caio = container_of(work, struct cdev_async_io,
+						wrk_itm);
+
+	caio_release(caio);
+}
+
+/*
+ * called by libqdma from the completion context (irq thread, workqueue or
+ * writeback thread) with the queue lock held: must not sleep.
+ */
+static int cdev_aio_done(struct qdma_request *req, unsigned int bytes_done,
+			int err)
+{
+	struct cdev_async_io *caio = (struct cdev_async_io *)req->uld_data;
+	struct qdma_cdev_file *xcf = caio->xcf;
+	struct workqueue_struct *wq = xcf->xcdev->aio_wq;
+
+	/*
+	 * the file may be released once the iocb is completed: sync and put
+	 * the registered buffer first, the data is then visible to the cpu.
+	 */
+	if (caio->qiocb.rbuf)
+		unmap_user_buf(&caio->qiocb, caio->write);
+	cdev_inflight_put(xcf, caio->write);
+	caio_complete(caio->iocb, err < 0 ? err : bytes_done);
+
+	/* h2c pages are only put, c2h pages are dirtied which may sleep */
+	if (caio->write || !caio->qiocb.pages_nr)
+		caio_release(caio);
+	else
+		queue_work(wq, &caio->wrk_itm);
+
+	return 0;
+}
+
+/*
+ * kernel bypass
+ */
+static void cdev_bypass_release(struct kref *ref)
+{
+	struct qdma_cdev_bypass *bp = container_of(ref, struct qdma_cdev_bypass,
+						ref);
+	struct qdma_cdev *xcdev = bp->xcdev;
+	struct xlnx_pci_dev *xpdev = xcdev->xcb->xpdev;
+	struct qdma_cdev_buf *buf, *tmp;
+	int c2h;
+
+	for (c2h = 0; c2h < 2; c2h++)
+		if (bp->started[c2h])
+			qdma_queue_user_stop(bp->dev_hndl, bp->qhndl[c2h]);
+
+	list_for_each_entry_safe(buf, tmp, &bp->buf_list, list) {
+		list_del(&buf->list);
+		cdev_buf_free(buf);
+	}
+
+	spin_lock(&xpdev->cdev_lock);
+	xcdev->bypass = NULL;
+	spin_unlock(&xpdev->cdev_lock);
+
+	pr_info("%s, kernel bypass off.\n", xcdev->name);
+	kfree(bp);
+}
+
+static void cdev_bypass_q_fill(struct qdma_cdev_bypass_q *q,
+			struct qdma_queue_user_info *info, int c2h)
+{
+	q->flags = QDMA_CDEV_BYPASS_F_VALID |
+		   (info->st ? QDMA_CDEV_BYPASS_F_ST : 0);
+	q->qid = info->qidx_hw;
+	q->rngsz = info->rngsz;
+	q->desc_sz = info->desc_sz;
+	q->ring_len = info->ring_len;
+	q->cmpl_rngsz = info->cmpl_rngsz;
+	q->cmpl_sz = info->cmpl_sz;
+	q->cmpl_len = info->cmpl_len;
+	q->c2h_bufsz = info->c2h_bufsz;
+	q->db_off = info->db_off;
+	q->cmpl_db_off = info->cmpl_db_off;
+	q->cmpl_db_flags = info->cmpl_db_flags;
+
+	q->ring_mmap_off = (__u64)CDEV_BYPASS_PGOFF(c2h, QDMA_QUEUE_USER_RING)
+				<< PAGE_SHIFT;
+	if (info->cmpl_len)
+		q->cmpl_mmap_off = (__u64)CDEV_BYPASS_PGOFF(c2h,
+					QDMA_QUEUE_USER_CMPL) << PAGE_SHIFT;
+	q->db_mmap_off = (__u64)CDEV_BYPASS_PGOFF(c2h, QDMA_QUEUE_USER_DB)
+				<< PAGE_SHIFT;
+}
+
+static long cdev_bypass_start(struct qdma_cdev_file *xcf, unsigned long arg)
+{
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct xlnx_pci_dev *xpdev = xcdev->xcb->xpdev;
+	struct qdma_cdev_bypass_info binfo;
+	struct qdma_queue_user_info info;
+	struct qdma_cdev_bypass *bp;
+	int c2h, rv;
+
+	if (!capable(CAP_SYS_RAWIO))
+		return -EPERM;
+
+	bp = kzalloc(sizeof(struct qdma_cdev_bypass), GFP_KERNEL);
+	if (!bp)
+		return -ENOMEM;
+	kref_init(&bp->ref);
+	INIT_LIST_HEAD(&bp->buf_list);
+	bp->xcdev = xcdev;
+	bp->dev_hndl = xpdev->dev_hndl;
+
+	/* one owner per queue pair */
+	spin_lock(&xpdev->cdev_lock);
+	if (xcdev->bypass) {
+		spin_unlock(&xpdev->cdev_lock);
+		kfree(bp);
+		return -EBUSY;
+	}
+	xcdev->bypass = bp;
+	spin_unlock(&xpdev->cdev_lock);
+
+	memset(&binfo, 0, sizeof(binfo));
+	for (c2h = 0; c2h < 2; c2h++) {
+		if (!(xcdev->dir_init & (1 << c2h)))
+			continue;
+
+		bp->qhndl[c2h] = c2h ? xcdev->c2h_qhndl : xcdev->h2c_qhndl;
+		rv = qdma_queue_user_start(bp->dev_hndl, bp->qhndl[c2h], &info);
+		if (rv < 0) {
+			pr_info("%s, %s user start failed %d.\n",
+				xcdev->name, c2h ? "c2h" : "h2c", rv);
+			/* the queue has to be added but not started */
+			rv = rv == QDMA_ERR_INVALID_DESCQ_STATE ? -EBUSY : -EIO;
+			kref_put(&bp->ref, cdev_bypass_release);
+			return rv;
+		}
+		bp->started[c2h] = true;
+		cdev_bypass_q_fill(c2h ? &binfo.c2h : &binfo.h2c, &info, c2h);
+	}
+
+	/* released on close */
+	xcf->bypass = bp;
+	pr_info("%s, kernel bypass on.\n", xcdev->name);
+
+	if (copy_to_user((void __user *)arg, &binfo, sizeof(binfo)))
+		return -EFAULT;
+	return 0;
+}
+
+static long cdev_buf_dma(struct qdma_cdev_file *xcf, unsigned long arg)
+{
+	struct qdma_cdev_buf_dma bd;
+	struct qdma_cdev_buf *buf;
+	u64 __user *addr;
+	bool found = false;
+	unsigned int i;
+	long rv = 0;
+
+	if (!capable(CAP_SYS_RAWIO))
+		return -EPERM;
+
+	if (copy_from_user(&bd, (void __user *)arg, sizeof(bd)))
+		return -EFAULT;
+
+	spin_lock(&xcf->lock);
+	list_for_each_entry(buf, &xcf->buf_list, list) {
+		if (buf->handle == bd.handle) {
+			atomic_inc(&buf->users);
+			found = true;
+			break;
+		}
+	}
+	spin_unlock(&xcf->lock);
+
+	if (!found)
+		return -EINVAL;
+
+	if (bd.count > buf->pages_nr)
+		rv = -EINVAL;
+
+	addr = (u64 __user *)(unsigned long)bd.addr;
+	for (i = 0; !rv && i < bd.count; i++)
+		if (put_user((u64)buf->dma_addr[i], addr + i))
+			rv = -EFAULT;
+
+	cdev_buf_put(buf);
+	return rv;
+}
+
+/*
+ * mm striping: i/o larger than the stripe size is split over the queues of
+ * the set, in the direction of the i/o. The queues are looked up per i/o.
+ */
+static long cdev_stripe_set(struct qdma_cdev_file *xcf, unsigned long arg)
+{
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct xlnx_pci_dev *xpdev = xcdev->xcb->xpdev;
+	struct qdma_cdev_stripe st;
+	unsigned int i;
+	int c2h;
+
+	if (copy_from_user(&st, (void __user *)arg, sizeof(st)))
+		return -EFAULT;
+	if (st.qcnt > QDMA_CDEV_STRIPE_QMAX)
+		return -EINVAL;
+
+	for (i = 0; i < st.qcnt; i++) {
+		for (c2h = 0; c2h < 2; c2h++) {
+			struct xlnx_qdata *qdata;
+			struct qdma_queue_conf *qconf;
+
+			if (!(xcdev->dir_init & (1 << c2h)))
+				continue;
+			qdata = xpdev_queue_get(xpdev, st.qidx[i], c2h, 1,
+						NULL, 0);
+			if (!qdata || !qdata->qhndl)
+				return -EINVAL;
+			qconf = qdma_queue_get_config(xpdev->dev_hndl,
+						qdata->qhndl, NULL, 0);
+			if (!qconf || qconf->st) {
+				pr_info("%s, stripe queue %u NOT mm.\n",
+					xcdev->name, st.qidx[i]);
+				return -EINVAL;
+			}
+		}
+	}
+
+	spin_lock(&xcf->lock);
+	xcf->stripe_qcnt = st.qcnt;
+	xcf->stripe_chunk = st.chunk;
+	memcpy(xcf->stripe_qidx, st.qidx, sizeof(st.qidx));
+	spin_unlock(&xcf->lock);
+
+	pr_debug("%s, stripe over %u queues, chunk %u.\n",
+		xcdev->name, st.qcnt, st.chunk);
+	return 0;
+}
+
+static void cdev_bypass_vm_open(struct vm_area_struct *vma)
+{
+	struct qdma_cdev_bypass *bp = vma->vm_private_data;
 
-skip_tran:
-	spin_unlock(&caio->lock);
-	kmem_cache_free(cdev_cache, caio); /* how do we handle if simultaneous free req comes from cdev destroy? */
-	return;
-requeue:
-	requeue_aio_work(caio);
+	kref_get(&bp->ref);
+}
+
+static void cdev_bypass_vm_close(struct vm_area_struct *vma)
+{
+	struct qdma_cdev_bypass *bp = vma->vm_private_data;
+
+	kref_put(&bp->ref, cdev_bypass_release);
+}
+
+static const struct vm_operations_struct cdev_bypass_vm_ops = {
+	.open = cdev_bypass_vm_open,
+	.close = cdev_bypass_vm_close,
+};
+
+static int cdev_gen_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev_bypass *bp = READ_ONCE(xcf->bypass);
+	unsigned int c2h, region;
+	int rv;
+
+	if (!bp || !(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	if (vma->vm_pgoff >= CDEV_BYPASS_PGOFF(2, 0))
+		return -EINVAL;
+	c2h = vma->vm_pgoff / QDMA_QUEUE_USER_REGION_MAX;
+	region = vma->vm_pgoff % QDMA_QUEUE_USER_REGION_MAX;
+	if (!bp->started[c2h])
+		return -EINVAL;
+
+	/* the queue memory does not go along with fork() */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+	vm_flags_set(vma, VM_DONTCOPY);
+#else
+	vma->vm_flags |= VM_DONTCOPY;
+#endif
+
+	rv = qdma_queue_user_mmap(bp->dev_hndl, bp->qhndl[c2h], region, vma);
+	if (rv < 0)
+		return rv;
+
+	kref_get(&bp->ref);
+	vma->vm_private_data = bp;
+	vma->vm_ops = &cdev_bypass_vm_ops;
+	return 0;
 }
 
 /*
@@ -150,17 +808,56 @@ static int cdev_gen_open(struct inode *inode, struct file *file)
 {
 	struct qdma_cdev *xcdev = container_of(inode->i_cdev, struct qdma_cdev,
 						cdev);
-	file->private_data = xcdev;
+	struct qdma_cdev_file *xcf;
+	int rv;
 
-	if (xcdev->fp_open_extra)
-		return xcdev->fp_open_extra(xcdev);
+	xcf = kzalloc(sizeof(struct qdma_cdev_file), GFP_KERNEL);
+	if (!xcf)
+		return -ENOMEM;
+	xcf->xcdev = xcdev;
+	init_waitqueue_head(&xcf->wq);
+	spin_lock_init(&xcf->lock);
+	INIT_LIST_HEAD(&xcf->buf_list);
+	file->private_data = xcf;
+
+	if (xcdev->fp_open_extra) {
+		rv = xcdev->fp_open_extra(xcdev);
+		if (rv < 0) {
+			file->private_data = NULL;
+			kfree(xcf);
+		}
+		return rv;
+	}
 
 	return 0;
 }
 
 static int cdev_gen_close(struct inode *inode, struct file *file)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct qdma_cdev_buf *buf, *tmp;
+
+	/* the aio completions may still be putting their registered buffer */
+	list_for_each_entry(buf, &xcf->buf_list, list)
+		wait_event(xcf->wq, !atomic_read(&buf->users));
+
+	/*
+	 * kernel bypass: the queues stop once the user mappings are gone too,
+	 * the registered buffers may be in use by the queues until then.
+	 */
+	if (xcf->bypass) {
+		list_splice_init(&xcf->buf_list, &xcf->bypass->buf_list);
+		kref_put(&xcf->bypass->ref, cdev_bypass_release);
+	}
+
+	list_for_each_entry_safe(buf, tmp, &xcf->buf_list, list) {
+		list_del(&buf->list);
+		cdev_buf_free(buf);
+	}
+
+	kfree(xcf);
+	file->private_data = NULL;
 
 	if (xcdev->fp_close_extra)
 		return xcdev->fp_close_extra(xcdev);
@@ -170,7 +867,8 @@ static int cdev_gen_close(struct inode *inode, struct file *file)
 
 static loff_t cdev_gen_llseek(struct file *file, loff_t off, int whence)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf->xcdev;
 
 	loff_t newpos = 0;
 
@@ -199,7 +897,50 @@ static loff_t cdev_gen_llseek(struct file *file, loff_t off, int whence)
 static long cdev_gen_ioctl(struct file *file, unsigned int cmd,
 			unsigned long arg)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct qdma_cdev_buf_reg breg;
+	u32 v;
+	int rv;
+
+	switch (cmd) {
+	case QDMA_CDEV_IOC_SET_INFLIGHT_MAX:
+		if (get_user(v, (u32 __user *)arg))
+			return -EFAULT;
+		WRITE_ONCE(xcf->inflight_max, v);
+		/* let the waiters re-check against the new limit */
+		wake_up(&xcf->wq);
+		return 0;
+	case QDMA_CDEV_IOC_GET_INFLIGHT_MAX:
+		v = READ_ONCE(xcf->inflight_max);
+		return put_user(v, (u32 __user *)arg);
+	case QDMA_CDEV_IOC_BUF_REG:
+		if (copy_from_user(&breg, (void __user *)arg, sizeof(breg)))
+			return -EFAULT;
+		rv = cdev_buf_register(xcf, &breg);
+		if (rv < 0)
+			return rv;
+		if (put_user(breg.handle,
+			&((struct qdma_cdev_buf_reg __user *)arg)->handle)) {
+			cdev_buf_unregister(xcf, breg.handle);
+			return -EFAULT;
+		}
+		return 0;
+	case QDMA_CDEV_IOC_BUF_UNREG:
+		if (get_user(v, (u32 __user *)arg))
+			return -EFAULT;
+		return cdev_buf_unregister(xcf, v);
+	case QDMA_CDEV_IOC_BYPASS:
+		return cdev_bypass_start(xcf, arg);
+	case QDMA_CDEV_IOC_BUF_DMA:
+		return cdev_buf_dma(xcf, arg);
+	case QDMA_CDEV_IOC_MM_XFER:
+		return cdev_mm_xfer(xcf, arg, !(file->f_flags & O_NONBLOCK));
+	case QDMA_CDEV_IOC_STRIPE:
+		return cdev_stripe_set(xcf, arg);
+	default:
+		break;
+	}
 
 	if (xcdev->fp_ioctl_extra)
 		return xcdev->fp_ioctl_extra(xcdev, cmd, arg);
@@ -211,6 +952,7 @@ static long cdev_gen_ioctl(struct file *file, unsigned int cmd,
 /*
  * cdev r/w
  */
+
 static inline void iocb_release(struct qdma_io_cb *iocb)
 {
 	if (iocb->sgl) {
@@ -218,7 +960,7 @@ static inline void iocb_release(struct qdma_io_cb *iocb)
 		iocb->sgl = NULL;
 	}
 	if (iocb->pages) {
-		kfree(iocb->pages);
+		cdev_pages_free(iocb->pages);
 		iocb->pages = NULL;
 	}
 	iocb->buf = NULL;
@@ -228,10 +970,28 @@ static void unmap_user_buf(struct qdma_io_cb *iocb, bool write)
 {
 	int i;
 
+	if (iocb->rbuf) {
+		struct qdma_cdev_buf *buf = iocb->rbuf;
+
+		/* registered buffer: only the sgl is per i/o */
+		for (i = 0; iocb->rbuf_dir == DMA_FROM_DEVICE && iocb->sgl &&
+		     i < iocb->sgcnt; i++)
+			dma_sync_single_for_cpu(buf->dev,
+					iocb->sgl[i].dma_addr,
+					iocb->sgl[i].len, DMA_FROM_DEVICE);
+		kfree(iocb->sgl);
+		iocb->sgl = NULL;
+		iocb->sgcnt = 0;
+		iocb->rbuf = NULL;
+		cdev_buf_put(buf);
+		return;
+	}
+
 	if (iocb->sgl) {
 		kfree(iocb->sgl);
 		iocb->sgl = NULL;
 	}
+	iocb->sgcnt = 0;
 
 	if (!iocb->pages || !iocb->pages_nr)
 		return;
@@ -251,103 +1011,254 @@ static void unmap_user_buf(struct qdma_io_cb *iocb, bool write)
 	iocb->pages_nr = 0;
 }
 
-static int map_user_buf_to_sgl(struct qdma_io_cb *iocb, bool write)
+/*
+ * walk the pinned pages of all the segments, physically contiguous pages
+ * (i.e., hugepages, large folios) within a segment share one sg entry.
+ * Returns the # of sg entries, the sgl is filled in if not NULL.
+ */
+static unsigned int iov_to_sgl(struct page **pages, const struct iovec *iov,
+				unsigned long nr_segs, struct qdma_sw_sg *sgl)
+{
+	struct qdma_sw_sg *sg = NULL;
+	unsigned int sg_nr = 0;
+	unsigned int pg_idx = 0;
+	unsigned long seg;
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		unsigned long addr = (unsigned long)iov[seg].iov_base;
+		size_t len = iov[seg].iov_len;
+		unsigned int sg_pages = 0;
+
+		while (len) {
+			unsigned int offset = offset_in_page(addr);
+			unsigned int nbytes = min_t(size_t, PAGE_SIZE - offset,
+							len);
+			struct page *pg = pages[pg_idx];
+
+			if (!sg_pages || sg_pages == CDEV_SG_PAGES_MAX ||
+			    !cdev_page_next(pages[pg_idx - 1], pg)) {
+				sg_nr++;
+				sg_pages = 0;
+				if (sgl) {
+					if (sg)
+						sg->next = sg + 1;
+					sg = sgl + sg_nr - 1;
+					sg->next = NULL;
+					sg->pg = pg;
+					sg->offset = offset;
+					sg->len = 0;
+					sg->dma_addr = 0UL;
+				}
+			}
+			if (sgl) {
+				flush_dcache_page(pg);
+				sg->len += nbytes;
+			}
+
+			sg_pages++;
+			pg_idx++;
+			addr += nbytes;
+			len -= nbytes;
+		}
+	}
+
+	return sg_nr;
+}
+
+/* zero byte transfer: one page pinned, one empty sg entry */
+static int map_user_buf_zero(struct qdma_io_cb *iocb, void __user *buf)
+{
+	int rv;
+
+	iocb->pages = cdev_pages_alloc(1);
+	if (!iocb->pages)
+		return -ENOMEM;
+
+	rv = get_user_pages_fast((unsigned long)buf, 1, 1/* write */,
+				iocb->pages);
+	if (rv < 0)
+		return rv;
+	iocb->pages_nr = rv;
+	if (rv != 1)
+		return -EFAULT;
+
+	iocb->sgl = kzalloc(sizeof(struct qdma_sw_sg), GFP_KERNEL);
+	if (!iocb->sgl)
+		return -ENOMEM;
+	iocb->sgl->pg = iocb->pages[0];
+	iocb->sgl->offset = offset_in_page(buf);
+	iocb->sgcnt = 1;
+	return 0;
+}
+
+/*
+ * pin the user pages of all the segments and build one sgl spanning them
+ */
+static int map_user_buf_to_sgl(struct qdma_io_cb *iocb,
+				const struct iovec *iov, unsigned long nr_segs,
+				bool write)
 {
-	unsigned long len = iocb->len;
-	char *buf = iocb->buf;
 	struct qdma_sw_sg *sg;
-	unsigned int pages_nr = (((unsigned long)buf + len + PAGE_SIZE - 1) -
-				 ((unsigned long)buf & PAGE_MASK))
-				>> PAGE_SHIFT;
+	unsigned int pages_nr = 0;
+	unsigned int sg_nr;
+	unsigned long seg;
 	int i;
 	int rv;
 
-	if (len == 0) pages_nr = 1;
-	if (pages_nr == 0)
+	if (!nr_segs)
 		return -EINVAL;
 
-	sg = kzalloc(pages_nr * sizeof(struct qdma_sw_sg), GFP_KERNEL);
-	if (!sg) {
-		pr_err("sgl %u OOM.\n", pages_nr);
-		return -ENOMEM;
-	}
-	iocb->sgl = sg;
+	for (seg = 0; seg < nr_segs; seg++) {
+		unsigned long addr = (unsigned long)iov[seg].iov_base;
+		size_t len = iov[seg].iov_len;
 
-	iocb->pages = kmalloc(pages_nr * sizeof(struct page *), GFP_KERNEL);
-	if (!iocb->pages) {
-		pr_err("pages OOM.\n");
-		rv = -ENOMEM;
-		goto err_out;
+		if (!len)
+			continue;
+		pages_nr += (PAGE_ALIGN(addr + len) - (addr & PAGE_MASK))
+				>> PAGE_SHIFT;
 	}
-	rv = get_user_pages_fast((unsigned long)buf, pages_nr, 1/* write */,
-				iocb->pages);
-	/* No pages were pinned */
-	if (rv < 0) {
-		pr_err("unable to pin down %u user pages, %d.\n",
-			pages_nr, rv);
-		goto err_out;
+
+	/* zero byte transfer: one empty sg entry */
+	if (!pages_nr) {
+		rv = map_user_buf_zero(iocb, iov[0].iov_base);
+		if (rv < 0)
+			goto err_out;
+		return 0;
 	}
-	/* Less pages pinned than wanted */
-	if (rv != pages_nr) {
-		pr_err("unable to pin down all %u user pages, %d.\n",
-			pages_nr, rv);
-		rv = -EFAULT;
-		iocb->pages_nr = rv;
-		goto err_out;
+
+	iocb->pages = cdev_pages_alloc(pages_nr);
+	if (!iocb->pages) {
+		pr_err("pages %u OOM.\n", pages_nr);
+		return -ENOMEM;
 	}
 
-	for (i = 1; i < pages_nr; i++) {
-		if (iocb->pages[i - 1] == iocb->pages[i]) {
-			pr_err("duplicate pages, %d, %d.\n",
-				i - 1, i);
+	for (seg = 0; seg < nr_segs; seg++) {
+		unsigned long addr = (unsigned long)iov[seg].iov_base;
+		size_t len = iov[seg].iov_len;
+		struct page **pages = iocb->pages + iocb->pages_nr;
+		unsigned int nr;
+
+		if (!len)
+			continue;
+
+		nr = (PAGE_ALIGN(addr + len) - (addr & PAGE_MASK))
+			>> PAGE_SHIFT;
+		rv = get_user_pages_fast(addr, nr, 1/* write */, pages);
+		/* No pages were pinned */
+		if (rv < 0) {
+			pr_err("unable to pin down %u user pages, %d.\n",
+				nr, rv);
+			goto err_out;
+		}
+		iocb->pages_nr += rv;
+		/* Less pages pinned than wanted */
+		if (rv != nr) {
+			pr_err("unable to pin down all %u user pages, %d.\n",
+				nr, rv);
 			rv = -EFAULT;
-			iocb->pages_nr = pages_nr;
 			goto err_out;
 		}
-	}
 
-	sg = iocb->sgl;
-	for (i = 0; i < pages_nr; i++, sg++) {
-		unsigned int offset = offset_in_page(buf);
-		unsigned int nbytes = min_t(unsigned int, PAGE_SIZE - offset,
-						len);
-		struct page *pg = iocb->pages[i];
-
-		flush_dcache_page(pg);
-
-		sg->next = sg + 1;
-		sg->pg = pg;
-		sg->offset = offset;
-		sg->len = nbytes;
-		sg->dma_addr = 0UL;
+		for (i = 1; i < nr; i++) {
+			if (pages[i - 1] == pages[i]) {
+				pr_err("duplicate pages, %d, %d.\n",
+					i - 1, i);
+				rv = -EFAULT;
+				goto err_out;
+			}
+		}
+	}
 
-		buf += nbytes;
-		len -= nbytes;
-//		pr_info("sg->offset = %x", sg->offset);
+	sg_nr = iov_to_sgl(iocb->pages, iov, nr_segs, NULL);
+	/* qdma_request.sgcnt is 16 bits */
+	if (sg_nr > USHRT_MAX) {
+		pr_err("sgl %u too large.\n", sg_nr);
+		rv = -EINVAL;
+		goto err_out;
 	}
 
-	iocb->sgl[pages_nr - 1].next = NULL;
-	iocb->pages_nr = pages_nr;
+	sg = kcalloc(sg_nr, sizeof(struct qdma_sw_sg), GFP_KERNEL);
+	if (!sg) {
+		pr_err("sgl %u OOM.\n", sg_nr);
+		rv = -ENOMEM;
+		goto err_out;
+	}
+	iocb->sgl = sg;
+	iocb->sgcnt = iov_to_sgl(iocb->pages, iov, nr_segs, sg);
 	return 0;
 
 err_out:
 	unmap_user_buf(iocb, write);
+	iocb_release(iocb);
+
+	return rv;
+}
+
+/* use the registered buffer if the user buffer falls within one */
+static int cdev_map_user_buf(struct qdma_cdev_file *xcf,
+				struct qdma_io_cb *iocb,
+				const struct iovec *iov, unsigned long nr_segs,
+				bool write)
+{
+	struct qdma_cdev_buf *buf = NULL;
+	int rv;
 
+	/* a registered buffer covers a single segment only */
+	if (nr_segs == 1)
+		buf = cdev_buf_get(xcf, (unsigned long)iocb->buf, iocb->len,
+					write);
+	if (!buf)
+		return map_user_buf_to_sgl(iocb, iov, nr_segs, write);
+
+	rv = map_user_buf_reg(iocb, buf, write, xcf->xcdev->st);
+	if (rv < 0)
+		cdev_buf_put(buf);
 	return rv;
 }
 
+/* submit to the queue, or striped over the stripe set if large enough */
+static ssize_t cdev_submit(struct qdma_cdev_file *xcf, unsigned long qhndl,
+			struct qdma_request *req)
+{
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct xlnx_pci_dev *xpdev = xcdev->xcb->xpdev;
+	unsigned long qhndls[QDMA_CDEV_STRIPE_QMAX];
+	u16 qidx[QDMA_CDEV_STRIPE_QMAX];
+	unsigned int qcnt, chunk, i;
+
+	spin_lock(&xcf->lock);
+	qcnt = xcf->stripe_qcnt;
+	chunk = xcf->stripe_chunk;
+	memcpy(qidx, xcf->stripe_qidx, qcnt * sizeof(u16));
+	spin_unlock(&xcf->lock);
+
+	if (!qcnt || req->count <= chunk)
+		return xcdev->fp_rw(xpdev->dev_hndl, qhndl, req);
+
+	for (i = 0; i < qcnt; i++) {
+		struct xlnx_qdata *qdata = xpdev_queue_get(xpdev, qidx[i],
+						!req->write, 1, NULL, 0);
+
+		if (!qdata || !qdata->qhndl)
+			return -EINVAL;
+		qhndls[i] = qdata->qhndl;
+	}
+
+	return qdma_request_submit_striped(xpdev->dev_hndl, qhndls, qcnt, req,
+					chunk);
+}
+
 static ssize_t cdev_gen_read_write(struct file *file, char __user *buf,
 		size_t count, loff_t *pos, bool write)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf ? xcf->xcdev : NULL;
 	struct qdma_io_cb iocb;
 	struct qdma_request *req = &iocb.req;
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
 	ssize_t res = 0;
 	int rv;
-	int lock_stat;
-	unsigned long qhndl = write ? xcdev->h2c_qhndl : xcdev->c2h_qhndl;
-	spinlock_t *xcdev_lock = write ?
-			&xcdev->h2c_lock : &xcdev->c2h_lock;
+	unsigned long qhndl;
 
 	if (!xcdev) {
 		pr_info("file 0x%p, xcdev NULL, 0x%p,%llu, pos %llu, W %d.\n",
@@ -361,37 +1272,39 @@ static ssize_t cdev_gen_read_write(struct file *file, char __user *buf,
 		return -EINVAL;
 	}
 
+	qhndl = write ? xcdev->h2c_qhndl : xcdev->c2h_qhndl;
 	pr_debug("%s, priv 0x%lx: buf 0x%p,%llu, pos %llu, W %d.\n",
 		xcdev->name, qhndl, buf, (u64)count, (u64)*pos,
 		write);
 
-	/* use try_lock so that kthread_stop is handled ASAP */
-	lock_stat = spin_trylock(xcdev_lock);
-	if (!lock_stat) return -EINVAL; /* allowing only 1 aio request per cdev */
+	rv = cdev_inflight_get(xcf, write, !(file->f_flags & O_NONBLOCK));
+	if (rv < 0)
+		return rv;
+
 	memset(&iocb, 0, sizeof(struct qdma_io_cb));
 	iocb.buf = buf;
 	iocb.len = count;
-	rv = map_user_buf_to_sgl(&iocb, write);
+	rv = cdev_map_user_buf(xcf, &iocb, &iov, 1, write);
 	if (rv < 0) {
-		spin_unlock(xcdev_lock);
+		cdev_inflight_put(xcf, write);
 		return rv;
 	}
 
-	req->sgcnt = iocb.pages_nr;
+	req->sgcnt = iocb.sgcnt;
 	req->sgl = iocb.sgl;
 	req->write = write ? 1 : 0;
-	req->dma_mapped = 0;
+	req->dma_mapped = iocb.rbuf ? 1 : 0;
 	req->udd_len = 0;
 	req->ep_addr = (u64)*pos;
 	req->count = count;
 	req->timeout_ms = 10 * 1000;	/* 10 seconds */
 	req->fp_done = NULL;		/* blocking */
 
-	res = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl, qhndl, req);
+	res = cdev_submit(xcf, qhndl, req);
 
 	unmap_user_buf(&iocb, write);
 	iocb_release(&iocb);
-	spin_unlock(xcdev_lock);
+	cdev_inflight_put(xcf, write);
 
 	return res;
 }
@@ -408,74 +1321,265 @@ static ssize_t cdev_gen_read(struct file *file, char __user *buf,
 	return cdev_gen_read_write(file, (char *)buf, count, pos, 0);
 }
 
-static ssize_t cdev_aio_write(struct kiocb *iocb, const struct iovec *io,
-                              unsigned long count, loff_t pos)
+/*
+ * MM batch transfer: one request per segment, the requests of each
+ * direction are submitted to the queue as one batch.
+ */
+struct cdev_mm_batch {
+	atomic_t pending;		/* + 1 until all are submitted */
+	struct completion done;
+};
+
+struct cdev_mm_seg {
+	struct qdma_io_cb qiocb;
+	struct cdev_mm_batch *batch;
+	int status;
+	bool write;
+	bool mapped;
+	bool queued;
+};
+
+/* libqdma completion context, queue lock held */
+static int cdev_mm_seg_done(struct qdma_request *req, unsigned int bytes_done,
+			int err)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)iocb->ki_filp->private_data;
-	struct cdev_async_io *caio;
-	struct qdma_request *req;
+	struct cdev_mm_seg *seg = (struct cdev_mm_seg *)req->uld_data;
+	struct cdev_mm_batch *batch = seg->batch;
+
+	seg->status = err < 0 ? err : bytes_done;
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+	return 0;
+}
+
+static int cdev_mm_seg_map(struct qdma_cdev_file *xcf, struct cdev_mm_seg *seg,
+			struct qdma_cdev_mm_seg *useg)
+{
+	struct qdma_request *req = &seg->qiocb.req;
+	struct iovec iov;
 	int rv;
-	unsigned long i;
 
-	if (!xcdev) {
-		pr_err("file 0x%p, xcdev NULL, %llu, pos %llu, W %d.\n",
-		        iocb->ki_filp, (u64)count, (u64)pos, 1);
+	seg->write = useg->write ? true : false;
+	if (!(xcf->xcdev->dir_init & (1 << (seg->write ? 0 : 1))) ||
+	    useg->len > MAX_RW_COUNT)
 		return -EINVAL;
-	}
 
-	if (!xcdev->fp_rw) {
-		pr_err("No Read write handler assigned\n");
+	seg->qiocb.buf = (void __user *)(unsigned long)useg->addr;
+	seg->qiocb.len = useg->len;
+	iov.iov_base = seg->qiocb.buf;
+	iov.iov_len = useg->len;
+	rv = cdev_map_user_buf(xcf, &seg->qiocb, &iov, 1, seg->write);
+	if (rv < 0)
+		return rv;
+	seg->mapped = true;
+
+	req->sgcnt = seg->qiocb.sgcnt;
+	req->sgl = seg->qiocb.sgl;
+	req->write = seg->write ? 1 : 0;
+	req->dma_mapped = seg->qiocb.rbuf ? 1 : 0;
+	req->udd_len = 0;
+	req->ep_addr = useg->ep_addr;
+	req->count = useg->len;
+	req->uld_data = (unsigned long)seg;
+	req->fp_done = cdev_mm_seg_done;
+	return 0;
+}
+
+static long cdev_mm_xfer(struct qdma_cdev_file *xcf, unsigned long arg,
+			bool wait)
+{
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	unsigned long dev_hndl = xcdev->xcb->xpdev->dev_hndl;
+	unsigned long qhndl[2] = { xcdev->c2h_qhndl, xcdev->h2c_qhndl };
+	struct qdma_cdev_mm_seg __user *usegs;
+	struct qdma_cdev_mm_xfer xfer;
+	struct qdma_cdev_mm_seg useg;
+	struct cdev_mm_batch batch;
+	struct qdma_request **reqs;
+	struct cdev_mm_seg *segs;
+	bool inflight[2] = { false, false };
+	unsigned int i, n, tmo;
+	long rv = 0;
+	int write;
+
+	if (copy_from_user(&xfer, (void __user *)arg, sizeof(xfer)))
+		return -EFAULT;
+
+	if (!xfer.count || xfer.count > QDMA_CDEV_MM_XFER_MAX)
 		return -EINVAL;
+
+	usegs = (struct qdma_cdev_mm_seg __user *)(unsigned long)xfer.segs;
+	tmo = xfer.timeout_ms ? xfer.timeout_ms : 10 * 1000;
+
+	segs = vzalloc(xfer.count * sizeof(struct cdev_mm_seg));
+	reqs = vmalloc(xfer.count * sizeof(struct qdma_request *));
+	if (!segs || !reqs) {
+		rv = -ENOMEM;
+		goto free_out;
 	}
 
-	for (i = 0; i < count; i++) {
-		caio = kmem_cache_alloc(cdev_cache, GFP_KERNEL);
-		req = &(caio->qiocb.req);
-		memset(&(caio->qiocb), 0, sizeof(struct qdma_io_cb));
-		memset(caio, 0, sizeof(struct cdev_async_io));
-		caio->qiocb.buf = io[i].iov_base;
-		caio->qiocb.len = io[i].iov_len;
-		rv = map_user_buf_to_sgl(&(caio->qiocb), true);
-		if (rv < 0) {
-			kmem_cache_free(cdev_cache, caio);
-			return rv;
+	atomic_set(&batch.pending, 1);
+	init_completion(&batch.done);
+
+	for (i = 0; i < xfer.count; i++) {
+		if (copy_from_user(&useg, usegs + i, sizeof(useg))) {
+			rv = -EFAULT;
+			goto release;
+		}
+		segs[i].batch = &batch;
+		segs[i].status = useg.len ? cdev_mm_seg_map(xcf, segs + i,
+							&useg) : 0;
+		/* timed out by the queue, fp_done gets -ETIMEDOUT */
+		segs[i].qiocb.req.timeout_ms = tmo;
+	}
+
+	for (write = 0; write < 2; write++) {
+		for (n = 0, i = 0; i < xfer.count; i++)
+			if (segs[i].mapped && segs[i].write == write)
+				reqs[n++] = &segs[i].qiocb.req;
+		if (!n)
+			continue;
+
+		/* the batch of each direction counts as one i/o in flight */
+		rv = cdev_inflight_get(xcf, write, wait);
+		if (!rv) {
+			inflight[write] = true;
+			atomic_add(n, &batch.pending);
+			rv = qdma_batch_request_submit(dev_hndl, qhndl[write],
+							reqs, n);
+			if (rv < 0)
+				atomic_sub(n, &batch.pending);
+		}
+		for (i = 0; i < xfer.count; i++) {
+			if (!segs[i].mapped || segs[i].write != write)
+				continue;
+			if (rv < 0)
+				segs[i].status = rv;
+			else
+				segs[i].queued = true;
+		}
+	}
+	rv = 0;
+
+	/* drop the bias, the last completion wakes us up */
+	if (!atomic_dec_and_test(&batch.pending)) {
+		if (wait_for_completion_interruptible(&batch.done)) {
+			pr_info("%s, mm xfer of %u interrupted.\n",
+				xcdev->name, xfer.count);
+			for (i = 0; i < xfer.count; i++) {
+				struct cdev_mm_seg *seg = segs + i;
+
+				if (!seg->queued || qdma_request_cancel(
+						dev_hndl, qhndl[seg->write],
+						&seg->qiocb.req))
+					continue;
+				seg->status = -EINTR;
+				if (atomic_dec_and_test(&batch.pending))
+					complete(&batch.done);
+			}
+			/* the segments posted already have to complete */
+			wait_for_completion(&batch.done);
 		}
+	}
+
+	for (write = 0; write < 2; write++)
+		if (inflight[write])
+			cdev_inflight_put(xcf, write);
+
+	for (i = 0; i < xfer.count; i++) {
+		if (put_user(segs[i].status, &usegs[i].status)) {
+			rv = -EFAULT;
+			break;
+		}
+		if (segs[i].queued && segs[i].status == segs[i].qiocb.len)
+			rv++;
+	}
 
-		req->sgcnt = caio->qiocb.pages_nr;
-		req->sgl = caio->qiocb.sgl;
-		req->write = true;
-		req->dma_mapped = false;
-		req->udd_len = 0;
-		req->ep_addr = (u64)pos;
-		req->count = io->iov_len;
-		req->timeout_ms = 10 * 1000;	/* 10 seconds */
-		req->fp_done = NULL;		/* blocking */
+release:
+	for (i = 0; i < xfer.count; i++) {
+		if (!segs[i].mapped)
+			continue;
+		unmap_user_buf(&segs[i].qiocb, segs[i].write);
+		iocb_release(&segs[i].qiocb);
+	}
+free_out:
+	vfree(reqs);
+	vfree(segs);
+	return rv;
+}
 
-		iocb->private = caio;
-		caio->iocb = iocb;
-		caio->write = true;
-		caio->cancel = false;
-		spin_lock_init(&caio->lock);
+/*
+ * submit one request for the whole kiocb. A synchronous kiocb (i.e., readv()
+ * and writev()) blocks until the request is done.
+ */
+static ssize_t cdev_aio_submit(struct kiocb *iocb,
+				struct cdev_async_io *caio, loff_t pos,
+				bool write)
+{
+	struct qdma_cdev_file *xcf =
+			(struct qdma_cdev_file *)iocb->ki_filp->private_data;
+	struct qdma_cdev *xcdev = xcf->xcdev;
+	struct qdma_request *req = &(caio->qiocb.req);
+	unsigned long qhndl = write ? xcdev->h2c_qhndl : xcdev->c2h_qhndl;
+	bool sync = is_sync_kiocb(iocb);
+	ssize_t res;
+
+	res = cdev_inflight_get(xcf, write,
+			sync && !(iocb->ki_filp->f_flags & O_NONBLOCK));
+	if (res < 0) {
+		caio_release(caio);
+		return res;
+	}
 
-		kiocb_set_cancel_fn(caio->iocb, caio_cancel);
-		INIT_WORK(&caio->wrk_itm, async_io_handler);
-		queue_work(xcdev->aio_wq, &caio->wrk_itm);
+	req->sgcnt = caio->qiocb.sgcnt;
+	req->sgl = caio->qiocb.sgl;
+	req->write = write;
+	req->dma_mapped = caio->qiocb.rbuf ? 1 : 0;
+	req->udd_len = 0;
+	req->ep_addr = (u64)pos;
+	req->count = caio->qiocb.len;
+	req->timeout_ms = 10 * 1000;	/* 10 seconds */
+	req->uld_data = (unsigned long)caio;
+	/* non-blocking, unless sync */
+	req->fp_done = sync ? NULL : cdev_aio_done;
+
+	caio->iocb = iocb;
+	caio->xcf = xcf;
+	caio->write = write;
+	INIT_WORK(&caio->wrk_itm, async_io_handler);
+
+	res = cdev_submit(xcf, qhndl, req);
+	if (res || sync) {
+		/*
+		 * failed, sync, or st c2h served from the already received
+		 * data
+		 */
+		cdev_inflight_put(xcf, write);
+		caio_release(caio);
+		return res;
 	}
 
 	return -EIOCBQUEUED;
 }
-static ssize_t cdev_aio_read(struct kiocb *iocb, const struct iovec *io,
-                             unsigned long count, loff_t pos)
+
+/*
+ * all the iovec segments go into one request: one sgl, one dma job and one
+ * completion per call.
+ */
+static ssize_t cdev_aio_rw(struct kiocb *iocb, const struct iovec *io,
+				unsigned long count, loff_t pos, bool write)
 {
-	struct qdma_cdev *xcdev = (struct qdma_cdev *)iocb->ki_filp->private_data;
+	struct qdma_cdev_file *xcf =
+			(struct qdma_cdev_file *)iocb->ki_filp->private_data;
+	struct qdma_cdev *xcdev = xcf ? xcf->xcdev : NULL;
 	struct cdev_async_io *caio;
-	struct qdma_request *req;
+	size_t len = 0;
 	int rv;
 	unsigned long i;
 
 	if (!xcdev) {
 		pr_err("file 0x%p, xcdev NULL, %llu, pos %llu, W %d.\n",
-		        iocb->ki_filp, (u64)count, (u64)pos, 1);
+		        iocb->ki_filp, (u64)count, (u64)pos, write);
 		return -EINVAL;
 	}
 
@@ -484,55 +1588,356 @@ static ssize_t cdev_aio_read(struct kiocb *iocb, const struct iovec *io,
 		return -EINVAL;
 	}
 
+	if (!count)
+		return -EINVAL;
+
+	/* qdma_request.count is 32 bits */
 	for (i = 0; i < count; i++) {
-		caio = kmem_cache_alloc(cdev_cache, GFP_KERNEL);
-		req = &(caio->qiocb.req);
-		memset(&(caio->qiocb), 0, sizeof(struct qdma_io_cb));
-		memset(caio, 0, sizeof(struct cdev_async_io));
-		caio->qiocb.buf = io[i].iov_base;
-		caio->qiocb.len = io[i].iov_len;
-		rv = map_user_buf_to_sgl(&(caio->qiocb), false);
-		if (rv < 0) {
-			kmem_cache_free(cdev_cache, caio);
-			return rv;
+		if (io[i].iov_len > MAX_RW_COUNT - len)
+			return -EINVAL;
+		len += io[i].iov_len;
+	}
+
+	caio = kmem_cache_alloc(cdev_cache, GFP_KERNEL);
+	if (!caio)
+		return -ENOMEM;
+	memset(caio, 0, sizeof(struct cdev_async_io));
+	caio->qiocb.buf = io[0].iov_base;
+	caio->qiocb.len = len;
+	rv = cdev_map_user_buf(xcf, &(caio->qiocb), io, count, write);
+	if (rv < 0) {
+		kmem_cache_free(cdev_cache, caio);
+		return rv;
+	}
+
+	return cdev_aio_submit(iocb, caio, pos, write);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,16,0)
+static ssize_t cdev_aio_write(struct kiocb *iocb, const struct iovec *io,
+                              unsigned long count, loff_t pos)
+{
+	return cdev_aio_rw(iocb, io, count, pos, true);
+}
+
+static ssize_t cdev_aio_read(struct kiocb *iocb, const struct iovec *io,
+                             unsigned long count, loff_t pos)
+{
+	return cdev_aio_rw(iocb, io, count, pos, false);
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,20,0)
+/*
+ * io_uring registered (fixed) buffers come in as a bvec iterator, the pages
+ * stay pinned by io_uring as long as the buffer is registered: build the sgl
+ * straight from the bvecs, no get_user_pages() per i/o.
+ */
+static int map_bvec_to_sgl(struct qdma_io_cb *iocb, struct iov_iter *io)
+{
+	const struct bio_vec *bv = io->bvec;
+	size_t skip = io->iov_offset;
+	size_t len = iov_iter_count(io);
+	struct qdma_sw_sg *sg;
+	unsigned long i;
+
+	if (!len || !io->nr_segs)
+		return -EINVAL;
+	/* qdma_request.sgcnt is 16 bits */
+	if (io->nr_segs > USHRT_MAX) {
+		pr_err("sgl %lu too large.\n", io->nr_segs);
+		return -EINVAL;
+	}
+
+	sg = kzalloc(io->nr_segs * sizeof(struct qdma_sw_sg), GFP_KERNEL);
+	if (!sg) {
+		pr_err("sgl %lu OOM.\n", io->nr_segs);
+		return -ENOMEM;
+	}
+	iocb->sgl = sg;
+	iocb->len = len;
+
+	for (i = 0; len && i < io->nr_segs; i++, bv++) {
+		unsigned int nbytes;
+
+		if (skip >= bv->bv_len) {
+			skip -= bv->bv_len;
+			continue;
 		}
 
-		req->sgcnt = caio->qiocb.pages_nr;
-		req->sgl = caio->qiocb.sgl;
-		req->write = false;
-		req->dma_mapped = false;
-		req->udd_len = 0;
-		req->ep_addr = (u64)pos;
-		req->count = io->iov_len;
-		req->timeout_ms = 10 * 1000;	/* 10 seconds */
-		req->fp_done = NULL;		/* blocking */
+		/* a bvec is physically contiguous, may span pages */
+		nbytes = min_t(size_t, bv->bv_len - skip, len);
 
-		iocb->private = caio;
-		caio->iocb = iocb;
-		caio->write = false;
-		caio->cancel = false;
-		spin_lock_init(&caio->lock);
+		sg->next = sg + 1;
+		sg->pg = bv->bv_page;
+		sg->offset = bv->bv_offset + skip;
+		sg->len = nbytes;
+		sg->dma_addr = 0UL;
 
-		kiocb_set_cancel_fn(caio->iocb, caio_cancel);
-		INIT_WORK(&caio->wrk_itm, async_io_handler);
-		queue_work(xcdev->aio_wq, &caio->wrk_itm);
+		sg++;
+		skip = 0;
+		len -= nbytes;
 	}
 
-	return -EIOCBQUEUED;
+	(sg - 1)->next = NULL;
+	/* iocb->pages stays NULL: the pages are not ours to release */
+	iocb->sgcnt = sg - iocb->sgl;
+	return 0;
+}
+
+static ssize_t cdev_aio_rw_bvec(struct kiocb *iocb, struct iov_iter *io,
+				bool write)
+{
+	struct cdev_async_io *caio;
+	int rv;
+
+	caio = kmem_cache_alloc(cdev_cache, GFP_KERNEL);
+	if (!caio)
+		return -ENOMEM;
+	memset(caio, 0, sizeof(struct cdev_async_io));
+
+	rv = map_bvec_to_sgl(&caio->qiocb, io);
+	if (rv < 0) {
+		kmem_cache_free(cdev_cache, caio);
+		return rv;
+	}
+
+	return cdev_aio_submit(iocb, caio, iocb->ki_pos, write);
+}
+#endif
+
+static ssize_t cdev_rw_iter(struct kiocb *iocb, struct iov_iter *io,
+				bool write)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+	struct iovec iov;
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,20,0)
+	if (iov_iter_is_bvec(io)) {
+		struct qdma_cdev_file *xcf = iocb->ki_filp->private_data;
+
+		if (!xcf || !xcf->xcdev->fp_rw)
+			return -EINVAL;
+		return cdev_aio_rw_bvec(iocb, io, write);
+	}
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+	/* single user buffer, i.e., io_uring IORING_OP_READ/WRITE */
+	if (iter_is_ubuf(io)) {
+		iov.iov_base = io->ubuf + io->iov_offset;
+		iov.iov_len = iov_iter_count(io);
+		return cdev_aio_rw(iocb, &iov, 1, iocb->ki_pos, write);
+	}
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0)
+	/* i.e., pipe or kvec iterators */
+	if (!iter_is_iovec(io))
+		return -EINVAL;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0)
+	return cdev_aio_rw(iocb, iter_iov(io), io->nr_segs, iocb->ki_pos,
+			write);
+#else
+	return cdev_aio_rw(iocb, io->iov, io->nr_segs, iocb->ki_pos, write);
+#endif
 }
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
 static ssize_t cdev_write_iter(struct kiocb *iocb, struct iov_iter *io)
 {
-	return cdev_aio_write(iocb, io->iov, io->nr_segs, io->iov_offset);
+	return cdev_rw_iter(iocb, io, true);
 }
 
 static ssize_t cdev_read_iter(struct kiocb *iocb, struct iov_iter *io)
 {
-	return cdev_aio_read(iocb, io->iov, io->nr_segs, io->iov_offset);
+	return cdev_rw_iter(iocb, io, false);
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+/*
+ * io_uring IORING_OP_URING_CMD: queue specific operations, completed inline
+ */
+static int cdev_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+	struct qdma_cdev_file *xcf =
+			(struct qdma_cdev_file *)ioucmd->file->private_data;
+	struct qdma_cdev *xcdev = xcf ? xcf->xcdev : NULL;
+	const struct qdma_uring_cmd *cmd;
+	struct qdma_c2h_peek peek;
+	unsigned long dev_hndl;
+	unsigned long qhndl;
+	int rv;
+
+	if (!xcdev)
+		return -EINVAL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,6,0)
+	cmd = io_uring_sqe_cmd(ioucmd->sqe);
+#else
+	cmd = (const struct qdma_uring_cmd *)ioucmd->cmd;
+#endif
+	dev_hndl = xcdev->xcb->xpdev->dev_hndl;
+
+	switch (ioucmd->cmd_op) {
+	case QDMA_URING_CMD_AVAIL_DESC:
+		qhndl = READ_ONCE(cmd->write) ? xcdev->h2c_qhndl :
+						xcdev->c2h_qhndl;
+		if (!qhndl)
+			return -EINVAL;
+		return qdma_queue_avail_desc(dev_hndl, qhndl);
+	case QDMA_URING_CMD_C2H_PEEK:
+		if (!xcdev->c2h_qhndl)
+			return -EINVAL;
+		memset(&peek, 0, sizeof(peek));
+		rv = qdma_queue_c2h_peek(dev_hndl, xcdev->c2h_qhndl,
+				&peek.udd_cnt, &peek.pkt_cnt, &peek.data_len);
+		if (rv < 0)
+			return rv;
+		if (copy_to_user(u64_to_user_ptr(READ_ONCE(cmd->addr)), &peek,
+				sizeof(peek)))
+			return -EFAULT;
+		return peek.pkt_cnt;
+	default:
+		pr_info("%s uring cmd %u NOT supported.\n",
+			xcdev->name, ioucmd->cmd_op);
+		return -ENOTTY;
+	}
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+static void cdev_pipe_buf_release(struct pipe_inode_info *pipe,
+				struct pipe_buffer *buf)
+{
+	put_page(buf->page);
+}
+
+static const struct pipe_buf_operations cdev_pipe_buf_ops = {
+	.release = cdev_pipe_buf_release,
+	.get = generic_pipe_buf_get,
+};
+
+static void cdev_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	put_page(spd->pages[i]);
+}
+
+/*
+ * st c2h: the received freelist buffers are moved into the pipe, the data
+ * is not copied. mm c2h: dma'ed into newly allocated pipe pages (6.5+), or
+ * read into the pipe via read_iter.
+ */
+static ssize_t cdev_splice_read(struct file *file, loff_t *ppos,
+				struct pipe_inode_info *pipe, size_t len,
+				unsigned int flags)
+{
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf ? xcf->xcdev : NULL;
+	struct qdma_sw_sg sgl[PIPE_DEF_BUFFERS];
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.ops = &cdev_pipe_buf_ops,
+		.spd_release = cdev_spd_release,
+	};
+	bool wait = !(file->f_flags & O_NONBLOCK) &&
+			!(flags & SPLICE_F_NONBLOCK);
+	unsigned int room;
+	int i, rv;
+
+	if (!xcdev || !xcdev->c2h_qhndl)
+		return -EINVAL;
+
+	/* the buffers taken off the queue must all fit in the pipe */
+	room = pipe->max_usage - pipe_occupancy(pipe->head, pipe->tail);
+	room = min_t(unsigned int, room, PIPE_DEF_BUFFERS);
+	if (!room)
+		return -EAGAIN;
+	len = min_t(size_t, len, (size_t)room << PAGE_SHIFT);
+
+retry:
+	rv = qdma_queue_c2h_pages_take(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->c2h_qhndl, sgl, PIPE_DEF_BUFFERS,
+				len, room, wait);
+	if (rv == -EOPNOTSUPP)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+		return copy_splice_read(file, ppos, pipe, len, flags);
+#else
+		return generic_file_splice_read(file, ppos, pipe, len, flags);
+#endif
+	if (rv < 0)
+		return rv;
+
+	for (i = 0; i < rv; i++) {
+		struct qdma_sw_sg *sg = sgl + i;
+		unsigned int off = sg->offset;
+		unsigned int left = sg->len;
+
+		/* one pipe buffer per page of the (compound) buffer */
+		while (left) {
+			unsigned int nbytes = min_t(unsigned int, left,
+						PAGE_SIZE - offset_in_page(off));
+			struct page *pg = nth_page(sg->pg, off >> PAGE_SHIFT);
+
+			get_page(pg);
+			pages[spd.nr_pages] = pg;
+			partial[spd.nr_pages].offset = offset_in_page(off);
+			partial[spd.nr_pages].len = nbytes;
+			spd.nr_pages++;
+
+			off += nbytes;
+			left -= nbytes;
+		}
+		/* the freelist's reference */
+		put_page(sg->pg);
+	}
+
+	/* zero length packets only */
+	if (!spd.nr_pages) {
+		if (wait)
+			goto retry;
+		return -EAGAIN;
+	}
+
+	return splice_to_pipe(pipe, &spd);
 }
 #endif
 
+/*
+ * readable: st c2h data received (mm: free c2h descriptors)
+ * writable: free h2c descriptors
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+static __poll_t cdev_gen_poll(struct file *file, poll_table *wait)
+#else
+static unsigned int cdev_gen_poll(struct file *file, poll_table *wait)
+#endif
+{
+	struct qdma_cdev_file *xcf = (struct qdma_cdev_file *)file->private_data;
+	struct qdma_cdev *xcdev = xcf ? xcf->xcdev : NULL;
+	unsigned long dev_hndl;
+	unsigned int mask = 0;
+
+	if (!xcdev)
+		return POLLERR;
+	dev_hndl = xcdev->xcb->xpdev->dev_hndl;
+
+	/* woken up when an i/o completes under the inflight limit */
+	poll_wait(file, &xcf->wq, wait);
+
+	if (xcdev->c2h_qhndl && !cdev_inflight_full(xcf, false))
+		mask |= qdma_queue_poll(dev_hndl, xcdev->c2h_qhndl, file, wait);
+	if (xcdev->h2c_qhndl && !cdev_inflight_full(xcf, true))
+		mask |= qdma_queue_poll(dev_hndl, xcdev->h2c_qhndl, file, wait);
+
+	return mask;
+}
+
 static const struct file_operations cdev_gen_fops = {
 	.owner = THIS_MODULE,
 	.open = cdev_gen_open,
@@ -551,6 +1956,18 @@ static const struct file_operations cdev_gen_fops = {
 #endif
 	.unlocked_ioctl = cdev_gen_ioctl,
 	.llseek = cdev_gen_llseek,
+	.poll = cdev_gen_poll,
+	.mmap = cdev_gen_mmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+	.splice_read = cdev_splice_read,
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)
+	/* h2c: the pipe pages are dma'ed from as is, via write_iter (bvec) */
+	.splice_write = iter_file_splice_write,
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+	.uring_cmd = cdev_uring_cmd,
+#endif
 };
 
 /*
@@ -605,13 +2022,12 @@ int qdma_cdev_create(struct qdma_cdev_cb *xcb, struct pci_dev *pdev,
 		return -ENOMEM;
 	}
 
-	spin_lock_init(&xcdev->c2h_lock);
-	spin_lock_init(&xcdev->h2c_lock);
 	xcdev->cdev.owner = THIS_MODULE;
 	xcdev->xcb = xcb;
 	priv_data = qconf->c2h ? &xcdev->c2h_qhndl : &xcdev->h2c_qhndl;
 	*priv_data = qhndl;
 	xcdev->dir_init = (1 << qconf->c2h);
+	xcdev->st = qconf->st;
 	strcpy(xcdev->name, qconf->name);
 
 	xcdev->minor = minor;
@@ -19,6 +19,7 @@
 
 #include "libqdma/libqdma_export.h"
 #include <linux/workqueue.h>
+#include <linux/dma-direction.h>
 
 #define QDMA_CDEV_CLASS_NAME  DRV_MODULE_NAME
 
@@ -32,6 +33,8 @@ struct qdma_cdev_cb {
 	int cdev_minor_cnt;
 };
 
+struct qdma_cdev_bypass;
+
 struct qdma_cdev {
 	struct list_head list_head;
 	int minor;
@@ -43,9 +46,10 @@ struct qdma_cdev {
 	unsigned long c2h_qhndl;
 	unsigned long h2c_qhndl;
 	unsigned short dir_init;
+	unsigned short st;		/* st c2h data is copied by the cpu */
 	struct workqueue_struct *aio_wq;
-	spinlock_t c2h_lock;
-	spinlock_t h2c_lock;
+	/* kernel bypass owner, protected by xpdev->cdev_lock */
+	struct qdma_cdev_bypass *bypass;
 
 	int (*fp_open_extra)(struct qdma_cdev *);
 	int (*fp_close_extra)(struct qdma_cdev *);
@@ -55,12 +59,17 @@ struct qdma_cdev {
 	char name[0];
 };
 
+struct qdma_cdev_buf;
+
 struct qdma_io_cb {
 	void __user *buf;
 	size_t len;
-	unsigned int pages_nr;
+	unsigned int pages_nr;		/* # of pages pinned */
+	unsigned int sgcnt;		/* # of sgl entries */
 	struct qdma_sw_sg *sgl;
 	struct page **pages;
+	struct qdma_cdev_buf *rbuf;	/* registered buffer, if used */
+	enum dma_data_direction rbuf_dir; /* synced for the device, if any */
 
 	struct qdma_request req;
 };
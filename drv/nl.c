@@ -15,6 +15,7 @@
 #include <linux/version.h>
 #include <linux/kernel.h>
 #include <linux/pci.h>
+#include <linux/ktime.h>
 #include <net/genetlink.h>
 
 #include "libqdma/libqdma_export.h"
@@ -54,6 +55,14 @@ static struct nla_policy xnl_policy[XNL_ATTR_MAX] = {
 	[XNL_ATTR_RANGE_END] =		{ .type = NLA_U32 },
 
 	[XNL_ATTR_INTR_VECTOR_IDX] =	{ .type = NLA_U32 },
+	[XNL_ATTR_MM_CHANNEL] =		{ .type = NLA_U32 },
+	[XNL_ATTR_QOS_PRIO] =		{ .type = NLA_U32 },
+	[XNL_ATTR_QOS_WEIGHT] =		{ .type = NLA_U32 },
+	[XNL_ATTR_RATE_BPS] =		{ .type = NLA_U64 },
+	[XNL_ATTR_RATE_DPS] =		{ .type = NLA_U32 },
+	[XNL_ATTR_BURST_BYTES] =	{ .type = NLA_U32 },
+	[XNL_ATTR_BURST_DESC] =		{ .type = NLA_U32 },
+	[XNL_ATTR_Q_STATUS] =		{ .type = NLA_BINARY },
 
 #ifdef ERR_DEBUG
 	[XNL_ATTR_QPARAM_ERR_SEL1] =    { .type = NLA_U32 },
@@ -69,6 +78,8 @@ static int xnl_q_list(struct sk_buff *, struct genl_info *);
 static int xnl_q_add(struct sk_buff *, struct genl_info *);
 static int xnl_q_start(struct sk_buff *, struct genl_info *);
 static int xnl_q_stop(struct sk_buff *, struct genl_info *);
+static int xnl_q_rate(struct sk_buff *, struct genl_info *);
+static int xnl_q_restart(struct sk_buff *, struct genl_info *);
 static int xnl_q_del(struct sk_buff *, struct genl_info *);
 static int xnl_q_dump(struct sk_buff *, struct genl_info *);
 static int xnl_q_dump_desc(struct sk_buff *, struct genl_info *);
@@ -140,6 +151,16 @@ struct genl_ops xnl_ops[] = {
 		.policy = xnl_policy,
 		.doit = xnl_intr_ring_dump,
 	},
+	{
+		.cmd = XNL_CMD_Q_RATE,
+		.policy = xnl_policy,
+		.doit = xnl_q_rate,
+	},
+	{
+		.cmd = XNL_CMD_Q_RESTART,
+		.policy = xnl_policy,
+		.doit = xnl_q_restart,
+	},
 #ifdef ERR_DEBUG
 	{
 		.cmd = XNL_CMD_Q_ERR_INDUCE,
@@ -305,6 +326,39 @@ static int xnl_respond_buffer(struct genl_info *info, char *buf, int buflen)
 	return rv;
 }
 
+/*
+ * respond to a bulk queue operation: the summary in @buf and the result of
+ * each of the @cnt queues, see XNL_ATTR_Q_STATUS
+ */
+static int xnl_respond_status(struct genl_info *info, char *buf, int *status,
+				unsigned int cnt)
+{
+	struct sk_buff *skb;
+	void *hdr;
+	int rv;
+
+	skb = xnl_msg_alloc(info->genlhdr->cmd,
+			XNL_RESP_BUFLEN_MAX + cnt * sizeof(*status), &hdr, info);
+	if (!skb)
+		return -ENOMEM;
+
+	rv = xnl_msg_add_attr_str(skb, XNL_ATTR_GENMSG, buf);
+	if (rv != 0) {
+		pr_err("xnl_msg_add_attr_str() failed: %d", rv);
+		nlmsg_free(skb);
+		return rv;
+	}
+
+	rv = nla_put(skb, XNL_ATTR_Q_STATUS, cnt * sizeof(*status), status);
+	if (rv != 0) {
+		pr_err("nla_put() status of %u queues failed: %d", cnt, rv);
+		nlmsg_free(skb);
+		return rv;
+	}
+
+	return xnl_msg_send(skb, hdr, info);
+}
+
 static char *xnl_mem_alloc(int l, struct genl_info *info)
 {
 	char ebuf[XNL_ERR_BUFLEN];
@@ -446,6 +500,15 @@ static int xnl_chk_attr(enum xnl_attr_t xnl_attr, struct genl_info *info,
 	return rv;
 }
 
+/* a range of queues: at most all of the device's, within xpdev->qmax */
+static bool xnl_num_q_valid(struct xlnx_pci_dev *xpdev, unsigned short qidx,
+			unsigned int num_q)
+{
+	if (!num_q || num_q > xpdev->qmax)
+		return false;
+	return qidx == QDMA_QUEUE_IDX_INVALID || qidx + num_q <= xpdev->qmax;
+}
+
 static void xnl_extract_extra_config_attr(struct genl_info *info,
                                  struct qdma_queue_conf *qconf)
 {
@@ -481,6 +544,16 @@ static void xnl_extract_extra_config_attr(struct genl_info *info,
 				nla_get_u32(info->attrs[XNL_ATTR_WRB_TRIG_MODE]);
 	else
 		qconf->cmpl_trig_mode = 1;
+	if (info->attrs[XNL_ATTR_MM_CHANNEL]) {
+		qconf->mm_chnl_fixed = 1;
+		qconf->mm_channel =
+				nla_get_u32(info->attrs[XNL_ATTR_MM_CHANNEL]);
+	}
+	if (info->attrs[XNL_ATTR_QOS_PRIO])
+		qconf->qos_prio = nla_get_u32(info->attrs[XNL_ATTR_QOS_PRIO]);
+	if (info->attrs[XNL_ATTR_QOS_WEIGHT])
+		qconf->qos_weight =
+				nla_get_u32(info->attrs[XNL_ATTR_QOS_WEIGHT]);
 }
 
 static int xnl_dev_list(struct sk_buff *skb2, struct genl_info *info)
@@ -610,12 +683,18 @@ static int xnl_q_add(struct sk_buff *skb2, struct genl_info *info)
 {
 	struct xlnx_pci_dev *xpdev = NULL;
 	struct qdma_queue_conf qconf;
+	char ebuf[XNL_RESP_BUFLEN_MIN];
 	char* buf, * cur, * end;
+	int *status = NULL;
+	ktime_t start;
+	s64 elapsed;
 	int rv;
 	int rv2;
 	unsigned char is_qp;
 	unsigned int num_q;
 	unsigned int i;
+	unsigned int cnt = 0;
+	unsigned int added = 0;
 	unsigned short qidx;
 	unsigned char is_c2h;
 
@@ -645,29 +724,66 @@ static int xnl_q_add(struct sk_buff *skb2, struct genl_info *info)
 	if (rv < 0)
 		goto send_resp;
 	num_q = nla_get_u32(info->attrs[XNL_ATTR_NUM_Q]);
+	if (!xnl_num_q_valid(xpdev, qidx, num_q)) {
+		cur += snprintf(cur, end - cur,
+				"ERR! %u queues from %u, qmax %u.\n",
+				num_q, qidx, xpdev->qmax);
+		rv = -EINVAL;
+		goto send_resp;
+	}
+
+	status = kcalloc(num_q, (is_qp ? 2 : 1) * sizeof(*status), GFP_KERNEL);
+	if (!status) {
+		cur += snprintf(cur, end - cur, "ERR! %u queues, OOM.\n", num_q);
+		rv = -ENOMEM;
+		goto send_resp;
+	}
 
+	/* the queues added and the 1st one failed are reported in the status */
+	start = ktime_get();
 	is_c2h = qconf.c2h;
 	for (i = 0; i < num_q; i++) {
 		qconf.c2h = is_c2h;
 add_q:
 		if (qidx != QDMA_QUEUE_IDX_INVALID)
 			qconf.qidx = qidx + i;
-		rv = xpdev_queue_add(xpdev, &qconf, cur, end - cur);
+		ebuf[0] = '\0';
+		rv = xpdev_queue_add(xpdev, &qconf, ebuf, XNL_RESP_BUFLEN_MIN);
 		if (rv < 0) {
 			pr_err("xpdev_queue_add() failed: %d", rv);
-			goto send_resp;
-		}
-		cur = buf + strlen(buf);
+			if (cur < end)
+				cur += snprintf(cur, end - cur, "%s", ebuf);
+		} else
+			added++;
+		status[cnt++] = rv < 0 ? rv : 0;
+		if (rv < 0)
+			break;
 		if (is_qp && (is_c2h == qconf.c2h)) {
 			qconf.c2h = ~qconf.c2h;
 			goto add_q;
 		}
 	}
-	cur += snprintf(cur, end - cur, "Added %d Queues.\n", i);
+	elapsed = ktime_us_delta(ktime_get(), start);
+	pr_info("qdma%d: added %u of %u queues in %lld us.\n",
+		xpdev->idx, added, cnt, elapsed);
+
+	if (cur < end) {
+		if (added == cnt)
+			snprintf(cur, end - cur, "Added %d Queues in %lld us.\n",
+				i, elapsed);
+		else
+			snprintf(cur, end - cur,
+				"Added %u of %u Queues in %lld us.\n",
+				added, num_q * (is_qp ? 2 : 1), elapsed);
+	}
+	rv2 = xnl_respond_status(info, buf, status, cnt);
+	rv = added ? 0 : rv;
+	goto free_buf;
 
 send_resp:
 	rv2 = xnl_respond_buffer(info, buf, strlen(buf));
 free_buf:
+	kfree(status);
 	kfree(buf);
 	return rv < 0 ? rv : rv2;
 }
@@ -678,10 +794,15 @@ static int xnl_q_start(struct sk_buff *skb2, struct genl_info *info)
 	struct qdma_queue_conf qconf;
 	char buf[XNL_RESP_BUFLEN_MIN];
 	struct xlnx_qdata *qdata;
+	unsigned long *qhndls = NULL;
+	int *status = NULL;
+	ktime_t start;
+	s64 elapsed;
 	int rv;
 	unsigned char is_qp;
-	unsigned short num_q;
+	unsigned int num_q;
 	unsigned int i;
+	unsigned int cnt = 0;
 	unsigned short qidx;
 	unsigned char is_c2h;
 
@@ -704,6 +825,20 @@ static int xnl_q_start(struct sk_buff *skb2, struct genl_info *info)
 	if (rv < 0)
 		goto send_resp;
 	num_q = nla_get_u32(info->attrs[XNL_ATTR_NUM_Q]);
+	if (!xnl_num_q_valid(xpdev, qidx, num_q)) {
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"ERR! %u queues from %u, qmax %u.\n",
+			num_q, qidx, xpdev->qmax);
+		goto send_resp;
+	}
+
+	qhndls = kcalloc(num_q, (is_qp ? 2 : 1) * sizeof(*qhndls), GFP_KERNEL);
+	status = kcalloc(num_q, (is_qp ? 2 : 1) * sizeof(*status), GFP_KERNEL);
+	if (!qhndls || !status) {
+		snprintf(buf, XNL_RESP_BUFLEN_MIN, "ERR! %u queues, OOM.\n",
+			num_q);
+		goto send_resp;
+	}
 
 	xnl_extract_extra_config_attr(info, &qconf);
 	is_c2h = qconf.c2h;
@@ -714,38 +849,175 @@ start_q:
 		qdata = xnl_rcv_check_qidx(info, xpdev, &qconf, buf,
 					XNL_RESP_BUFLEN_MIN);
 		if (!qdata)
-			goto send_resp;
+			goto free_buf;
 
 		rv = qdma_queue_reconfig(xpdev->dev_hndl, qdata->qhndl, &qconf,
-		                         buf, XNL_RESP_BUFLEN_MAX);
+		                         buf, XNL_RESP_BUFLEN_MIN);
 		if (rv < 0) {
 			pr_err("qdma_queue_reconfig() failed: %d", rv);
 			goto send_resp;
 		}
+		qhndls[cnt++] = qdata->qhndl;
 
-		rv = qdma_queue_start(xpdev->dev_hndl, qdata->qhndl,
-		                      buf, XNL_RESP_BUFLEN_MIN);
-		if (rv < 0) {
-			pr_err("qdma_queue_start() failed: %d", rv);
-			goto send_resp;
-		}
 		if (is_qp && (is_c2h == qconf.c2h)) {
 			qconf.c2h = ~qconf.c2h;
 			goto start_q;
 		}
 	}
-	rv += sprintf(buf + rv, "Started Queues %d -> %d.\n", qidx, i - 1);
-	buf[rv] = '\0';
+
+	start = ktime_get();
+	rv = qdma_queue_start_bulk(xpdev->dev_hndl, qhndls, cnt, status);
+	if (rv < 0) {
+		pr_err("qdma_queue_start_bulk() failed: %d", rv);
+		snprintf(buf, XNL_RESP_BUFLEN_MIN, "ERR! start failed %d.\n",
+			rv);
+		goto send_resp;
+	}
+	elapsed = ktime_us_delta(ktime_get(), start);
+	pr_info("qdma%d: started %d of %u queues in %lld us.\n",
+		xpdev->idx, rv, cnt, elapsed);
+
+	if (rv == cnt)
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"Started Queues %d -> %d in %lld us.\n",
+			qidx, i - 1, elapsed);
+	else
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"Started %d of %u Queues %d -> %d in %lld us.\n",
+			rv, cnt, qidx, i - 1, elapsed);
+	rv = xnl_respond_status(info, buf, status, cnt);
+	goto free_buf;
+
 send_resp:
 	rv = xnl_respond_buffer(info, buf, XNL_RESP_BUFLEN_MIN);
+free_buf:
+	kfree(status);
+	kfree(qhndls);
+	return rv;
+}
+
+/* q stop, or q restart with the rings kept */
+static int xnl_q_stop_bulk(struct genl_info *info, bool restart)
+{
+	const char *op = restart ? "Restarted" : "Stopped";
+	struct xlnx_pci_dev *xpdev;
+	struct qdma_queue_conf qconf;
+	char buf[XNL_RESP_BUFLEN_MIN];
+	struct xlnx_qdata *qdata;
+	unsigned long *qhndls = NULL;
+	int *status = NULL;
+	ktime_t start;
+	s64 elapsed;
+	int rv;
+	unsigned char is_qp;
+	unsigned int num_q;
+	unsigned int i;
+	unsigned int cnt = 0;
+	unsigned short qidx;
+	unsigned char is_c2h;
+
+	if (info == NULL)
+		return 0;
+
+	xnl_dump_attrs(info);
 
+	xpdev = xnl_rcv_check_xpdev(info);
+	if (!xpdev)
+		return 0;
+
+	rv = qconf_get(&qconf, info, buf, XNL_RESP_BUFLEN_MIN, &is_qp);
+	if (rv < 0)
+		goto send_resp;
+
+	if (!info->attrs[XNL_ATTR_NUM_Q]) {
+		pr_warn("Missing attribute 'XNL_ATTR_NUM_Q'");
+		return -1;
+	}
+	num_q = nla_get_u32(info->attrs[XNL_ATTR_NUM_Q]);
+	qidx = qconf.qidx;
+	if (!xnl_num_q_valid(xpdev, qidx, num_q)) {
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"ERR! %u queues from %u, qmax %u.\n",
+			num_q, qidx, xpdev->qmax);
+		goto send_resp;
+	}
+
+	qhndls = kcalloc(num_q, (is_qp ? 2 : 1) * sizeof(*qhndls), GFP_KERNEL);
+	status = kcalloc(num_q, (is_qp ? 2 : 1) * sizeof(*status), GFP_KERNEL);
+	if (!qhndls || !status) {
+		snprintf(buf, XNL_RESP_BUFLEN_MIN, "ERR! %u queues, OOM.\n",
+			num_q);
+		goto send_resp;
+	}
+
+	is_c2h = qconf.c2h;
+	for (i = qidx; i < (qidx + num_q); i++) {
+		qconf.c2h = is_c2h;
+stop_q:
+		qconf.qidx = i;
+		qdata = xnl_rcv_check_qidx(info, xpdev, &qconf, buf,
+					XNL_RESP_BUFLEN_MIN);
+		if (!qdata)
+			goto free_buf;
+		qhndls[cnt++] = qdata->qhndl;
+
+		if (is_qp && (is_c2h == qconf.c2h)) {
+			qconf.c2h = ~qconf.c2h;
+			goto stop_q;
+		}
+	}
+
+	start = ktime_get();
+	if (restart)
+		rv = qdma_queue_restart_bulk(xpdev->dev_hndl, qhndls, cnt,
+					status);
+	else
+		rv = qdma_queue_stop_bulk(xpdev->dev_hndl, qhndls, cnt, status);
+	if (rv < 0) {
+		pr_err("qdma_queue_%s_bulk() failed: %d",
+			restart ? "restart" : "stop", rv);
+		snprintf(buf, XNL_RESP_BUFLEN_MIN, "ERR! %s failed %d.\n",
+			restart ? "restart" : "stop", rv);
+		goto send_resp;
+	}
+	elapsed = ktime_us_delta(ktime_get(), start);
+	pr_info("qdma%d: %s %d of %u queues in %lld us.\n",
+		xpdev->idx, op, rv, cnt, elapsed);
+
+	if (rv == cnt)
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"%s Queues %d -> %d in %lld us.\n",
+			op, qidx, i - 1, elapsed);
+	else
+		snprintf(buf, XNL_RESP_BUFLEN_MIN,
+			"%s %d of %u Queues %d -> %d in %lld us.\n",
+			op, rv, cnt, qidx, i - 1, elapsed);
+	rv = xnl_respond_status(info, buf, status, cnt);
+	goto free_buf;
+
+send_resp:
+	rv = xnl_respond_buffer(info, buf, XNL_RESP_BUFLEN_MIN);
+free_buf:
+	kfree(status);
+	kfree(qhndls);
 	return rv;
 }
 
 static int xnl_q_stop(struct sk_buff *skb2, struct genl_info *info)
+{
+	return xnl_q_stop_bulk(info, false);
+}
+
+static int xnl_q_restart(struct sk_buff *skb2, struct genl_info *info)
+{
+	return xnl_q_stop_bulk(info, true);
+}
+
+static int xnl_q_rate(struct sk_buff *skb2, struct genl_info *info)
 {
 	struct xlnx_pci_dev *xpdev;
 	struct qdma_queue_conf qconf;
+	struct qdma_queue_rate rate;
 	char buf[XNL_RESP_BUFLEN_MIN];
 	struct xlnx_qdata *qdata;
 	int rv;
@@ -774,28 +1046,45 @@ static int xnl_q_stop(struct sk_buff *skb2, struct genl_info *info)
 	}
 	num_q = nla_get_u32(info->attrs[XNL_ATTR_NUM_Q]);
 
+	/* no attribute: no limit */
+	memset(&rate, 0, sizeof(rate));
+	if (info->attrs[XNL_ATTR_RATE_BPS])
+		rate.bytes_ps = nla_get_u64(info->attrs[XNL_ATTR_RATE_BPS]);
+	if (info->attrs[XNL_ATTR_RATE_DPS])
+		rate.desc_ps = nla_get_u32(info->attrs[XNL_ATTR_RATE_DPS]);
+	if (info->attrs[XNL_ATTR_BURST_BYTES])
+		rate.burst_bytes =
+			nla_get_u32(info->attrs[XNL_ATTR_BURST_BYTES]);
+	if (info->attrs[XNL_ATTR_BURST_DESC])
+		rate.burst_desc = nla_get_u32(info->attrs[XNL_ATTR_BURST_DESC]);
+
 	qidx = qconf.qidx;
 	is_c2h = qconf.c2h;
 	for (i = qidx; i < (qidx + num_q); i++) {
 		qconf.c2h = is_c2h;
-stop_q:
+rate_q:
 		qconf.qidx = i;
 		qdata = xnl_rcv_check_qidx(info, xpdev, &qconf, buf,
 					XNL_RESP_BUFLEN_MIN);
 		if (!qdata)
 			goto send_resp;
-		rv = qdma_queue_stop(xpdev->dev_hndl, qdata->qhndl, buf,
-					XNL_RESP_BUFLEN_MIN);
+		rv = qdma_queue_set_rate(xpdev->dev_hndl, qdata->qhndl, &rate,
+					buf, XNL_RESP_BUFLEN_MIN);
 		if (rv < 0) {
-			pr_err("qdma_queue_stop() failed: %d", rv);
+			pr_err("qdma_queue_set_rate() failed: %d", rv);
 			goto send_resp;
 		}
 		if (is_qp && (is_c2h == qconf.c2h)) {
 			qconf.c2h = ~qconf.c2h;
-			goto stop_q;
+			goto rate_q;
 		}
 	}
-	rv += sprintf(buf + rv, "Stopped Queues %d -> %d.\n", qidx, i - 1);
+	if (rate.bytes_ps || rate.desc_ps)
+		rv = sprintf(buf, "Queues %d -> %d, rate %llu B/s, %u desc/s.\n",
+			qidx, i - 1, rate.bytes_ps, rate.desc_ps);
+	else
+		rv = sprintf(buf, "Queues %d -> %d, no rate limit.\n",
+			qidx, i - 1);
 	buf[rv] = '\0';
 send_resp:
 	rv = xnl_respond_buffer(info, buf, XNL_RESP_BUFLEN_MIN);
@@ -870,6 +1159,7 @@ static int xnl_q_dump(struct sk_buff *skb2, struct genl_info *info)
 	unsigned int i;
 	unsigned short qidx;
 	unsigned char is_c2h;
+	bool ctxt_hw;
 	int buf_len = XNL_RESP_BUFLEN_MAX;
 
 	if (info == NULL)
@@ -884,6 +1174,7 @@ static int xnl_q_dump(struct sk_buff *skb2, struct genl_info *info)
 	rv = qconf_get(&qconf, info, ebuf, XNL_RESP_BUFLEN_MIN, &is_qp);
 	if (rv < 0)
 		return rv;
+	ctxt_hw = nla_get_u32(info->attrs[XNL_ATTR_QFLAG]) & XNL_F_CTXT_HW;
 
 	if (info->attrs[XNL_ATTR_RSP_BUF_LEN])
 		buf_len =  nla_get_u32(info->attrs[XNL_ATTR_RSP_BUF_LEN]);
@@ -907,8 +1198,12 @@ dump_q:
 					XNL_RESP_BUFLEN_MIN);
 		if (!qdata)
 			goto send_resp;
-		rv = qdma_queue_dump(xpdev->dev_hndl, qdata->qhndl, buf,
-		                     buf_len);
+		if (ctxt_hw)
+			rv = qdma_queue_dump_hw(xpdev->dev_hndl, qdata->qhndl,
+						buf, buf_len);
+		else
+			rv = qdma_queue_dump(xpdev->dev_hndl, qdata->qhndl,
+						buf, buf_len);
 		if (rv < 0) {
 			pr_err("qdma_queue_dump() failed: %d", rv);
 			goto send_resp;
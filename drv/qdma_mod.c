@@ -43,6 +43,30 @@ static unsigned int ind_intr_mode = 0;
 module_param(ind_intr_mode, uint, 0644);
 MODULE_PARM_DESC(ind_intr_mode, "enable interrupt aggregation");
 
+static unsigned int intr_inline_en = 0;
+module_param(intr_inline_en, uint, 0644);
+MODULE_PARM_DESC(intr_inline_en, "interrupt mode: service completions in the irq thread instead of the system workqueue");
+
+static unsigned int intr_budget = 64;
+module_param(intr_budget, uint, 0644);
+MODULE_PARM_DESC(intr_budget, "max. # of completions serviced per queue per interrupt with intr_inline_en, 0 = no limit");
+
+static unsigned int intr_adaptive_en = 0;
+module_param(intr_adaptive_en, uint, 0644);
+MODULE_PARM_DESC(intr_adaptive_en, "interrupt mode: switch busy queues to polling and back to interrupt when traffic drops");
+
+static unsigned int intr_poll_th = 32;
+module_param(intr_poll_th, uint, 0644);
+MODULE_PARM_DESC(intr_poll_th, "# of completions serviced in one interrupt to switch a queue to polling with intr_adaptive_en, 0 = never");
+
+static unsigned int intr_irq_th = 4;
+module_param(intr_irq_th, uint, 0644);
+MODULE_PARM_DESC(intr_irq_th, "a polling pass with fewer completions switches a queue back to interrupt with intr_adaptive_en");
+
+static unsigned int ctxt_verify = 1;
+module_param(ctxt_verify, uint, 0644);
+MODULE_PARM_DESC(ctxt_verify, "read back and compare the queue contexts programmed, 0 = skip for faster queue start");
+
 static unsigned int master_pf = 0;
 module_param(master_pf, uint, 0644);
 MODULE_PARM_DESC(master_pf, "Master PF for setting global CSRs, dflt PF 0");
@@ -426,6 +450,16 @@ int xpdev_queue_delete(struct xlnx_pci_dev *xpdev, unsigned int qidx, bool c2h,
 		return -EINVAL;
 
 	spin_lock(&xpdev->cdev_lock);
+	/* driven from user space, see QDMA_CDEV_IOC_BYPASS */
+	if (qdata->xcdev && qdata->xcdev->bypass) {
+		spin_unlock(&xpdev->cdev_lock);
+		pr_info("qdma%d QID %u in use by user space.\n",
+			xpdev->idx, qidx);
+		if (ebuf && ebuflen)
+			snprintf(ebuf, ebuflen,
+				"QID %u in use by user space.\n", qidx);
+		return -EBUSY;
+	}
 	qdata->xcdev->dir_init &= ~(1 << (c2h ? 1 : 0));
 	if (qdata->xcdev && !qdata->xcdev->dir_init)
 		qdma_cdev_destroy(qdata->xcdev);
@@ -560,6 +594,12 @@ static int probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 	memset(&conf, 0, sizeof(conf));
 	conf.poll_mode = poll_mode_en;
 	conf.intr_agg = ind_intr_mode;
+	conf.intr_inline = intr_inline_en ? 1 : 0;
+	conf.intr_budget = intr_budget;
+	conf.intr_adaptive = intr_adaptive_en ? 1 : 0;
+	conf.intr_poll_th = intr_poll_th;
+	conf.intr_irq_th = intr_irq_th;
+	conf.ctxt_verify = ctxt_verify ? 1 : 0;
 	conf.vf_max = 0;	/* enable via sysfs */
 
 #ifdef __QDMA_VF__
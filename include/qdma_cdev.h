@@ -0,0 +1,186 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+#ifndef QDMA_CDEV_H__
+#define QDMA_CDEV_H__
+
+/*
+ * user interface of the per queue character devices,
+ * i.e., /dev/qdma<N>-<MM|ST>-<idx>
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * io_uring IORING_OP_URING_CMD
+ * sqe->cmd_op is one of enum qdma_uring_cmd_op, the sqe command area holds a
+ * struct qdma_uring_cmd. The result is returned in cqe->res.
+ */
+enum qdma_uring_cmd_op {
+	QDMA_URING_CMD_AVAIL_DESC = 1,	/* res: # of free descriptors */
+	QDMA_URING_CMD_C2H_PEEK,	/* res: # of packets received,
+					   struct qdma_c2h_peek copied to addr */
+};
+
+struct qdma_uring_cmd {
+	__u64 addr;		/* C2H_PEEK: user address of qdma_c2h_peek */
+	__u32 write;		/* AVAIL_DESC: 1 - h2c queue, 0 - c2h queue */
+	__u32 rsvd;
+};
+
+struct qdma_c2h_peek {
+	__u32 udd_cnt;
+	__u32 pkt_cnt;
+	__u32 data_len;
+	__u32 rsvd;
+};
+
+/*
+ * ioctls
+ */
+#define QDMA_CDEV_IOC_MAGIC	'q'
+
+/*
+ * max. # of i/o in flight per direction on this file, 0: no limit.
+ * When the limit is reached, read()/write() wait (-EAGAIN with O_NONBLOCK),
+ * aio/io_uring requests fail with -EAGAIN. The segments of each direction of
+ * a QDMA_CDEV_IOC_MM_XFER count as one i/o, those not submitted for the
+ * limit get its error in their status.
+ */
+#define QDMA_CDEV_IOC_SET_INFLIGHT_MAX	_IOW(QDMA_CDEV_IOC_MAGIC, 1, __u32)
+#define QDMA_CDEV_IOC_GET_INFLIGHT_MAX	_IOR(QDMA_CDEV_IOC_MAGIC, 2, __u32)
+
+/*
+ * register a user buffer: the buffer is pinned and dma mapped once, a
+ * read/write whose buffer falls within a registered buffer skips the per
+ * i/o pinning and mapping. The registration is per open file and is
+ * dropped on close or with QDMA_CDEV_IOC_BUF_UNREG <handle>.
+ * Once the user mapping of the range changes (i.e., munmap), i/o to the
+ * range is pinned per i/o again.
+ * A buffer registered with QDMA_CDEV_BUF_F_H2C_ONLY is pinned read-only
+ * (i.e., a PROT_READ mapping) and is used for writes only.
+ */
+struct qdma_cdev_buf_reg {
+	__u64 addr;		/* user address */
+	__u64 len;		/* length in bytes */
+	__u32 handle;		/* out: registration handle */
+	__u32 flags;		/* QDMA_CDEV_BUF_F_XXX */
+};
+
+#define QDMA_CDEV_BUF_F_H2C_ONLY	0x1
+
+#define QDMA_CDEV_IOC_BUF_REG	_IOWR(QDMA_CDEV_IOC_MAGIC, 3, \
+					struct qdma_cdev_buf_reg)
+#define QDMA_CDEV_IOC_BUF_UNREG	_IOW(QDMA_CDEV_IOC_MAGIC, 4, __u32)
+
+/*
+ * kernel bypass (needs CAP_SYS_RAWIO): QDMA_CDEV_IOC_BYPASS starts the added,
+ * not yet started queues of this cdev with their data path in user space.
+ * The kernel only programs the queue contexts, the process maps the rings and
+ * the doorbell page with mmap() at the offsets returned, posts descriptors
+ * and rings the doorbells itself (see qdma_uq.h). read()/write() on the cdev
+ * fail with -EBUSY meanwhile. The queues are stopped once the file is closed
+ * and all the mappings are gone.
+ * Trust boundary: the doorbell page is a page of the config bar, it also
+ * holds the pidx/cidx doorbells of the 255 neighbouring queues of the
+ * function, which the owner can ring as well, and the device dma's to any
+ * bus address posted. Only hand a bypass cdev to a process trusted with all
+ * the queues of the function.
+ */
+#define QDMA_CDEV_BYPASS_F_VALID	0x1	/* the direction is present */
+#define QDMA_CDEV_BYPASS_F_ST		0x2	/* streaming, otherwise MM */
+
+struct qdma_cdev_bypass_q {
+	__u32 flags;
+	__u32 qid;		/* hw queue index */
+	__u32 rngsz;		/* # of descriptors in the ring */
+	__u32 desc_sz;		/* descriptor size in bytes */
+	__u32 ring_len;		/* ring + status writeback, in bytes */
+	__u32 cmpl_rngsz;	/* st c2h: # of completion entries */
+	__u32 cmpl_sz;		/* st c2h: completion entry size */
+	__u32 cmpl_len;		/* st c2h: completion ring + status, in bytes */
+	__u32 c2h_bufsz;	/* st c2h: size of each rx buffer */
+	__u32 db_off;		/* pidx doorbell offset in the doorbell page */
+	__u32 cmpl_db_off;	/* st c2h: completion cidx doorbell offset */
+	__u32 cmpl_db_flags;	/* st c2h: or'ed into each cidx doorbell write */
+	__u64 ring_mmap_off;	/* mmap() offsets */
+	__u64 cmpl_mmap_off;
+	__u64 db_mmap_off;
+};
+
+struct qdma_cdev_bypass_info {
+	struct qdma_cdev_bypass_q h2c;
+	struct qdma_cdev_bypass_q c2h;
+};
+
+#define QDMA_CDEV_IOC_BYPASS	_IOR(QDMA_CDEV_IOC_MAGIC, 5, \
+					struct qdma_cdev_bypass_info)
+
+/*
+ * bus addresses of a registered buffer for the descriptors posted in kernel
+ * bypass mode (needs CAP_SYS_RAWIO): one per page, from the page holding the
+ * start of the buffer on.
+ */
+struct qdma_cdev_buf_dma {
+	__u32 handle;		/* from QDMA_CDEV_IOC_BUF_REG */
+	__u32 count;		/* # of pages */
+	__u64 addr;		/* user address of a __u64[count] array */
+};
+
+#define QDMA_CDEV_IOC_BUF_DMA	_IOW(QDMA_CDEV_IOC_MAGIC, 6, \
+					struct qdma_cdev_buf_dma)
+
+/*
+ * MM only: a batch of transfers, each between a user buffer and a card
+ * address, in either direction. All are posted at once and the call returns
+ * once all are done: the # of segments transferred in full, the result of
+ * each in its status. A segment within a registered buffer uses it.
+ */
+#define QDMA_CDEV_MM_XFER_MAX	4096	/* max. # of segments per call */
+
+struct qdma_cdev_mm_seg {
+	__u64 addr;		/* user buffer */
+	__u64 ep_addr;		/* card address */
+	__u32 len;		/* length in bytes */
+	__u32 write;		/* 1: h2c (to the card), 0: c2h */
+	__s32 status;		/* out: # of bytes transferred, or -errno */
+	__u32 rsvd;
+};
+
+struct qdma_cdev_mm_xfer {
+	__u64 segs;		/* user address of qdma_cdev_mm_seg[count] */
+	__u32 count;		/* # of segments */
+	__u32 timeout_ms;	/* 0: 10 seconds */
+};
+
+#define QDMA_CDEV_IOC_MM_XFER	_IOW(QDMA_CDEV_IOC_MAGIC, 7, \
+					struct qdma_cdev_mm_xfer)
+
+/*
+ * MM only: read()/write() (incl. aio/io_uring) larger than the stripe size
+ * are split into chunks of it, spread over a set of mm queues of the same
+ * device and transferred in parallel. The queues are given by index, the
+ * ones of the direction of each i/o are used. qcnt 0 turns striping off.
+ */
+#define QDMA_CDEV_STRIPE_QMAX	16
+
+struct qdma_cdev_stripe {
+	__u32 qcnt;		/* # of queues in qidx[] */
+	__u32 chunk;		/* stripe size in bytes, 0: 256KB */
+	__u16 qidx[QDMA_CDEV_STRIPE_QMAX];
+};
+
+#define QDMA_CDEV_IOC_STRIPE	_IOW(QDMA_CDEV_IOC_MAGIC, 8, \
+					struct qdma_cdev_stripe)
+
+#endif /* ifndef QDMA_CDEV_H__ */
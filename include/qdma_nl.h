@@ -41,8 +41,10 @@
 #define XNL_F_WRB_STAT_DESC_EN  0x00000400
 #define XNL_F_C2H_CMPL_INTR_EN  0x00000800
 #define XNL_F_CMPL_UDD_EN       0x00001000
+#define XNL_F_CTXT_HW		0x00002000	/* q dump: read the contexts
+						   from the hw */
 
-#define MAX_QFLAGS 13
+#define MAX_QFLAGS 14
 
 #define QDMA_MAX_INT_RING_ENTRIES 512
 
@@ -87,6 +89,15 @@ enum xnl_attr_t {
 	XNL_ATTR_INTR_VECTOR_START_IDX,
 	XNL_ATTR_INTR_VECTOR_END_IDX,
 	XNL_ATTR_RSP_BUF_LEN,
+	XNL_ATTR_MM_CHANNEL,
+	XNL_ATTR_QOS_PRIO,
+	XNL_ATTR_QOS_WEIGHT,
+	XNL_ATTR_RATE_BPS,
+	XNL_ATTR_RATE_DPS,
+	XNL_ATTR_BURST_BYTES,
+	XNL_ATTR_BURST_DESC,
+	XNL_ATTR_Q_STATUS,	/* q add/start/stop reply: s32 per queue,
+				   0 or -errno, both directions c2h first */
 #ifdef ERR_DEBUG
 	XNL_ATTR_QPARAM_ERR_SEL1,
 	XNL_ATTR_QPARAM_ERR_SEL2,
@@ -138,6 +149,14 @@ static const char *xnl_attr_str[XNL_ATTR_MAX] = {
 	"INTR_VECTOR_START_IDX", /*XNL_ATTR_INTR_VECTOR_START_IDX */
 	"INTR_VECTOR_END_IDX", /*XNL_ATTR_INTR_VECTOR_END_IDX */
 	"RSP_BUF_LEN", /* XNL_ATTR_RSP_BUF_LEN */
+	"MM_CHANNEL",	/* XNL_ATTR_MM_CHANNEL */
+	"QOS_PRIO",	/* XNL_ATTR_QOS_PRIO */
+	"QOS_WEIGHT",	/* XNL_ATTR_QOS_WEIGHT */
+	"RATE_BPS",	/* XNL_ATTR_RATE_BPS */
+	"RATE_DPS",	/* XNL_ATTR_RATE_DPS */
+	"BURST_BYTES",	/* XNL_ATTR_BURST_BYTES */
+	"BURST_DESC",	/* XNL_ATTR_BURST_DESC */
+	"Q_STATUS",	/* XNL_ATTR_Q_STATUS */
 #ifdef ERR_DEBUG
 	"QPARAM_ERR_SEL1",
 	"QPARAM_ERR_SEL2",
@@ -170,6 +189,8 @@ enum xnl_op_t {
 #endif
 
 	XNL_CMD_INTR_RING_DUMP,
+	XNL_CMD_Q_RATE,
+	XNL_CMD_Q_RESTART,
 	XNL_CMD_MAX,
 };
 
@@ -192,6 +213,8 @@ static const char *xnl_op_str[XNL_CMD_MAX] = {
 	"Q_RX_PKT",	/* XNL_CMD_Q_RX_PKT */
 
 	"INTR_RING_DUMP", /* XNL_CMD_INTR_RING_DUMP */
+	"Q_RATE",	/* XNL_CMD_Q_RATE */
+	"Q_RESTART",	/* XNL_CMD_Q_RESTART */
 #ifdef ERR_DEBUG
 	"Q_ERR_INDUCE"  /* XNL_CMD_Q_ERR_INDUCE */
 #endif
@@ -0,0 +1,317 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+#ifndef QDMA_UQ_H__
+#define QDMA_UQ_H__
+
+/*
+ * user space queues (kernel bypass), see QDMA_CDEV_IOC_BYPASS.
+ *
+ * The queue pair of a cdev is started in bypass mode, its rings and doorbell
+ * page are mapped into the process. Descriptors are posted and the doorbells
+ * rung with no system call; completions are found by polling the status
+ * writeback (mm, st h2c) or the completion ring (st c2h).
+ * The host addresses in the descriptors are bus addresses, i.e., of a buffer
+ * registered with QDMA_CDEV_IOC_BUF_REG, see QDMA_CDEV_IOC_BUF_DMA.
+ *
+ * Not thread safe: one thread per queue.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "qdma_cdev.h"
+
+/* descriptor bits, as programmed by libqdma */
+#define QDMA_UQ_MM_DESC_F_DV		(1U << 28)
+#define QDMA_UQ_MM_DESC_F_SOP		(1U << 29)
+#define QDMA_UQ_MM_DESC_F_EOP		(1U << 30)
+
+#define QDMA_UQ_H2C_DESC_F_SOP		1
+#define QDMA_UQ_H2C_DESC_F_EOP		2
+#define QDMA_UQ_H2C_DESC_CDH_FLAGS	13
+
+/* st c2h completion entry, 1st dword */
+#define QDMA_UQ_CMPL_F_COLOR		(1U << 1)
+#define QDMA_UQ_CMPL_F_ERR		(1U << 2)
+#define QDMA_UQ_CMPL_F_DESC_USED	(1U << 3)
+#define QDMA_UQ_CMPL_LEN(dw)		(((dw) >> 4) & 0xFFFFU)
+
+struct qdma_uq_mm_desc {
+	uint64_t src_addr;
+	uint32_t flag_len;
+	uint32_t rsvd0;
+	uint64_t dst_addr;
+	uint64_t rsvd1;
+};
+
+struct qdma_uq_h2c_desc {
+	uint16_t cdh_flags;
+	uint16_t pld_len;
+	uint16_t len;
+	uint16_t flags;
+	uint64_t src_addr;
+};
+
+/* status writeback, after the last descriptor of the ring */
+struct qdma_uq_desc_wb {
+	uint16_t pidx;
+	uint16_t cidx;
+	uint32_t rsvd;
+};
+
+struct qdma_uq {
+	struct qdma_cdev_bypass_q info;
+	uint8_t *ring;
+	volatile struct qdma_uq_desc_wb *wb;
+	uint8_t *cmpl;			/* st c2h */
+	uint8_t *db;			/* doorbell page */
+	unsigned int pidx;		/* next descriptor to fill */
+	unsigned int cidx;		/* st c2h: next completion entry */
+	unsigned int color;		/* st c2h: of a new completion entry */
+};
+
+struct qdma_uq_pair {
+	int fd;
+	struct qdma_uq h2c;
+	struct qdma_uq c2h;
+};
+
+static inline unsigned int qdma_uq_idx_incr(unsigned int idx, unsigned int cnt,
+					unsigned int rngsz)
+{
+	idx += cnt;
+	return idx >= rngsz ? idx - rngsz : idx;
+}
+
+static inline void qdma_uq_db_write(struct qdma_uq *q, unsigned int off,
+				uint32_t v)
+{
+	/* the descriptors are visible before the doorbell */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	*(volatile uint32_t *)(q->db + off) = v;
+}
+
+static inline void qdma_uq_unmap(struct qdma_uq *q)
+{
+	if (q->ring)
+		munmap(q->ring, q->info.ring_len);
+	if (q->cmpl)
+		munmap(q->cmpl, q->info.cmpl_len);
+	if (q->db)
+		munmap(q->db, getpagesize());
+	memset(q, 0, sizeof(*q));
+}
+
+static inline void *qdma_uq_mmap(int fd, size_t len, __u64 off)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			(off_t)off);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static inline int qdma_uq_map(int fd, struct qdma_uq *q,
+			struct qdma_cdev_bypass_q *info)
+{
+	memset(q, 0, sizeof(*q));
+	q->info = *info;
+	if (!(info->flags & QDMA_CDEV_BYPASS_F_VALID))
+		return 0;
+
+	q->ring = qdma_uq_mmap(fd, info->ring_len, info->ring_mmap_off);
+	q->db = qdma_uq_mmap(fd, getpagesize(), info->db_mmap_off);
+	if (info->cmpl_len)
+		q->cmpl = qdma_uq_mmap(fd, info->cmpl_len,
+					info->cmpl_mmap_off);
+	if (!q->ring || !q->db || (info->cmpl_len && !q->cmpl)) {
+		qdma_uq_unmap(q);
+		return -errno;
+	}
+
+	q->wb = (volatile struct qdma_uq_desc_wb *)(q->ring +
+				info->rngsz * info->desc_sz);
+	q->color = 1;
+	return 0;
+}
+
+/*
+ * open the cdev (i.e., /dev/qdma<N>-ST-<idx>) and start its queues, which
+ * have to be added but not started, in bypass mode.
+ * return 0 or -errno
+ */
+static inline int qdma_uq_open(struct qdma_uq_pair *qp, const char *path)
+{
+	struct qdma_cdev_bypass_info binfo;
+	int rv;
+
+	memset(qp, 0, sizeof(*qp));
+	qp->fd = open(path, O_RDWR);
+	if (qp->fd < 0)
+		return -errno;
+
+	if (ioctl(qp->fd, QDMA_CDEV_IOC_BYPASS, &binfo) < 0) {
+		rv = -errno;
+		goto err_out;
+	}
+
+	rv = qdma_uq_map(qp->fd, &qp->h2c, &binfo.h2c);
+	if (rv < 0)
+		goto err_out;
+	rv = qdma_uq_map(qp->fd, &qp->c2h, &binfo.c2h);
+	if (rv < 0)
+		goto err_out;
+
+	return 0;
+
+err_out:
+	qdma_uq_unmap(&qp->h2c);
+	close(qp->fd);
+	qp->fd = -1;
+	return rv;
+}
+
+/* the queues stop once closed and unmapped */
+static inline void qdma_uq_close(struct qdma_uq_pair *qp)
+{
+	qdma_uq_unmap(&qp->h2c);
+	qdma_uq_unmap(&qp->c2h);
+	if (qp->fd >= 0)
+		close(qp->fd);
+	qp->fd = -1;
+}
+
+/* the hw consumer index, from the status writeback */
+static inline unsigned int qdma_uq_hw_cidx(struct qdma_uq *q)
+{
+	unsigned int cidx = q->wb->cidx;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return cidx;
+}
+
+/* # of free descriptors, one is always left unused */
+static inline unsigned int qdma_uq_avail(struct qdma_uq *q)
+{
+	unsigned int cidx = qdma_uq_hw_cidx(q);
+	unsigned int rngsz = q->info.rngsz;
+	unsigned int used = q->pidx >= cidx ? q->pidx - cidx :
+				q->pidx + rngsz - cidx;
+
+	return rngsz - 1 - used;
+}
+
+/*
+ * mm: one descriptor, @host is a bus address, @ep the card address.
+ * A transfer of several descriptors sets sop on the 1st and eop on the last.
+ */
+static inline int qdma_uq_mm_post(struct qdma_uq *q, int c2h, uint64_t host,
+				uint64_t ep, uint32_t len, int sop, int eop)
+{
+	struct qdma_uq_mm_desc *desc;
+
+	if (!qdma_uq_avail(q))
+		return -EAGAIN;
+
+	desc = (struct qdma_uq_mm_desc *)(q->ring + q->pidx * q->info.desc_sz);
+	desc->src_addr = c2h ? ep : host;
+	desc->dst_addr = c2h ? host : ep;
+	desc->flag_len = len | QDMA_UQ_MM_DESC_F_DV |
+			(sop ? QDMA_UQ_MM_DESC_F_SOP : 0) |
+			(eop ? QDMA_UQ_MM_DESC_F_EOP : 0);
+	desc->rsvd0 = 0;
+	desc->rsvd1 = 0;
+
+	q->pidx = qdma_uq_idx_incr(q->pidx, 1, q->info.rngsz);
+	return 0;
+}
+
+/* st h2c: one descriptor of a packet, @len < 64KB */
+static inline int qdma_uq_h2c_post(struct qdma_uq *q, uint64_t host,
+				uint16_t len, int sop, int eop)
+{
+	struct qdma_uq_h2c_desc *desc;
+
+	if (!qdma_uq_avail(q))
+		return -EAGAIN;
+
+	desc = (struct qdma_uq_h2c_desc *)(q->ring +
+				q->pidx * q->info.desc_sz);
+	desc->src_addr = host;
+	desc->len = len;
+	desc->pld_len = len;
+	desc->cdh_flags = QDMA_UQ_H2C_DESC_CDH_FLAGS;
+	desc->flags = (sop ? QDMA_UQ_H2C_DESC_F_SOP : 0) |
+			(eop ? QDMA_UQ_H2C_DESC_F_EOP : 0);
+
+	q->pidx = qdma_uq_idx_incr(q->pidx, 1, q->info.rngsz);
+	return 0;
+}
+
+/* st c2h: one rx buffer of info.c2h_bufsz bytes */
+static inline int qdma_uq_c2h_post(struct qdma_uq *q, uint64_t host)
+{
+	if (!qdma_uq_avail(q))
+		return -EAGAIN;
+
+	*(uint64_t *)(q->ring + q->pidx * q->info.desc_sz) = host;
+
+	q->pidx = qdma_uq_idx_incr(q->pidx, 1, q->info.rngsz);
+	return 0;
+}
+
+/* hand the posted descriptors to the hw, no completion interrupt */
+static inline void qdma_uq_kick(struct qdma_uq *q)
+{
+	qdma_uq_db_write(q, q->info.db_off, q->pidx);
+}
+
+/*
+ * st c2h: the next received packet. @len is its length, @bufs the # of rx
+ * buffers it used, in the order they were posted (0 for udd only entries).
+ * The completion is acked right away.
+ * return 1 if a packet was received, 0 if none, -EIO on a completion error:
+ * the entry is consumed all the same, @bufs are the buffers to post again.
+ */
+static inline int qdma_uq_c2h_reap(struct qdma_uq *q, uint32_t *len,
+				unsigned int *bufs)
+{
+	volatile uint32_t *entry = (volatile uint32_t *)(q->cmpl +
+				q->cidx * q->info.cmpl_sz);
+	uint32_t dw0 = *entry;
+	unsigned int bufsz = q->info.c2h_bufsz;
+
+	if (!!(dw0 & QDMA_UQ_CMPL_F_COLOR) != q->color)
+		return 0;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	*len = QDMA_UQ_CMPL_LEN(dw0);
+	if (dw0 & QDMA_UQ_CMPL_F_DESC_USED)
+		*bufs = *len ? (*len + bufsz - 1) / bufsz : 1;
+	else
+		*bufs = 0;
+
+	if (++q->cidx == q->info.cmpl_rngsz) {
+		q->cidx = 0;
+		q->color ^= 1;
+	}
+	qdma_uq_db_write(q, q->info.cmpl_db_off,
+			q->cidx | q->info.cmpl_db_flags);
+	return (dw0 & QDMA_UQ_CMPL_F_ERR) ? -EIO : 1;
+}
+
+#endif /* ifndef QDMA_UQ_H__ */
@@ -14,6 +14,9 @@
 
 #include "libqdma_export.h"
 
+#include <linux/rculist.h>
+#include <linux/completion.h>
+#include <linux/mm.h>
 #include "qdma_descq.h"
 #include "qdma_device.h"
 #include "qdma_thread.h"
@@ -24,21 +27,37 @@
 #include "version.h"
 
 /* ********************* static function definitions ************************ */
+/* ms an interrupted request waits for its descriptors, then the queue fails */
+#define QDMA_REQ_INTR_TMO_MS	1000
+
+/* a request with a timeout is failed by the queue's timeout timer */
 static int qdma_request_wait_for_cmpl(struct xlnx_dma_dev *xdev,
 			struct qdma_descq *descq, struct qdma_request *req)
 {
 	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
 
-	if (req->timeout_ms)
-		wait_event_interruptible_timeout(cb->wq, cb->done,
-			msecs_to_jiffies(req->timeout_ms));
-	else
-		wait_event_interruptible(cb->wq, cb->done);
+	wait_event_interruptible(cb->wq, cb->done);
 
 	lock_descq(descq);
-	if (!cb->done)
-		/* timed out */
-		list_del(&cb->list);
+	/*
+	 * interrupted: the descriptors posted have to complete first. If they
+	 * don't in time, the queue is taken off the hw, which completes the
+	 * request as well.
+	 */
+	if (!cb->done && qdma_sgt_req_defer(descq, cb, -EINTR)) {
+		unlock_descq(descq);
+		if (!wait_event_timeout(cb->wq, cb->done,
+				msecs_to_jiffies(QDMA_REQ_INTR_TMO_MS))) {
+			lock_descq(descq);
+			if (!cb->done)
+				qdma_descq_set_err(descq);
+			unlock_descq(descq);
+			wait_event(cb->wq, cb->done);
+		}
+		lock_descq(descq);
+	} else if (!cb->done) {
+		qdma_sgt_req_abandon(descq, cb);
+	}
 
 	if (!cb->done || cb->status) {
 		pr_info("%s: req 0x%p, %c,%u,%u/%u,0x%llx, done %d, err %d, tm %u.\n",
@@ -85,6 +104,7 @@ static ssize_t qdma_request_submit_st_c2h(struct xlnx_dma_dev *xdev,
 	lock_descq(descq);
 	if (descq->online) {
 		list_add_tail(&cb->list, &descq->pend_list);
+		qdma_req_tmo_add(descq, cb);
 		/* trigger an interrupt in case the data already dma'ed but
 		 * have not processed yet */
 		descq_wrb_cidx_update(descq, descq->cidx_wrb_pend);
@@ -100,7 +120,7 @@ static ssize_t qdma_request_submit_st_c2h(struct xlnx_dma_dev *xdev,
 		qdma_kthread_wakeup(descq->wbthp);
 
 	if (!wait) {
-		pr_info("%s: cb 0x%p, 0x%x NO wait.\n",
+		pr_debug("%s: cb 0x%p, 0x%x NO wait.\n",
 			descq->conf.name, cb, req->count);
 		return 0;
 	}
@@ -131,24 +151,72 @@ struct qdma_queue_conf *qdma_queue_get_config(unsigned long dev_hndl,
 	return NULL;
 }
 
-int qdma_queue_dump(unsigned long dev_hndl, unsigned long id, char *buf,
-				int buflen)
+static int ctxt_sprintf(char *buf, const char *name, u32 *data, int cnt)
+{
+	int len = sprintf(buf, "\t%s", name);
+
+	if (cnt == 1)
+		return len + sprintf(buf + len, "0x%08x\n", data[0]);
+
+	while (--cnt >= 0)
+		len += sprintf(buf + len, "[%d]:0x%08x%s", cnt, data[cnt],
+				cnt ? " " : "\n");
+	return len;
+}
+
+/*
+ * the hw moves the ring indices (and the irq ack) as the queue runs, they
+ * never match what was programmed: not compared with the shadow
+ */
+static const u32 sw_ctxt_hw_mask[4] = {
+	(M_DESC_CTXT_W0_PIDX << S_DESC_CTXT_W0_PIDX) |
+		(1U << S_DESC_CTXT_W0_F_IRQ_ACK),
+};
+
+static const u32 wrb_ctxt_hw_mask[4] = {
+	[2] = M_WRB_CTXT_W2_PIDX_L << S_WRB_CTXT_W2_PIDX_L,
+	[3] = (M_WRB_CTXT_W3_PIDX_H << S_WRB_CTXT_W3_PIDX_H) |
+		(M_WRB_CTXT_W3_CIDX << S_WRB_CTXT_W3_CIDX),
+};
+
+/* st c2h: the sw credits and the prefetch state */
+static const u32 pftch_ctxt_hw_mask[2] = {
+	(1U << S_PFTCH_W0_F_Q_IN_PFTCH) |
+		(M_PFTCH_W0_SW_CRDT_L << S_PFTCH_W0_SW_CRDT_L),
+	(M_PFTCH_W1_SW_CRDT_H << S_PFTCH_W1_SW_CRDT_H) |
+		(1U << S_PFTCH_W1_F_VALID),
+};
+
+static bool ctxt_differs(const u32 *rd, const u32 *prog, const u32 *hw_mask,
+			int cnt)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		if ((rd[i] ^ prog[i]) & ~hw_mask[i])
+			return true;
+	return false;
+}
+
+/*
+ * the contexts come from the shadow kept when they were programmed, unless
+ * @hw is set: then they are read from the hw, with what was programmed next
+ * to any that differ.
+ */
+static int queue_dump(struct qdma_descq *descq, char *buf, int buflen, bool hw)
 {
-	struct qdma_descq *descq = qdma_device_get_descq_by_id(
-					(struct xlnx_dma_dev *)dev_hndl, id,
-					buf, buflen, 0);
 	struct hw_descq_context ctxt;
+	struct hw_descq_context shadow;
+	u8 shadow_valid;
 	int len = 0;
 	int rv;
 #ifndef __QDMA_VF__
+	struct intr_coal_conf *coal;
 	int ring_index = 0;
 	u32 intr_ctxt[4];
 	int i = 0;
 #endif
 
-	if (!descq)
-		return -EINVAL;
-
 	/* TODO assume buflen is sufficient */
 	if (!buf || !buflen)
 		return QDMA_ERR_INVALID_INPUT_PARAM;
@@ -156,6 +224,31 @@ int qdma_queue_dump(unsigned long dev_hndl, unsigned long id, char *buf,
 	qdma_descq_dump(descq, buf, buflen, 1);
 	len = strlen(buf);
 
+	lock_descq(descq);
+	shadow = descq->ctxt;
+	shadow_valid = descq->ctxt_valid;
+	unlock_descq(descq);
+
+	if (!hw) {
+		if (!shadow_valid) {
+			len += sprintf(buf + len, "\tCTXT: not programmed\n");
+			goto intr_ctxt;
+		}
+
+		len += ctxt_sprintf(buf + len, "SW CTXT:    ", shadow.sw, 4);
+		len += sprintf(buf + len,
+			"\tHW/CR CTXT: hw only, dump with ctxt_hw\n");
+		len += ctxt_sprintf(buf + len, "QID2VEC CTXT:    ",
+				shadow.qid2vec, 1);
+		if (descq->conf.c2h && descq->conf.st) {
+			len += ctxt_sprintf(buf + len, "WRB CTXT:   ",
+					shadow.wrb, 4);
+			len += ctxt_sprintf(buf + len, "PFTCH CTXT: ",
+					shadow.prefetch, 2);
+		}
+		goto intr_ctxt;
+	}
+
 	rv = qdma_descq_context_read(descq->xdev, descq->qidx_hw,
 				descq->conf.st, descq->conf.c2h, &ctxt);
 	if (rv < 0) {
@@ -164,34 +257,54 @@ int qdma_queue_dump(unsigned long dev_hndl, unsigned long id, char *buf,
 		return rv;
 	}
 
-	len += sprintf(buf + len,
-			"\tSW CTXT:    [3]:0x%08x [2]:0x%08x [1]:0x%08x [0]:0x%08x\n",
-			ctxt.sw[3], ctxt.sw[2], ctxt.sw[1], ctxt.sw[0]);
-
-	len += sprintf(buf + len,
-			"\tHW CTXT:    [1]:0x%08x [0]:0x%08x\n",
-			ctxt.hw[1], ctxt.hw[0]);
+	len += ctxt_sprintf(buf + len, "SW CTXT:    ", ctxt.sw, 4);
+	if (shadow_valid &&
+	    ctxt_differs(ctxt.sw, shadow.sw, sw_ctxt_hw_mask, 4))
+		len += ctxt_sprintf(buf + len, "  programmed: ", shadow.sw, 4);
 
-	len += sprintf(buf + len,
-			"\tCR CTXT:    0x%08x\n", ctxt.cr[0]);
+	len += ctxt_sprintf(buf + len, "HW CTXT:    ", ctxt.hw, 2);
+	len += ctxt_sprintf(buf + len, "CR CTXT:    ", ctxt.cr, 1);
 
-	len += sprintf(buf + len,
-			"\tQID2VEC CTXT:    0x%08x\n", ctxt.qid2vec[0]);
+	len += ctxt_sprintf(buf + len, "QID2VEC CTXT:    ", ctxt.qid2vec, 1);
+	if (shadow_valid &&
+	    memcmp(ctxt.qid2vec, shadow.qid2vec, sizeof(ctxt.qid2vec)))
+		len += ctxt_sprintf(buf + len, "  programmed: ",
+				shadow.qid2vec, 1);
 
 	if (descq->conf.c2h && descq->conf.st) {
-		len += sprintf(buf + len,
-			"\tWRB CTXT:   [3]:0x%08x [2]:0x%08x [1]:0x%08x [0]:0x%08x\n",
-			ctxt.wrb[3], ctxt.wrb[2], ctxt.wrb[1], ctxt.wrb[0]);
-
-		len += sprintf(buf + len,
-			"\tPFTCH CTXT: [1]:0x%08x [0]:0x%08x\n",
-			ctxt.prefetch[1], ctxt.prefetch[0]);
+		len += ctxt_sprintf(buf + len, "WRB CTXT:   ", ctxt.wrb, 4);
+		if (shadow_valid &&
+		    ctxt_differs(ctxt.wrb, shadow.wrb, wrb_ctxt_hw_mask, 4))
+			len += ctxt_sprintf(buf + len, "  programmed: ",
+					shadow.wrb, 4);
+
+		len += ctxt_sprintf(buf + len, "PFTCH CTXT: ",
+				ctxt.prefetch, 2);
+		if (shadow_valid &&
+		    ctxt_differs(ctxt.prefetch, shadow.prefetch,
+				 pftch_ctxt_hw_mask, 2))
+			len += ctxt_sprintf(buf + len, "  programmed: ",
+					shadow.prefetch, 2);
 	}
 
+intr_ctxt:
 #ifndef __QDMA_VF__
 	for(i = 0; i < QDMA_DATA_VEC_PER_PF_MAX; i++) {
+		if (!descq->xdev->intr_coal_list)
+			break;
 
+		coal = descq->xdev->intr_coal_list + i;
 		ring_index = get_intr_ring_index(descq->xdev, (i + descq->xdev->dvec_start_idx));
+
+		if (!hw) {
+			if (!coal->ctxt_valid)
+				continue;
+			len += sprintf(buf + len,
+				"\tRING_INDEX[%d] INTR AGGR CTXT:    [1]:0x%08x [0]:0x%08x\n",
+				ring_index, coal->ctxt[1], coal->ctxt[0]);
+			continue;
+		}
+
 		rv = qdma_intr_context_read(descq->xdev, ring_index, intr_ctxt);
 		if (rv < 0) {
 			len += sprintf(buf + len, "%s read intr context failed %d.\n",
@@ -210,6 +323,32 @@ int qdma_queue_dump(unsigned long dev_hndl, unsigned long id, char *buf,
 	return len;
 }
 
+int qdma_queue_dump(unsigned long dev_hndl, unsigned long id, char *buf,
+				int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl, id,
+					buf, buflen, 0);
+
+	if (!descq)
+		return -EINVAL;
+
+	return queue_dump(descq, buf, buflen, 0);
+}
+
+int qdma_queue_dump_hw(unsigned long dev_hndl, unsigned long id, char *buf,
+				int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl, id,
+					buf, buflen, 0);
+
+	if (!descq)
+		return -EINVAL;
+
+	return queue_dump(descq, buf, buflen, 1);
+}
+
 int qdma_queue_dump_desc(unsigned long dev_hndl, unsigned long id,
 			unsigned int start, unsigned int end, char *buf,
 			int buflen)
@@ -269,6 +408,14 @@ int qdma_queue_remove(unsigned long dev_hndl, unsigned long id, char *buf,
 	if (!descq)
 		return QDMA_ERR_INVALID_QIDX;
 
+	if (descq->user_owned) {
+		pr_info("%s in use by user space.\n", descq->conf.name);
+		if (buf && buflen)
+			snprintf(buf, buflen, "queue %s in use by user space.\n",
+				descq->conf.name);
+		return -EBUSY;
+	}
+
 	lock_descq(descq);
 	descq->inited = 0;
 	descq->online = 0;
@@ -337,6 +484,48 @@ int qdma_queue_config(unsigned long dev_hndl, unsigned long qid,
 	return QDMA_OPERATION_SUCCESSFUL;
 }
 
+/* request latency per qos class, of the MM and ST H2C queues */
+static int qdma_queue_qos_dump(struct qdma_dev *qdev, char *buf, int buflen)
+{
+	struct qdma_descq *descq = qdev->h2c_descq;
+	unsigned int qcnt[QDMA_QOS_PRIO_MAX] = {0};
+	unsigned long cnt[QDMA_QOS_PRIO_MAX] = {0};
+	u64 sum[QDMA_QOS_PRIO_MAX] = {0};
+	u32 max[QDMA_QOS_PRIO_MAX] = {0};
+	int len = 0;
+	int i;
+
+	/* c2h_descq follows h2c_descq */
+	for (i = 0; i < qdev->qmax * 2; i++, descq++) {
+		unsigned int prio;
+
+		lock_descq(descq);
+		if (!descq->enabled || (descq->conf.st && descq->conf.c2h)) {
+			unlock_descq(descq);
+			continue;
+		}
+		prio = descq->conf.qos_prio;
+		qcnt[prio]++;
+		cnt[prio] += descq->lat_cnt;
+		sum[prio] += descq->lat_sum;
+		if (descq->lat_max > max[prio])
+			max[prio] = descq->lat_max;
+		unlock_descq(descq);
+	}
+
+	for (i = 0; i < QDMA_QOS_PRIO_MAX && len < buflen; i++) {
+		if (!qcnt[i])
+			continue;
+		len += snprintf(buf + len, buflen - len,
+			"QoS prio %d: %u Q, req %lu, lat avg %llu, max %llu us.\n",
+			i, qcnt[i], cnt[i],
+			cnt[i] ? div64_u64(sum[i] << 10, cnt[i] * 1000ULL) : 0ULL,
+			div_u64((u64)max[i] << 10, 1000));
+	}
+
+	return len;
+}
+
 int qdma_queue_list(unsigned long dev_hndl, char *buf, int buflen)
 {
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
@@ -361,6 +550,26 @@ int qdma_queue_list(unsigned long dev_hndl, char *buf, int buflen)
 	if (cur >= end)
 		goto handle_truncation;
 
+	for (i = 0; i < xdev->mm_channel_max && i < QDMA_MM_CHANNEL_MAX; i++) {
+		struct qdma_mm_chnl_stat *h2c = &xdev->mm_chnl[0][i];
+		struct qdma_mm_chnl_stat *c2h = &xdev->mm_chnl[1][i];
+
+		cur += snprintf(cur, end - cur,
+			"MM channel %d: H2C Q %u, %llu bytes, C2H Q %u, %llu bytes.\n",
+			i, h2c->qcnt, (u64)atomic64_read(&h2c->bytes),
+			c2h->qcnt, (u64)atomic64_read(&c2h->bytes));
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
+	cur += qdma_queue_qos_dump(qdev, cur, end - cur);
+	if (cur >= end)
+		goto handle_truncation;
+
+	cur += qdma_ring_pool_dump(xdev, cur, end - cur);
+	if (cur >= end)
+		goto handle_truncation;
+
 	if (qdev->h2c_qcnt) {
 		descq = qdev->h2c_descq;
 		for (i = 0; i < qdev->qmax; i++, descq++) {
@@ -640,17 +849,16 @@ handle_truncation:
 	return rv;
 }
 
-int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
-		     char *buf, int buflen)
+/*
+ * a queue is started in three steps: descq_start_prep() claims it,
+ * qdma_descq_alloc_resource() sets up its rings and descq_start_hw()
+ * programs the contexts and puts it online. The rings of several queues can
+ * be allocated in parallel, see qdma_queue_start_bulk().
+ */
+static int descq_start_prep(struct qdma_descq *descq, char *buf, int buflen)
 {
-	struct qdma_descq *descq = qdma_device_get_descq_by_id(
-					(struct xlnx_dma_dev *)dev_hndl,
-					 id, buf, buflen, 1);
 	int rv;
 
-	if (!descq)
-		return QDMA_ERR_INVALID_QIDX;
-
 	rv = qdma_descq_config_complete(descq);
 	if (rv < 0) {
 		pr_err("%s 0x%x setup failed.\n",
@@ -662,7 +870,7 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 				"%s config failed.\n", descq->conf.name);
 			buf[l] = '\0';
 		}
-		goto free_resource;
+		return rv;
 	}
 
 	lock_descq(descq);
@@ -681,26 +889,27 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 		unlock_descq(descq);
 		return QDMA_ERR_INVALID_DESCQ_STATE;
 	}
+	descq->inited = 1;
+	unlock_descq(descq);
 
-	if (!descq->inited) {
-		descq->inited = 1;
-		unlock_descq(descq);
+	return 0;
+}
 
-		rv = qdma_descq_alloc_resource(descq);
+/* undo descq_start_prep() and the ring allocation */
+static void descq_start_abort(struct qdma_descq *descq)
+{
+	lock_descq(descq);
+	qdma_descq_free_resource(descq);
+	descq->inited = 0;
+	unlock_descq(descq);
+}
 
-		lock_descq(descq);
-		if (rv < 0) {
-			if (buf && buflen) {
-				int l = strlen(buf);
+static int descq_start_hw(struct qdma_descq *descq, char *buf, int buflen)
+{
+	int rv;
 
-				l += sprintf(buf + l,
-					"%s alloc resource failed.\n",
-					descq->conf.name);
-				buf[l] = '\0';
-			}
-			goto free_resource;
-		}
-	}
+	lock_descq(descq);
+	qdma_descq_mm_channel_get(descq);
 
 	rv = qdma_descq_prog_hw(descq);
 	if (rv < 0) {
@@ -714,23 +923,68 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 				descq->conf.name);
 			buf[l] = '\0';
 		}
-		goto clear_context;
+		qdma_descq_context_clear(descq->xdev, descq->qidx_hw,
+					descq->conf.st, descq->conf.c2h, 1);
+		qdma_descq_mm_channel_put(descq);
+		qdma_descq_free_resource(descq);
+		descq->inited = 0;
+		unlock_descq(descq);
+		return rv;
 	}
 
 	descq->online = 1;
 	unlock_descq(descq);
 
+	/* kernel bypass: no completion processing in the kernel */
+	if (descq->user_owned)
+		return 0;
+
 	qdma_thread_add_work(descq);
 
 	if (descq->xdev->num_vecs) {	/* Interrupt mode */
 		unsigned long flags;
 
 		spin_lock_irqsave(&descq->xdev->lock, flags);
-		list_add_tail(&descq->intr_list,
+		list_add_tail_rcu(&descq->intr_list,
 				&descq->xdev->intr_list[descq->intr_id]);
 		spin_unlock_irqrestore(&descq->xdev->lock, flags);
 	}
 
+	return 0;
+}
+
+int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
+		     char *buf, int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					 id, buf, buflen, 1);
+	int rv;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	rv = descq_start_prep(descq, buf, buflen);
+	if (rv < 0)
+		return rv;
+
+	rv = qdma_descq_alloc_resource(descq);
+	if (rv < 0) {
+		if (buf && buflen) {
+			int l = strlen(buf);
+
+			l += sprintf(buf + l, "%s alloc resource failed.\n",
+				descq->conf.name);
+			buf[l] = '\0';
+		}
+		descq_start_abort(descq);
+		return rv;
+	}
+
+	rv = descq_start_hw(descq, buf, buflen);
+	if (rv < 0)
+		return rv;
+
 	if (buf && buflen) {
 		rv = snprintf(buf, buflen, "%s started\n", descq->conf.name);
 		if (rv <= 0 || rv >= buflen) {
@@ -739,47 +993,196 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 	}
 
 	return QDMA_OPERATION_SUCCESSFUL;
+}
 
-clear_context:
-	qdma_descq_context_clear(descq->xdev, descq->qidx_hw, descq->conf.st,
-				descq->conf.c2h, 1);
-free_resource:
-	qdma_descq_free_resource(descq);
+/* below this many queues a bulk start allocates the rings inline */
+#define QDMA_BULK_ALLOC_MIN	32
 
-	descq->inited = 0;
-	unlock_descq(descq);
+struct descq_alloc_work {
+	struct work_struct work;
+	struct qdma_descq **descqs;
+	int *status;
+	unsigned int start;
+	unsigned int cnt;
+	unsigned int step;
+};
 
-	return rv;
+static void descq_alloc_work_fn(struct work_struct *work)
+{
+	struct descq_alloc_work *aw = container_of(work,
+					struct descq_alloc_work, work);
+	unsigned int i;
+
+	for (i = aw->start; i < aw->cnt; i += aw->step) {
+		if (aw->descqs[i] && !aw->status[i])
+			aw->status[i] = qdma_descq_alloc_resource(
+						aw->descqs[i]);
+	}
 }
 
-int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
-			int buflen)
+/* allocate the rings of the queues in @descqs, one worker per online cpu */
+static void descq_alloc_bulk(struct qdma_descq **descqs, int *status,
+			unsigned int cnt)
 {
-	struct qdma_descq *descq = qdma_device_get_descq_by_id(
-					(struct xlnx_dma_dev *)dev_hndl,
-					id, buf, buflen, 1);
+	struct descq_alloc_work *aw = NULL;
+	struct descq_alloc_work inl;
+	unsigned int nwork = min(num_online_cpus(), cnt / QDMA_BULK_ALLOC_MIN);
+	unsigned int i;
+
+	if (nwork > 1)
+		aw = kcalloc(nwork, sizeof(*aw), GFP_KERNEL);
+	if (!aw) {
+		inl.descqs = descqs;
+		inl.status = status;
+		inl.start = 0;
+		inl.cnt = cnt;
+		inl.step = 1;
+		descq_alloc_work_fn(&inl.work);
+		return;
+	}
 
-	if (!descq)
-		return QDMA_ERR_INVALID_QIDX;
+	for (i = 0; i < nwork; i++) {
+		INIT_WORK(&aw[i].work, descq_alloc_work_fn);
+		aw[i].descqs = descqs;
+		aw[i].status = status;
+		aw[i].start = i;
+		aw[i].cnt = cnt;
+		aw[i].step = nwork;
+		queue_work(system_unbound_wq, &aw[i].work);
+	}
+	for (i = 0; i < nwork; i++)
+		flush_work(&aw[i].work);
 
+	kfree(aw);
+}
+
+int qdma_queue_start_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq **descqs;
+	unsigned int started = 0;
+	unsigned int i;
+
+	if (!xdev || !qhndls || !status || !cnt)
+		return -EINVAL;
+
+	descqs = kcalloc(cnt, sizeof(*descqs), GFP_KERNEL);
+	if (!descqs)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		descqs[i] = qdma_device_get_descq_by_id(xdev, qhndls[i],
+							NULL, 0, 1);
+		if (!descqs[i]) {
+			status[i] = QDMA_ERR_INVALID_QIDX;
+			continue;
+		}
+		status[i] = descq_start_prep(descqs[i], NULL, 0);
+		if (status[i] < 0)
+			descqs[i] = NULL;
+	}
+
+	descq_alloc_bulk(descqs, status, cnt);
+
+	/* the contexts are programmed one after the other anyway */
+	for (i = 0; i < cnt; i++) {
+		if (!descqs[i])
+			continue;
+		if (status[i] < 0) {
+			pr_info("%s alloc resource failed %d.\n",
+				descqs[i]->conf.name, status[i]);
+			descq_start_abort(descqs[i]);
+			continue;
+		}
+		status[i] = descq_start_hw(descqs[i], NULL, 0);
+		if (!status[i])
+			started++;
+	}
+
+	kfree(descqs);
+	return started;
+}
+
+/*
+ * queue stop, in two steps: descq_stop_detach() and descq_stop_release().
+ * In between, the completion processing of the queue is flushed and its
+ * contexts cleared, for a set of queues at once by qdma_queue_stop_bulk().
+ */
+static void descq_stop_detach(struct qdma_descq *descq)
+{
 	qdma_thread_remove_work(descq);
-	if (descq->xdev->num_vecs) {	/* Interrupt mode */
+	hrtimer_cancel(&descq->rl_timer);
+	/* a user owned queue was never put on the interrupt list */
+	if (descq->xdev->num_vecs && !descq->user_owned) {
 		unsigned long flags;
 		spin_lock_irqsave(&descq->xdev->lock, flags);
-		list_del(&descq->intr_list);
+		list_del_rcu(&descq->intr_list);
 		spin_unlock_irqrestore(&descq->xdev->lock, flags);
 	}
+}
 
-	qdma_descq_context_clear(descq->xdev, descq->qidx_hw, descq->conf.st,
-				descq->conf.c2h, 0);
-
-	qdma_descq_free_resource(descq);
+/*
+ * with the contexts of the queue cleared. @keep_rings: the rings and rx
+ * buffers stay for the restart to follow, see qdma_queue_restart_bulk().
+ */
+static void descq_stop_release(struct qdma_descq *descq, bool keep_rings)
+{
+	if (!keep_rings)
+		qdma_descq_free_resource(descq);
 
 	lock_descq(descq);
+	/* the hw is done with the descriptors posted */
+	qdma_descq_flush_reqs(descq, -ECANCELED);
+	qdma_descq_mm_channel_put(descq);
 	descq->online = 0;
 	descq->inited = 0;
+	descq->ctxt_valid = 0;
+	descq->err = 0;
 	unlock_descq(descq);
 
+	/* with no requests left, nothing arms these again */
+	qdma_req_tmo_clear(descq);
+	cancel_work_sync(&descq->err_work);
+
+	/* poll()/epoll waiters get POLLERR */
+	wake_up_interruptible(&descq->poll_wq);
+}
+
+static void descq_stop(struct qdma_descq *descq)
+{
+	descq_stop_detach(descq);
+	if (descq->xdev->num_vecs && !descq->user_owned) {
+		/* no more irq thread or intr_work() touching the queue */
+		synchronize_irq(descq->xdev->msix[descq->intr_id].vector);
+		cancel_work_sync(&descq->work);
+	}
+	qdma_descq_context_clear(descq->xdev, descq->qidx_hw, descq->conf.st,
+				descq->conf.c2h, 0);
+	descq_stop_release(descq, false);
+}
+
+int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
+			int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, buf, buflen, 1);
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	/* stopped by its owner via qdma_queue_user_stop() */
+	if (descq->user_owned) {
+		pr_info("%s in use by user space.\n", descq->conf.name);
+		if (buf && buflen)
+			snprintf(buf, buflen, "queue %s in use by user space.\n",
+				descq->conf.name);
+		return -EBUSY;
+	}
+
+	descq_stop(descq);
+
 	if (buf && buflen) {
 		int len = snprintf(buf, buflen, "queue %s, idx %u stopped.\n",
 				descq->conf.name, descq->conf.qidx);
@@ -791,6 +1194,244 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 	return QDMA_OPERATION_SUCCESSFUL;
 }
 
+static int descq_stop_bulk(struct xlnx_dma_dev *xdev, unsigned long *qhndls,
+			unsigned int cnt, int *status, bool keep_rings)
+{
+	struct qdma_descq **descqs;
+	unsigned long *vecs = NULL;
+	unsigned int stopped = 0;
+	unsigned int i;
+
+	descqs = kcalloc(cnt, sizeof(*descqs), GFP_KERNEL);
+	if (!descqs)
+		return -ENOMEM;
+	if (xdev->num_vecs) {
+		vecs = kcalloc(BITS_TO_LONGS(xdev->num_vecs), sizeof(long),
+				GFP_KERNEL);
+		if (!vecs) {
+			kfree(descqs);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < cnt; i++) {
+		struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev,
+						qhndls[i], NULL, 0, 1);
+
+		if (!descq) {
+			status[i] = QDMA_ERR_INVALID_QIDX;
+			continue;
+		}
+		if (descq->user_owned) {
+			pr_info("%s in use by user space.\n", descq->conf.name);
+			status[i] = -EBUSY;
+			continue;
+		}
+		if (!descq->online) {
+			status[i] = QDMA_ERR_INVALID_DESCQ_STATE;
+			continue;
+		}
+
+		descq_stop_detach(descq);
+		if (vecs)
+			set_bit(descq->intr_id, vecs);
+		descqs[i] = descq;
+		status[i] = 0;
+	}
+
+	/* one irq synchronization per vector instead of one per queue */
+	if (vecs) {
+		for_each_set_bit(i, vecs, xdev->num_vecs)
+			synchronize_irq(xdev->msix[i].vector);
+		for (i = 0; i < cnt; i++)
+			if (descqs[i])
+				cancel_work_sync(&descqs[i]->work);
+	}
+
+	qdma_descq_context_clear_bulk(xdev, descqs, cnt);
+
+	for (i = 0; i < cnt; i++) {
+		if (!descqs[i])
+			continue;
+		descq_stop_release(descqs[i], keep_rings);
+		stopped++;
+	}
+
+	kfree(vecs);
+	kfree(descqs);
+	return stopped;
+}
+
+int qdma_queue_stop_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+
+	if (!xdev || !qhndls || !status || !cnt)
+		return -EINVAL;
+
+	return descq_stop_bulk(xdev, qhndls, cnt, status, false);
+}
+
+/*
+ * queue restart: the queues are stopped with their rings and rx buffers
+ * kept and started again. Unless the ring sizes changed meanwhile, the start
+ * only resets the rings and programs the contexts, nothing is allocated.
+ */
+int qdma_queue_restart_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	unsigned long *restart;
+	int *rstatus;
+	unsigned int started = 0;
+	unsigned int n = 0;
+	unsigned int i, j;
+	int rv;
+
+	if (!xdev || !qhndls || !status || !cnt)
+		return -EINVAL;
+
+	/* no failing half way, with the queues stopped */
+	restart = kcalloc(cnt, sizeof(*restart), GFP_KERNEL);
+	rstatus = kcalloc(cnt, sizeof(*rstatus), GFP_KERNEL);
+	if (!restart || !rstatus) {
+		rv = -ENOMEM;
+		goto free_buf;
+	}
+
+	rv = descq_stop_bulk(xdev, qhndls, cnt, status, true);
+	if (rv <= 0)
+		goto free_buf;
+
+	for (i = 0; i < cnt; i++)
+		if (!status[i])
+			restart[n++] = qhndls[i];
+
+	rv = qdma_queue_start_bulk(dev_hndl, restart, n, rstatus);
+
+	for (i = 0, j = 0; i < cnt; i++) {
+		struct qdma_descq *descq;
+
+		if (status[i])
+			continue;
+		status[i] = rv < 0 ? rv : rstatus[j];
+		j++;
+		if (!status[i]) {
+			started++;
+			continue;
+		}
+
+		/* a start failing early leaves the kept rings behind */
+		descq = qdma_device_get_descq_by_id(xdev, qhndls[i], NULL, 0,
+						1);
+		lock_descq(descq);
+		if (!descq->inited)
+			qdma_descq_free_resource(descq);
+		unlock_descq(descq);
+	}
+	rv = started;
+
+free_buf:
+	kfree(rstatus);
+	kfree(restart);
+	return rv;
+}
+
+int qdma_queue_restart(unsigned long dev_hndl, unsigned long id, char *buf,
+			int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, buf, buflen, 1);
+	int status;
+	int rv;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	rv = qdma_queue_restart_bulk(dev_hndl, &id, 1, &status);
+	if (rv >= 0)
+		rv = status;
+
+	if (buf && buflen) {
+		if (rv < 0)
+			snprintf(buf, buflen, "queue %s restart failed %d.\n",
+				descq->conf.name, rv);
+		else
+			snprintf(buf, buflen, "queue %s restarted.\n",
+				descq->conf.name);
+	}
+
+	return rv < 0 ? rv : QDMA_OPERATION_SUCCESSFUL;
+}
+
+int qdma_queue_user_start(unsigned long dev_hndl, unsigned long id,
+			struct qdma_queue_user_info *info)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, NULL, 0, 1);
+	int rv;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	lock_descq(descq);
+	if (!descq->enabled || descq->inited || descq->user_owned) {
+		unlock_descq(descq);
+		return QDMA_ERR_INVALID_DESCQ_STATE;
+	}
+	descq->user_owned = 1;
+	unlock_descq(descq);
+
+	rv = qdma_queue_start(dev_hndl, id, NULL, 0);
+	if (rv < 0) {
+		lock_descq(descq);
+		descq->user_owned = 0;
+		unlock_descq(descq);
+		return rv;
+	}
+
+	qdma_descq_user_info(descq, info);
+
+	pr_info("%s started, data path in user space.\n", descq->conf.name);
+	return 0;
+}
+
+int qdma_queue_user_stop(unsigned long dev_hndl, unsigned long id)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, NULL, 0, 1);
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	if (!descq->user_owned)
+		return QDMA_ERR_INVALID_DESCQ_STATE;
+
+	/*
+	 * the owner may still have the rings and the doorbells mapped, i.e.,
+	 * the queue is taken away on device removal: no user access to them
+	 * from here on (SIGBUS), before the rings are freed.
+	 */
+	if (descq->user_mapping) {
+		unmap_mapping_range(descq->user_mapping, 0, 0, 1);
+		descq->user_mapping = NULL;
+	}
+
+	descq_stop(descq);
+
+	lock_descq(descq);
+	descq->user_owned = 0;
+	unlock_descq(descq);
+
+	pr_info("%s stopped, data path back in the kernel.\n",
+		descq->conf.name);
+	return 0;
+}
+
 int qdma_intr_ring_dump(unsigned long dev_hndl, unsigned int vector_idx, int start_idx, int end_idx, char *buf, int buflen)
 {
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
@@ -861,6 +1502,16 @@ int qdma_intr_ring_dump(unsigned long dev_hndl, unsigned int vector_idx, int sta
 	return 0;
 }
 
+/*
+ * a sg entry is physically contiguous and may span multiple pages
+ * (i.e., hugepages), it is mapped from the start of its first page.
+ */
+static inline size_t sgl_map_len(struct qdma_sw_sg *sg)
+{
+	return max_t(size_t, PAGE_ALIGN((size_t)sg->offset + sg->len),
+			PAGE_SIZE);
+}
+
 void sgl_unmap(struct pci_dev *pdev, struct qdma_sw_sg *sg, unsigned int sgcnt,
 		 enum dma_data_direction dir)
 {
@@ -871,7 +1522,7 @@ void sgl_unmap(struct pci_dev *pdev, struct qdma_sw_sg *sg, unsigned int sgcnt,
                         break;
 		if (sg->dma_addr) {
 			pci_unmap_page(pdev, sg->dma_addr - sg->offset,
-                                PAGE_SIZE, dir);
+				sgl_map_len(sg), dir);
 			sg->dma_addr = 0UL;
 		}
 	}
@@ -883,8 +1534,8 @@ int sgl_map(struct pci_dev *pdev, struct qdma_sw_sg *sg, unsigned int sgcnt,
 	int i;
 
 	for (i = 0; i < sgcnt; i++, sg++) {
-		/* !! TODO  page size !! */
-		sg->dma_addr = pci_map_page(pdev, sg->pg, 0, PAGE_SIZE, dir);
+		sg->dma_addr = pci_map_page(pdev, sg->pg, 0, sgl_map_len(sg),
+					dir);
 		if (unlikely(pci_dma_mapping_error(pdev, sg->dma_addr))) {
 			pr_info("map sgl failed, sg %d, %u.\n", i, sg->len);
 			return -EIO;
@@ -916,6 +1567,10 @@ ssize_t qdma_request_submit(unsigned long dev_hndl, unsigned long id,
 		return -EINVAL;
 	}
 
+	/* the data path is in user space */
+	if (descq->user_owned)
+		return -EBUSY;
+
 	memset(cb, 0, QDMA_REQ_OPAQUE_SIZE);
 	init_waitqueue_head(&cb->wq);
 
@@ -937,14 +1592,16 @@ ssize_t qdma_request_submit(unsigned long dev_hndl, unsigned long id,
 	}
 
 	lock_descq(descq);
-	if (!descq->online) {
+	if (!descq->online || descq->err) {
 		unlock_descq(descq);
 		pr_info("%s descq %s NOT online.\n",
 			xdev->conf.name, descq->conf.name);
 		rv = -EINVAL;
 		goto unmap_sgl;
 	}
+	cb->t_submit = qdma_req_tstamp();
 	list_add_tail(&cb->list, &descq->work_list);
+	qdma_req_tmo_add(descq, cb);
 	unlock_descq(descq);
 
 	pr_debug("%s: cb 0x%p submitted.\n", descq->conf.name, cb);
@@ -967,6 +1624,427 @@ unmap_sgl:
 	return rv;
 }
 
+int qdma_batch_request_submit(unsigned long dev_hndl, unsigned long id,
+			struct qdma_request **reqs, unsigned int cnt)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	struct qdma_sgt_req_cb *cb;
+	enum dma_data_direction dir;
+	unsigned int i;
+	u32 ts;
+	int rv = 0;
+
+	if (!descq)
+		return -EINVAL;
+
+	if (descq->conf.st)
+		return -EOPNOTSUPP;
+
+	if (descq->user_owned)
+		return -EBUSY;
+
+	dir = descq->conf.c2h ?  DMA_FROM_DEVICE : DMA_TO_DEVICE;
+
+	for (i = 0; i < cnt; i++) {
+		struct qdma_request *req = reqs[i];
+
+		cb = qdma_req_cb_get(req);
+		if (!req->fp_done || req->write == descq->conf.c2h) {
+			pr_info("%s: req %u, %c, fp_done 0x%p.\n",
+				descq->conf.name, i, req->write ? 'W' : 'R',
+				req->fp_done);
+			rv = -EINVAL;
+			goto unmap_sgl;
+		}
+
+		memset(cb, 0, QDMA_REQ_OPAQUE_SIZE);
+		init_waitqueue_head(&cb->wq);
+
+		if (!req->dma_mapped) {
+			rv = sgl_map(xdev->conf.pdev, req->sgl, req->sgcnt,
+					dir);
+			if (rv < 0) {
+				pr_info("%s map sgl %u failed, %u.\n",
+					descq->conf.name, req->sgcnt,
+					req->count);
+				sgl_unmap(xdev->conf.pdev, req->sgl,
+					req->sgcnt, dir);
+				goto unmap_sgl;
+			}
+			cb->unmap_needed = 1;
+		}
+	}
+
+	/* all queued at once: posted back to back by the request thread */
+	lock_descq(descq);
+	if (!descq->online) {
+		unlock_descq(descq);
+		pr_info("%s descq %s NOT online.\n",
+			xdev->conf.name, descq->conf.name);
+		rv = -EINVAL;
+		goto unmap_sgl;
+	}
+	ts = qdma_req_tstamp();
+	for (i = 0; i < cnt; i++) {
+		cb = qdma_req_cb_get(reqs[i]);
+		cb->t_submit = ts;
+		list_add_tail(&cb->list, &descq->work_list);
+		qdma_req_tmo_add(descq, cb);
+	}
+	unlock_descq(descq);
+
+	pr_debug("%s: %u reqs submitted.\n", descq->conf.name, cnt);
+
+	qdma_kthread_wakeup(descq->wrkthp);
+
+	return 0;
+
+unmap_sgl:
+	while (i--) {
+		cb = qdma_req_cb_get(reqs[i]);
+		if (cb->unmap_needed)
+			sgl_unmap(xdev->conf.pdev, reqs[i]->sgl,
+				reqs[i]->sgcnt, dir);
+		cb->unmap_needed = 0;
+	}
+
+	return rv;
+}
+
+int qdma_request_cancel(unsigned long dev_hndl, unsigned long id,
+			struct qdma_request *req)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
+
+	if (!descq)
+		return -EINVAL;
+
+	lock_descq(descq);
+	/* fp_done is called with the lock held, it has returned already */
+	if (cb->done) {
+		unlock_descq(descq);
+		return -EALREADY;
+	}
+	/* the descriptors posted are owned by the hw until they complete */
+	if (cb->desc_nr && !(descq->conf.st && descq->conf.c2h)) {
+		unlock_descq(descq);
+		return -EBUSY;
+	}
+
+	qdma_sgt_req_abandon(descq, cb);
+	cb->done = 1;
+	cb->status = -ECANCELED;
+	unlock_descq(descq);
+
+	pr_info("%s: req 0x%p, %c,%u/%u,0x%llx cancelled.\n",
+		descq->conf.name, req, req->write ? 'W' : 'R', cb->offset,
+		req->count, req->ep_addr);
+	return 0;
+}
+
+/*
+ * striped mm request: split into chunks spread over a set of mm queues,
+ * each chunk is a non-blocking request of its own on one of the queues.
+ */
+#define STRIPE_CHUNK_DFLT	(256 * 1024)
+#define STRIPE_CHUNK_NR_MAX	64
+
+struct qdma_stripe_req;
+
+struct qdma_stripe_sub {
+	struct qdma_request req;
+	struct qdma_stripe_req *sreq;
+	unsigned long qhndl;
+	bool queued;
+};
+
+struct qdma_stripe_req {
+	struct qdma_request *req;
+	struct xlnx_dma_dev *xdev;
+	spinlock_t lock;
+	unsigned int pending;		/* + 1 until all are submitted */
+	unsigned int done;		/* bytes */
+	int err;
+	bool unmap_needed;
+	struct completion cmpl;
+	unsigned int sub_nr;
+	struct qdma_stripe_sub *subs;
+	struct qdma_sw_sg *sgl;
+};
+
+static void stripe_req_free(struct qdma_stripe_req *sreq)
+{
+	struct qdma_request *req = sreq->req;
+
+	if (sreq->unmap_needed)
+		sgl_unmap(sreq->xdev->conf.pdev, req->sgl, req->sgcnt,
+			req->write ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	kfree(sreq->sgl);
+	kfree(sreq->subs);
+	kfree(sreq);
+}
+
+/* the last chunk is done: blocking waiter or fp_done of the request */
+static void stripe_req_complete(struct qdma_stripe_req *sreq)
+{
+	struct qdma_request *req = sreq->req;
+	unsigned int done = sreq->done;
+	int err = sreq->err;
+
+	if (!req->fp_done) {
+		complete(&sreq->cmpl);
+		return;
+	}
+
+	stripe_req_free(sreq);
+	req->fp_done(req, done, err);
+}
+
+static bool stripe_req_put(struct qdma_stripe_req *sreq, unsigned int bytes,
+			int err)
+{
+	bool last;
+
+	spin_lock_bh(&sreq->lock);
+	sreq->done += bytes;
+	if (err < 0 && !sreq->err)
+		sreq->err = err;
+	last = !--sreq->pending;
+	spin_unlock_bh(&sreq->lock);
+
+	return last;
+}
+
+/* libqdma completion context, the chunk's queue lock held */
+static int stripe_sub_done(struct qdma_request *req, unsigned int bytes_done,
+			int err)
+{
+	struct qdma_stripe_sub *sub = (struct qdma_stripe_sub *)req->uld_data;
+
+	if (stripe_req_put(sub->sreq, bytes_done, err))
+		stripe_req_complete(sub->sreq);
+	return 0;
+}
+
+/*
+ * order the queue set so that consecutive chunks go to different mm
+ * channels where possible: the 1st queue of each channel, then the 2nd, ...
+ */
+static int stripe_queue_order(struct xlnx_dma_dev *xdev, unsigned long *qhndls,
+			unsigned int qcnt, bool write, unsigned long *order)
+{
+	u8 chan[QDMA_STRIPE_QMAX];
+	unsigned int rank[QDMA_STRIPE_QMAX];
+	unsigned int i, j, r, n = 0;
+
+	for (i = 0; i < qcnt; i++) {
+		struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev,
+						qhndls[i], NULL, 0, 1);
+
+		if (!descq || descq->conf.st || descq->conf.c2h == write)
+			return -EINVAL;
+		chan[i] = descq->channel;
+		for (rank[i] = 0, j = 0; j < i; j++)
+			if (chan[j] == chan[i])
+				rank[i]++;
+	}
+
+	for (r = 0; n < qcnt; r++)
+		for (i = 0; i < qcnt; i++)
+			if (rank[i] == r)
+				order[n++] = qhndls[i];
+	return 0;
+}
+
+/* split the request's sgl into the chunks */
+static int stripe_req_split(struct qdma_stripe_req *sreq, unsigned int chunk,
+			unsigned long *order, unsigned int qcnt)
+{
+	struct qdma_request *req = sreq->req;
+	struct qdma_sw_sg *sg = req->sgl;
+	struct qdma_sw_sg *sg_end = req->sgl + req->sgcnt;
+	struct qdma_sw_sg *out = sreq->sgl;
+	unsigned int left = req->count;
+	unsigned int sg_off = 0;
+	u64 ep_addr = req->ep_addr;
+	unsigned int k;
+
+	for (k = 0; k < sreq->sub_nr; k++) {
+		struct qdma_stripe_sub *sub = sreq->subs + k;
+		unsigned int len = min(left, chunk);
+		unsigned int l = len;
+
+		sub->req.sgl = out;
+		sub->req.sgcnt = 0;
+		while (l) {
+			unsigned int n;
+
+			if (sg == sg_end)
+				return -EINVAL;
+			n = min(sg->len - sg_off, l);
+			out->pg = sg->pg;
+			out->offset = sg->offset + sg_off;
+			out->len = n;
+			out->dma_addr = sg->dma_addr + sg_off;
+			out->next = out + 1;
+			out++;
+			sub->req.sgcnt++;
+
+			l -= n;
+			sg_off += n;
+			if (sg_off == sg->len) {
+				sg++;
+				sg_off = 0;
+			}
+		}
+		(out - 1)->next = NULL;
+
+		sub->sreq = sreq;
+		sub->qhndl = order[k % qcnt];
+		sub->req.count = len;
+		sub->req.ep_addr = ep_addr;
+		sub->req.write = req->write;
+		sub->req.dma_mapped = 1;
+		sub->req.timeout_ms = req->timeout_ms;
+		sub->req.uld_data = (unsigned long)sub;
+		sub->req.fp_done = stripe_sub_done;
+
+		ep_addr += len;
+		left -= len;
+	}
+
+	return 0;
+}
+
+ssize_t qdma_request_submit_striped(unsigned long dev_hndl,
+			unsigned long *qhndls, unsigned int qcnt,
+			struct qdma_request *req, unsigned int chunk)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_request *reqs[STRIPE_CHUNK_NR_MAX];
+	unsigned long order[QDMA_STRIPE_QMAX];
+	struct qdma_stripe_req *sreq;
+	unsigned int i, k, n, queued = 0;
+	int rv;
+
+	if (!qcnt || qcnt > QDMA_STRIPE_QMAX)
+		return -EINVAL;
+
+	if (!chunk)
+		chunk = STRIPE_CHUNK_DFLT;
+	chunk = max_t(unsigned int, PAGE_ALIGN(chunk),
+			DIV_ROUND_UP(req->count, STRIPE_CHUNK_NR_MAX));
+	chunk = PAGE_ALIGN(chunk);
+
+	/* nothing to spread */
+	if (qcnt == 1 || req->count <= chunk)
+		return qdma_request_submit(dev_hndl, qhndls[0], req);
+
+	rv = stripe_queue_order(xdev, qhndls, qcnt, req->write, order);
+	if (rv < 0)
+		return rv;
+
+	sreq = kzalloc(sizeof(struct qdma_stripe_req), GFP_KERNEL);
+	if (!sreq)
+		return -ENOMEM;
+	sreq->req = req;
+	sreq->xdev = xdev;
+	spin_lock_init(&sreq->lock);
+	init_completion(&sreq->cmpl);
+	sreq->sub_nr = DIV_ROUND_UP(req->count, chunk);
+	sreq->subs = kcalloc(sreq->sub_nr, sizeof(struct qdma_stripe_sub),
+				GFP_KERNEL);
+	sreq->sgl = kcalloc(req->sgcnt + sreq->sub_nr,
+				sizeof(struct qdma_sw_sg), GFP_KERNEL);
+	if (!sreq->subs || !sreq->sgl) {
+		rv = -ENOMEM;
+		goto free_sreq;
+	}
+
+	/* mapped once, the chunks use the bus addresses as is */
+	if (!req->dma_mapped) {
+		rv = sgl_map(xdev->conf.pdev, req->sgl, req->sgcnt,
+			req->write ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+		sreq->unmap_needed = true;
+		if (rv < 0)
+			goto free_sreq;
+	}
+
+	rv = stripe_req_split(sreq, chunk, order, qcnt);
+	if (rv < 0)
+		goto free_sreq;
+
+	pr_debug("req 0x%p, %u bytes, %u chunks of %u on %u queues.\n",
+		req, req->count, sreq->sub_nr, chunk, qcnt);
+
+	/* one batch per queue */
+	sreq->pending = 1;
+	for (i = 0; i < qcnt; i++) {
+		for (n = 0, k = i; k < sreq->sub_nr; k += qcnt)
+			reqs[n++] = &sreq->subs[k].req;
+
+		spin_lock_bh(&sreq->lock);
+		sreq->pending += n;
+		spin_unlock_bh(&sreq->lock);
+
+		rv = qdma_batch_request_submit(dev_hndl, order[i], reqs, n);
+		if (rv < 0) {
+			/* the others keep going, the request fails */
+			stripe_req_put(sreq, 0, rv);
+			spin_lock_bh(&sreq->lock);
+			sreq->pending -= n - 1;
+			spin_unlock_bh(&sreq->lock);
+			continue;
+		}
+		for (k = i; k < sreq->sub_nr; k += qcnt)
+			sreq->subs[k].queued = true;
+		queued += n;
+	}
+
+	if (!queued) {
+		/* none went out: fail right away, no fp_done */
+		rv = sreq->err;
+		goto free_sreq;
+	}
+
+	/* drop the bias */
+	if (stripe_req_put(sreq, 0, 0)) {
+		if (req->fp_done) {
+			stripe_req_complete(sreq);
+			return 0;
+		}
+	} else if (req->fp_done) {
+		return 0;
+	} else if (wait_for_completion_interruptible(&sreq->cmpl)) {
+		/* drop the chunks not posted yet, a chunk timing out is failed
+		 * by its queue */
+		pr_info("req 0x%p, striped over %u queues, interrupted.\n",
+			req, qcnt);
+		for (k = 0; k < sreq->sub_nr; k++) {
+			struct qdma_stripe_sub *sub = sreq->subs + k;
+
+			if (!sub->queued || qdma_request_cancel(dev_hndl,
+						sub->qhndl, &sub->req))
+				continue;
+			if (stripe_req_put(sreq, 0, -EINTR))
+				complete(&sreq->cmpl);
+		}
+		/* the chunks posted already have to complete */
+		wait_for_completion(&sreq->cmpl);
+	}
+
+	rv = sreq->err ? sreq->err : sreq->done;
+	stripe_req_free(sreq);
+	return rv;
+
+free_sreq:
+	stripe_req_free(sreq);
+	return rv;
+}
+
 int libqdma_init(void)
 {
 	if (sizeof(struct qdma_sgt_req_cb) > QDMA_REQ_OPAQUE_SIZE) {
@@ -50,6 +50,9 @@ typedef enum {
 } qdma_error_codes;
 
 struct pci_dev;
+struct file;
+struct poll_table_struct;
+struct vm_area_struct;
 
 /**
  * DOC: libqdma Initialization and Cleanup
@@ -94,12 +97,21 @@ enum intr_ring_size_sel {
 
 
 #define QDMA_DEV_NAME_MAXLEN	32
-#define QDMA_DEV_MSIX_VEC_MAX	8
+/* hw limit, the vector field of the queue interrupt context is 8 bits */
+#define QDMA_DEV_MSIX_VEC_MAX	256
 struct qdma_dev_conf {
 	struct pci_dev *pdev;
 
 	unsigned short qsets_max; /* max. of queue pairs */
-	unsigned short rsvd2;
+	unsigned short intr_budget; /* intr_inline=1, max. # of completions
+				       serviced per queue per interrupt,
+				       0: no limit */
+	unsigned short intr_poll_th; /* intr_adaptive=1, # of completions
+					serviced in one interrupt to switch
+					the queue to polling, 0: never */
+	unsigned short intr_irq_th; /* intr_adaptive=1, a polling pass with
+				       fewer completions switches the queue
+				       back to interrupt */
 
 	u8 poll_mode:1;		/* poll or interrupt */
 	u8 intr_agg:1;		/* poll_mode=0, enable intrrupt aggregation */
@@ -108,7 +120,13 @@ struct qdma_dev_conf {
 	u8 isr_top_q_en:1;	/* extra handling of per descq handling in
 				   top half (i.e., qdma_descq.fp_descq_isr_top
 				   will be set) */
-	u8 rsvd1:3;
+	u8 intr_inline:1;	/* poll_mode=0, service the queue
+				   completions in the threaded irq instead of
+				   the system workqueue */
+	u8 intr_adaptive:1;	/* poll_mode=0, switch busy queues to polling
+				   with their interrupt masked and back */
+	u8 ctxt_verify:1;	/* PF only: read back and compare each queue
+				   context written */
 
 	u8 vf_max;		/* PF only: max # VFs to be enabled */
 	u8 intr_rngsz;		/* intr_agg=1, intr_ring_size_sel */
@@ -116,14 +134,18 @@ struct qdma_dev_conf {
 	/*
 	 * interrupt:
 	 * - MSI-X only
-	 * max of QDMA_DEV_MSIX_VEC_MAX per function, 32 in Everest
+	 * all vectors advertised by the function are used, up to
+	 * QDMA_DEV_MSIX_VEC_MAX (32 in Everest)
  	 * - 1 vector is reserved for user interrupt
  	 * - 1 vector is reserved mailbox
 	 * - 1 vector on pf0 is reserved for error interrupt
 	 * - the remaining vectors will be used for queues
 	 */
 
-	/* max. of vectors used for queues. libqdma update w/ actual # */
+	/*
+	 * max. of vectors used for queues, 0 means no cap.
+	 * libqdma update w/ actual #
+	 */
 	u8 msix_qvec_max;
 
 	unsigned long uld;	/* upper layer data, i.e. callback data */
@@ -289,6 +311,9 @@ struct qdma_sw_sg {
 #define QDMA_QUEUE_NAME_MAXLEN	32
 #define QDMA_QUEUE_IDX_INVALID	0xFFFF
 #define QDMA_QUEUE_VEC_INVALID	0xFF	/* msix_vec_idx */
+#define QDMA_QOS_PRIO_MAX	4
+#define QDMA_QOS_QUANTUM	(128 * 1024)
+
 struct qdma_queue_conf {
 	unsigned short qidx;	/* 0xFFFF: libqdma choose the queue idx
 				   0 ~ (qdma_dev_conf.qsets_max - 1)
@@ -338,7 +363,19 @@ struct qdma_queue_conf {
 	u8 cmpl_trig_mode:3;	/* tigger_mode_t */
 	u8 cmpl_en_intr:1;	/* enable interrupt for WRB */
 
-	u8 rsvd;
+	/* config flags: byte #6 */
+	u8 mm_chnl_fixed:1;	/* MM only: use mm_channel, otherwise the least
+				   loaded channel is picked at queue start */
+	u8 rsvd:7;
+
+	u8 mm_channel;		/* MM only: channel (engine) if mm_chnl_fixed */
+
+	/*
+	 * request thread scheduling (MM, ST H2C): strict priority between
+	 * the classes, deficit round robin by weight within a class
+	 */
+	u8 qos_prio;		/* 0 (highest) ~ QDMA_QOS_PRIO_MAX - 1 */
+	u8 qos_weight;		/* 0: 1, quantum of QDMA_QOS_QUANTUM bytes each */
 
 	/*
 	 * TODO: for Platform streaming DSA
@@ -410,6 +447,87 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long qhndl, char *buf,
 int qdma_queue_remove(unsigned long dev_hndl, unsigned long qhndl, char *buf,
 				int buflen);
 
+/*
+ * qdma_queue_start_bulk - start a set of queues
+ * qdma_queue_stop_bulk - stop a set of queues
+ *
+ * @qhndls: the queues, @cnt of them, each listed once
+ * @status: per queue result, 0 or < 0 in case of error
+ *
+ * The rings of the queues are allocated in parallel and their contexts
+ * programmed in one pass, a failed queue does not affect the others.
+ * return # of queues started/stopped, < 0 in case of error
+ */
+int qdma_queue_start_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status);
+int qdma_queue_stop_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status);
+
+/*
+ * qdma_queue_restart - stop and start a queue again, keeping its rings
+ * qdma_queue_restart_bulk - restart a set of queues, as qdma_queue_stop_bulk
+ *
+ * The descriptor and completion rings and the mapped rx buffers are reused
+ * as long as the ring and buffer sizes stay the same: the indexes are reset
+ * and the contexts programmed, nothing is freed or allocated. Otherwise the
+ * rings are allocated again, as by qdma_queue_start().
+ * Not for queues in use by user space (-EBUSY).
+ * return 0 or # of queues restarted, < 0 in case of error
+ */
+int qdma_queue_restart(unsigned long dev_hndl, unsigned long qhndl, char *buf,
+			int buflen);
+int qdma_queue_restart_bulk(unsigned long dev_hndl, unsigned long *qhndls,
+			unsigned int cnt, int *status);
+
+/*
+ * kernel bypass: the queue's rings and doorbells are driven from user space,
+ * the kernel only programs the contexts. The data path of such a queue
+ * (request submit, packet read/write, poll) returns -EBUSY, and so do
+ * qdma_queue_stop() and qdma_queue_remove() until the owner lets it go.
+ */
+enum qdma_queue_user_region {
+	QDMA_QUEUE_USER_RING,	/* descriptor ring + status writeback */
+	QDMA_QUEUE_USER_CMPL,	/* st c2h: completion ring + status writeback */
+	QDMA_QUEUE_USER_DB,	/* the page of the queue's doorbell registers */
+	QDMA_QUEUE_USER_REGION_MAX
+};
+
+struct qdma_queue_user_info {
+	unsigned int qidx_hw;
+	unsigned int st;
+	unsigned int rngsz;		/* # of descriptors */
+	unsigned int desc_sz;		/* descriptor size in bytes */
+	unsigned int ring_len;		/* ring + status writeback, bytes */
+	unsigned int cmpl_rngsz;	/* st c2h: # of completion entries */
+	unsigned int cmpl_sz;		/* st c2h: completion entry size */
+	unsigned int cmpl_len;		/* st c2h: completion ring + status */
+	unsigned int c2h_bufsz;		/* st c2h: size of each rx buffer */
+	unsigned int db_off;		/* pidx doorbell, offset in the page */
+	unsigned int cmpl_db_off;	/* st c2h: cidx doorbell, offset */
+	unsigned int cmpl_db_flags;	/* st c2h: or'ed into each cidx write */
+};
+
+/*
+ * qdma_queue_user_start - start an added queue with its data path in
+ *			user space
+ * qdma_queue_user_stop - stop it again, the queue stays added
+ * qdma_queue_user_mmap - map one region of a user started queue into @vma,
+ *			the whole vma is mapped from offset 0 of the region,
+ *			vm_pgoff is left to the caller
+ *
+ * @dev_hndl: dev_hndl retured from qdma_device_open()
+ * @qhndl: hndl retured from qdma_queue_add()
+ * @info: filled in with the ring layout
+ *
+ * return < 0 in case of error
+ */
+int qdma_queue_user_start(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_queue_user_info *info);
+int qdma_queue_user_stop(unsigned long dev_hndl, unsigned long qhndl);
+int qdma_queue_user_mmap(unsigned long dev_hndl, unsigned long qhndl,
+			enum qdma_queue_user_region region,
+			struct vm_area_struct *vma);
+
 /**
  * queue helper/debug functions
  */
@@ -417,7 +535,9 @@ int qdma_queue_remove(unsigned long dev_hndl, unsigned long qhndl, char *buf,
 /*
  * qdma_queue_get_config - retrieve the configuration of a queue
  * qdma_queue_list - display all configured queues in a string buffer
- * qdma_queue_dump - display a queue's state in a string buffer
+ * qdma_queue_dump - display a queue's state in a string buffer, with its
+ *			contexts as they were programmed
+ * qdma_queue_dump_hw - qdma_queue_dump() with the contexts read from the hw
  * qdma_queue_dump_desc - display a queue's descriptor ring from index start
  * 				~ end in a string buffer
  * qdma_queue_dump_wrb -  display a queue's descriptor ring from index start
@@ -436,6 +556,8 @@ struct qdma_queue_conf *qdma_queue_get_config(unsigned long dev_hndl,
 int qdma_queue_list(unsigned long dev_hndl, char *buf, int buflen);
 int qdma_queue_dump(unsigned long dev_hndl, unsigned long qhndl, char *buf,
 				int buflen);
+int qdma_queue_dump_hw(unsigned long dev_hndl, unsigned long qhndl, char *buf,
+				int buflen);
 int qdma_queue_dump_desc(unsigned long dev_hndl, unsigned long qhndl,
 				unsigned int start, unsigned int end, char *buf,
 				int buflen);
@@ -457,7 +579,7 @@ int qdma_queue_set_err_indcution(unsigned long dev_hndl, unsigned long id,
  *	 < 0 in case of error
  */
 
-#define QDMA_REQ_OPAQUE_SIZE 	72
+#define QDMA_REQ_OPAQUE_SIZE 	96
 #define QDMA_UDD_MAXLEN		32
 struct qdma_request {
 	/* private to the dma driver, do NOT touch */
@@ -467,8 +589,12 @@ struct qdma_request {
 	unsigned long uld_data;		/* for the calling function */
 	int (*fp_done)(struct qdma_request *, unsigned int bytes_done, int err);
 					/* set fp_done for non-blocking mode */
-	unsigned int timeout_ms;	/* timeout in mili-seconds,
-					   0 - no timeout */
+	unsigned int timeout_ms;	/* timeout in mili-seconds, blocking
+					   and non-blocking (fp_done called
+					   with -ETIMEDOUT, once the
+					   descriptors posted complete or
+					   the queue is failed and taken
+					   off the hw), 0 - no timeout */
 	unsigned int count;		/* total data size */
 
 	u64 ep_addr;			/* MM only, DDR/BRAM memory addr */
@@ -483,6 +609,82 @@ struct qdma_request {
 ssize_t qdma_request_submit(unsigned long dev_hndl, unsigned long qhndl,
 			struct qdma_request *req);
 
+/*
+ * qdma_batch_request_submit - submit a batch of mm requests to a queue
+ *
+ * @dev_hndl: hndl retured from qdma_device_open()
+ * @qhndl: hndl retured from qdma_queue_add()
+ * @reqs, cnt: the requests, all non-blocking (fp_done set)
+ *
+ * The requests are queued at once and their descriptors posted back to back
+ * with one doorbell write, each completes via its fp_done.
+ *
+ * return 0 if all the requests are queued, < 0 if none is
+ */
+int qdma_batch_request_submit(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_request **reqs, unsigned int cnt);
+
+/*
+ * qdma_request_cancel - drop a non-blocking request not posted yet, its
+ *			fp_done is not called
+ *
+ * return 0 if cancelled, -EALREADY if fp_done has been called already,
+ * -EBUSY if it has descriptors posted: fp_done is called once they complete
+ */
+int qdma_request_cancel(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_request *req);
+
+/*
+ * qdma_request_submit_striped - submit a large mm request over several queues
+ *
+ * @dev_hndl: hndl retured from qdma_device_open()
+ * @qhndls, qcnt: mm queues of the request's direction, up to QDMA_STRIPE_QMAX
+ * @req: the request, blocking or not as with qdma_request_submit()
+ * @chunk: stripe size in bytes, 0 for the default (256KB). It is raised so a
+ *	request is split in 64 chunks at most.
+ *
+ * The request is split into chunks posted round robin to the queues, ordered
+ * so consecutive chunks go to queues on different mm channels where the set
+ * allows it. The chunks are in flight in parallel and complete in any order;
+ * the request completes once all of them have. A request no larger than a
+ * chunk goes to the 1st queue as is.
+ * A blocking request is interruptible: the chunks not posted yet are dropped
+ * (-EINTR), the call returns once those posted have completed.
+ *
+ * return # of bytes transferred (blocking), 0 if queued (non-blocking) or
+ *	< 0 on error
+ */
+#define QDMA_STRIPE_QMAX	32
+
+ssize_t qdma_request_submit_striped(unsigned long dev_hndl,
+			unsigned long *qhndls, unsigned int qcnt,
+			struct qdma_request *req, unsigned int chunk);
+
+/*
+ * qdma_queue_c2h_pages_take - zero copy st c2h receive
+ *
+ * @dev_hndl: hndl retured from qdma_device_open()
+ * @qhndl: hndl retured from qdma_queue_add()
+ * @sgl, sgcnt: filled in with the received data buffers
+ * @len: max. # of bytes
+ * @pg_max: max. # of PAGE_SIZE pages the buffers may span
+ * @wait: wait for data if none received yet
+ *
+ * The received freelist buffers are detached from the queue, in order, and
+ * replaced with newly allocated ones. The caller owns the page of each sg
+ * entry (a compound page of the freelist buffer size), release it with
+ * put_page(). Not available with fp_descq_c2h_packet or while read requests
+ * are pending on the queue.
+ *
+ * return # of sg entries filled
+ *	  -EAGAIN: no data (or the next buffer does not fit), and !wait
+ *	  -EOPNOTSUPP: not a st c2h queue
+ *	  < 0 in case of other errors
+ */
+int qdma_queue_c2h_pages_take(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_sw_sg *sgl, unsigned int sgcnt,
+			unsigned int len, unsigned int pg_max, bool wait);
+
 /*
  * qdma_queue_c2h_peek - peek a receive (c2h) queue
  *
@@ -513,6 +715,45 @@ int qdma_queue_c2h_peek(unsigned long dev_hndl, unsigned long qhndl,
  */
 int qdma_queue_avail_desc(unsigned long dev_hndl, unsigned long qhndl);
 
+/*
+ * qdma_queue_poll - poll()/epoll support
+ *
+ * @dev_hndl: hndl retured from qdma_device_open()
+ * @qhndl: hndl retured from qdma_queue_add()
+ * @filp, wait: as passed to file_operations.poll()
+ *
+ * the waiter is woken up when the queue's completions are processed.
+ * return POLLIN | POLLRDNORM: st c2h data received, mm c2h descriptors free
+ *	  POLLOUT | POLLWRNORM: h2c descriptors free
+ *	  POLLERR: queue not online or in error
+ */
+unsigned int qdma_queue_poll(unsigned long dev_hndl, unsigned long qhndl,
+			struct file *filp, struct poll_table_struct *wait);
+
+/*
+ * qdma_queue_set_rate - rate limit a queue (mm, st h2c)
+ *
+ * @dev_hndl: hndl retured from qdma_device_open()
+ * @qhndl: hndl retured from qdma_queue_add()
+ * @rate: the limits, all 0 to remove them
+ * @buf, buflen: message buffer
+ *
+ * token buckets of bytes and descriptors, refilled at the rates given. The
+ * request thread posts only as much as the buckets hold and leaves the queue
+ * alone until they are refilled. Takes effect at once, the buckets start full.
+ *
+ * return 0 if success, < 0 otherwise
+ */
+struct qdma_queue_rate {
+	u64 bytes_ps;		/* bytes/s, 0: no limit */
+	u32 desc_ps;		/* descriptors/s, 0: no limit */
+	u32 burst_bytes;	/* bucket size, 0: 10ms worth, at least 64KB */
+	u32 burst_desc;		/* bucket size, 0: 10ms worth, at least 16 */
+};
+
+int qdma_queue_set_rate(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_queue_rate *rate, char *buf, int buflen);
+
 /*
  * packet/streaming interfaces
  */
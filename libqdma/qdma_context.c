@@ -32,7 +32,7 @@ static int make_intr_context(struct xlnx_dma_dev *xdev, u32 *data, int cnt)
 		return 0;
 	}
 
-	/* assume data[2 * XDEV_NUM_IRQ_MAX] */
+	/* assume data[2 * QDMA_DATA_VEC_PER_PF_MAX] */
 	if (cnt < (QDMA_DATA_VEC_PER_PF_MAX << 1)) {
 		pr_warn("%s, intr context %d < (%d * 2).\n",
 			xdev->conf.name, cnt, QDMA_DATA_VEC_PER_PF_MAX);
@@ -92,7 +92,8 @@ static int make_sw_context(struct qdma_descq *descq, u32 *data, int cnt)
 			(V_DESC_CTXT_W1_FUNC_ID(descq->xdev->func_id)) |
 			(descq->conf.bypass << S_DESC_CTXT_W1_F_BYP) |
 			(descq->conf.wbk_en << S_DESC_CTXT_W1_F_WBK_EN) |
-			(descq->conf.irq_en << S_DESC_CTXT_W1_F_IRQ_EN);
+			((descq->conf.irq_en && !descq->user_owned) <<
+				S_DESC_CTXT_W1_F_IRQ_EN);
 #ifdef ERR_DEBUG
 	if (descq->induce_err & (1 << param)) {
 		data[1] |= (0xFF << S_DESC_CTXT_W1_FUNC_ID);
@@ -166,7 +167,8 @@ static int make_wrb_context(struct qdma_descq *descq, u32 *data, int cnt)
 	v = bus_64 & M_WRB_CTXT_W0_BADDR_64;
 
 	data[0] = (descq->conf.cmpl_stat_en << S_WRB_CTXT_W0_F_EN_STAT_DESC) |
-		  (descq->conf.irq_en << S_WRB_CTXT_W0_F_EN_INT) |
+		  ((descq->conf.irq_en && !descq->user_owned) <<
+				S_WRB_CTXT_W0_F_EN_INT) |
 		  (V_WRB_CTXT_W0_TRIG_MODE(descq->conf.cmpl_trig_mode)) |
 		  (V_WRB_CTXT_W0_FNC_ID(descq->xdev->func_id)) |
 		  (descq->conf.cmpl_timer_idx << S_WRB_CTXT_W0_TIMER_IDX) |
@@ -237,21 +239,22 @@ static int make_qid2vec_context(struct xlnx_dma_dev *xdev, struct qdma_descq *de
 #ifdef __QDMA_VF__
 int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 {
-	u32 data[XDEV_NUM_IRQ_MAX << 1];
+	/* one coalescing context per data vector ring, not per msi-x vector */
+	u32 data[QDMA_DATA_VEC_PER_PF_MAX << 1];
 	int i = 0;
 	int rv;
 
 	if (!xdev->intr_coal_en)
 		return 0;
 
-	rv = make_intr_context(xdev, data, XDEV_NUM_IRQ_MAX << 1);
+	rv = make_intr_context(xdev, data, QDMA_DATA_VEC_PER_PF_MAX << 1);
 	if (rv < 0)
 		return rv;
 	do {
 		struct mbox_msg m;
 		struct mbox_msg_hdr *hdr = &m.hdr;
 		struct mbox_msg_intr_ctxt *ictxt = &m.intr_ctxt;
-		u8 copy = xdev->num_vecs  - i;
+		u8 copy = QDMA_DATA_VEC_PER_PF_MAX - i;
 
 		if (copy > MBOX_INTR_CTXT_VEC_MAX)
 			copy = MBOX_INTR_CTXT_VEC_MAX;
@@ -266,7 +269,7 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 		ictxt->vec_base = i;
 		ictxt->vec_cnt = copy;
 
-		memcpy(ictxt->w, data + 2 * i, copy * sizeof(u32));
+		memcpy(ictxt->w, data + 2 * i, (copy << 1) * sizeof(u32));
 
 		rv = qdma_mbox_send_msg(xdev, &m, 1);
 		if (rv < 0) {
@@ -287,7 +290,7 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 
 		i += copy;
 
-	} while (i < xdev->num_vecs);
+	} while (i < QDMA_DATA_VEC_PER_PF_MAX);
 
 	return 0;
 }
@@ -330,6 +333,26 @@ int qdma_descq_context_clear(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 
 }
 
+int qdma_descq_context_clear_bulk(struct xlnx_dma_dev *xdev,
+				struct qdma_descq **descqs, unsigned int cnt)
+{
+	unsigned int i;
+	int rv = 0;
+	int rv2;
+
+	/* one mailbox message per queue */
+	for (i = 0; i < cnt; i++) {
+		if (!descqs[i])
+			continue;
+		rv2 = qdma_descq_context_clear(xdev, descqs[i]->qidx_hw,
+				descqs[i]->conf.st, descqs[i]->conf.c2h, 0);
+		if (rv2 < 0 && !rv)
+			rv = rv2;
+	}
+
+	return rv;
+}
+
 int qdma_descq_context_read(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 				bool st, bool c2h,
 				struct hw_descq_context *context)
@@ -411,10 +434,15 @@ int qdma_descq_context_setup(struct qdma_descq *descq)
 	hdr = &xdev->m_req.hdr;
 	pr_debug("%s, mbox rcv ack:%d, status 0x%x.\n",
 		xdev->conf.name, hdr->ack, hdr->status);
-	if (hdr->ack)
-		return hdr->status;
-	else
+	if (!hdr->ack)
 		return -EINVAL;
+	if (hdr->status)
+		return hdr->status;
+
+	/* qid2vec is set up by the pf */
+	descq->ctxt = *context;
+	descq->ctxt_valid = 1;
+	return 0;
 }
 
 #else /* PF only */
@@ -449,6 +477,9 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 					QDMA_CTXT_SEL_COAL, data + 2*i, 2, 1);
 		if (rv < 0)
 			return rv;
+		memcpy(xdev->intr_coal_list[i].ctxt, data + 2*i,
+			sizeof(xdev->intr_coal_list[i].ctxt));
+		xdev->intr_coal_list[i].ctxt_valid = 1;
 
 		pr_debug("intr_ctxt WR: ring_index(Qid) = %d, data[1] = %x data[0] = %x\n",
 						ring_index, *(data + ((2*i) + 1)), *(data + (2*i)));
@@ -468,46 +499,105 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 	return 0;
 }
 
-int qdma_descq_context_clear(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
-				bool st, bool c2h, bool clr)
+static inline void ctxt_op_set(struct hw_ind_ctxt_op *ctxt_op,
+				unsigned int qid_hw, enum ind_ctxt_cmd_op op,
+				enum ind_ctxt_cmd_sel sel, u32 *data,
+				unsigned int cnt, bool verify)
 {
-	u8 sel;
-	int rv = 0;
+	ctxt_op->qid_hw = qid_hw;
+	ctxt_op->op = op;
+	ctxt_op->sel = sel;
+	ctxt_op->data = data;
+	ctxt_op->cnt = cnt;
+	ctxt_op->verify = verify;
+}
 
-	sel = c2h ? QDMA_CTXT_SEL_SW_C2H : QDMA_CTXT_SEL_SW_H2C;
-	rv = hw_indirect_ctext_prog(xdev, qid_hw,
-			clr ? QDMA_CTXT_CMD_CLR : QDMA_CTXT_CMD_INV,
-			sel, NULL, 0, 0);
-	if (rv < 0)
-		return rv;
+/* max. # of commands to clear the contexts of a queue */
+#define QDMA_CTXT_CLR_OPS_MAX	5
 
-	sel = c2h ? QDMA_CTXT_SEL_HW_C2H : QDMA_CTXT_SEL_HW_H2C;
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_CLR, sel,
-				 NULL, 0, 0);
-	if (rv < 0)
-		return rv;
+static unsigned int make_context_clear_ops(struct hw_ind_ctxt_op *ops,
+				unsigned int qid_hw, bool st, bool c2h,
+				bool clr)
+{
+	unsigned int n = 0;
 
-	sel = c2h ? QDMA_CTXT_SEL_CR_C2H : QDMA_CTXT_SEL_CR_H2C;
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_CLR, sel,
-				NULL, 0, 0);
-	if (rv < 0)
-		return rv;
+	ctxt_op_set(ops + n++, qid_hw,
+			clr ? QDMA_CTXT_CMD_CLR : QDMA_CTXT_CMD_INV,
+			c2h ? QDMA_CTXT_SEL_SW_C2H : QDMA_CTXT_SEL_SW_H2C,
+			NULL, 0, 0);
+	ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_CLR,
+			c2h ? QDMA_CTXT_SEL_HW_C2H : QDMA_CTXT_SEL_HW_H2C,
+			NULL, 0, 0);
+	ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_CLR,
+			c2h ? QDMA_CTXT_SEL_CR_C2H : QDMA_CTXT_SEL_CR_H2C,
+			NULL, 0, 0);
 
 	/* Only clear prefetch and writeback contexts if this queue is ST C2H */
 	if (st && c2h) {
-		rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_CLR,
-					QDMA_CTXT_SEL_PFTCH, NULL, 0, 0);
-		if (rv < 0)
-			return rv;
-		rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_CLR,
-					QDMA_CTXT_SEL_WRB, NULL, 0, 0);
-		if (rv < 0)
-			return rv;
+		ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_CLR,
+				QDMA_CTXT_SEL_PFTCH, NULL, 0, 0);
+		ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_CLR,
+				QDMA_CTXT_SEL_WRB, NULL, 0, 0);
 	}
 
 	/* TODO pasid context (0x9) */
 
-	return 0;
+	return n;
+}
+
+int qdma_descq_context_clear(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
+				bool st, bool c2h, bool clr)
+{
+	struct hw_ind_ctxt_op ops[QDMA_CTXT_CLR_OPS_MAX];
+	unsigned int n = make_context_clear_ops(ops, qid_hw, st, c2h, clr);
+
+	return hw_indirect_ctext_prog_batch(xdev, ops, n, NULL);
+}
+
+int qdma_descq_context_clear_bulk(struct xlnx_dma_dev *xdev,
+				struct qdma_descq **descqs, unsigned int cnt)
+{
+	struct hw_ind_ctxt_op *ops;
+	unsigned int done;
+	unsigned int n = 0;
+	unsigned int i;
+	int rv = 0;
+	int rv2;
+
+	ops = kcalloc(cnt * QDMA_CTXT_CLR_OPS_MAX, sizeof(*ops), GFP_KERNEL);
+	if (!ops) {
+		for (i = 0; i < cnt; i++) {
+			if (!descqs[i])
+				continue;
+			rv2 = qdma_descq_context_clear(xdev, descqs[i]->qidx_hw,
+					descqs[i]->conf.st, descqs[i]->conf.c2h,
+					0);
+			if (rv2 < 0 && !rv)
+				rv = rv2;
+		}
+		return rv;
+	}
+
+	for (i = 0; i < cnt; i++)
+		if (descqs[i])
+			n += make_context_clear_ops(ops + n,
+					descqs[i]->qidx_hw, descqs[i]->conf.st,
+					descqs[i]->conf.c2h, 0);
+
+	/* a failed command does not keep the other queues from being cleared */
+	for (i = 0; i < n; i += done + 1) {
+		rv2 = hw_indirect_ctext_prog_batch(xdev, ops + i, n - i, &done);
+		if (rv2 < 0) {
+			pr_warn("%s, Q 0x%x, sel 0x%x, clear failed %d.\n",
+				xdev->conf.name, ops[i + done].qid_hw,
+				ops[i + done].sel, rv2);
+			if (!rv)
+				rv = rv2;
+		}
+	}
+
+	kfree(ops);
+	return rv;
 }
 
 int qdma_descq_context_setup(struct qdma_descq *descq)
@@ -516,11 +606,7 @@ int qdma_descq_context_setup(struct qdma_descq *descq)
 	struct hw_descq_context context;
 	int rv;
 
-	rv = qdma_descq_context_clear(xdev, descq->qidx_hw, descq->conf.st,
-				descq->conf.c2h, 1);
-	if (rv < 0)
-		return rv;
-
+	/* cleared by qdma_descq_context_program() first */
 	memset(&context, 0, sizeof(context));
 
 	make_sw_context(descq, context.sw, 4);
@@ -531,8 +617,14 @@ int qdma_descq_context_setup(struct qdma_descq *descq)
 		make_wrb_context(descq, context.wrb, 4);
 	}
 
-	return qdma_descq_context_program(descq->xdev, descq->qidx_hw,
+	rv = qdma_descq_context_program(descq->xdev, descq->qidx_hw,
 				descq->conf.st, descq->conf.c2h, &context);
+	if (rv < 0)
+		return rv;
+
+	descq->ctxt = context;
+	descq->ctxt_valid = 1;
+	return 0;
 }
 
 int qdma_descq_context_read(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
@@ -601,43 +693,33 @@ int qdma_descq_context_program(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 				struct hw_descq_context *context)
 
 {
-	u8 sel;
-	int rv;
+	struct hw_ind_ctxt_op ops[QDMA_CTXT_CLR_OPS_MAX + 4];
+	bool verify = xdev->conf.ctxt_verify;
+	unsigned int n;
 
-	/* always clear first */
-	rv = qdma_descq_context_clear(xdev, qid_hw, st, c2h, 1);
-	if (rv < 0)
-		return rv;
+	/* always clear first, all in one go */
+	n = make_context_clear_ops(ops, qid_hw, st, c2h, 1);
 
-	sel = c2h ?  QDMA_CTXT_SEL_SW_C2H : QDMA_CTXT_SEL_SW_H2C;
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_WR, sel,
-				context->sw, 4, 1);
-	if (rv < 0)
-		return rv;
+	ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_WR,
+			c2h ?  QDMA_CTXT_SEL_SW_C2H : QDMA_CTXT_SEL_SW_H2C,
+			context->sw, 4, verify);
 
 	/* qid2vec context */
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_WR,
-			QDMA_CTXT_SEL_QID2VEC, context->qid2vec, 1, 1);
-	if (rv < 0)
-		return rv;
+	ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_WR, QDMA_CTXT_SEL_QID2VEC,
+			context->qid2vec, 1, verify);
 
 	/* Only c2h st specific setup done below*/
-	if (!st || !c2h)
-		return 0;
-
-	/* prefetch context */
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_WR,
-				QDMA_CTXT_SEL_PFTCH, context->prefetch, 2, 1);
-	if (rv < 0)
-		return rv;
-
-	/* writeback context */
-	rv = hw_indirect_ctext_prog(xdev, qid_hw, QDMA_CTXT_CMD_WR,
-				QDMA_CTXT_SEL_WRB, context->wrb, 4, 1);
-	if (rv < 0)
-		return rv;
+	if (st && c2h) {
+		/* prefetch context */
+		ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_WR,
+				QDMA_CTXT_SEL_PFTCH, context->prefetch, 2,
+				verify);
+		/* writeback context */
+		ctxt_op_set(ops + n++, qid_hw, QDMA_CTXT_CMD_WR,
+				QDMA_CTXT_SEL_WRB, context->wrb, 4, verify);
+	}
 
-	return 0;
+	return hw_indirect_ctext_prog_batch(xdev, ops, n, NULL);
 }
 
 #endif
@@ -21,6 +21,9 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev);
 int qdma_descq_context_setup(struct qdma_descq *descq);
 int qdma_descq_context_clear(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 				bool st, bool c2h, bool clr);
+/* invalidate the contexts of the queues in @descqs, NULL entries skipped */
+int qdma_descq_context_clear_bulk(struct xlnx_dma_dev *xdev,
+				struct qdma_descq **descqs, unsigned int cnt);
 int qdma_descq_context_read(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 				bool st, bool c2h,
 				struct hw_descq_context *ctxt);
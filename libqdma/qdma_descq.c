@@ -16,6 +16,9 @@
 
 #include <linux/kernel.h>
 #include <linux/delay.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/pci.h>
 
 #include "qdma_device.h"
 #include "qdma_intr.h"
@@ -28,17 +31,19 @@
 #include "qdma_nl.h"
 #endif
 
-void intr_cidx_update(struct qdma_descq *descq, unsigned int sw_cidx)
+/*
+ * the interrupt ring's cidx, the register is addressed by the ring index
+ * (see get_intr_ring_index()), not by any of the queues on the ring.
+ */
+void intr_cidx_update(struct xlnx_dma_dev *xdev, unsigned int ring_index,
+			unsigned int sw_cidx)
 {
 	unsigned int cidx = 0;
 
 	cidx |= V_INTR_CIDX_UPD_SW_CIDX(sw_cidx);
 
-	if (descq->conf.c2h)
-		cidx |= 1 << S_INTR_CIDX_UPD_DIR_SEL;
-
-	__write_reg(descq->xdev,
-		QDMA_REG_INT_CIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP,
+	__write_reg(xdev,
+		QDMA_REG_INT_CIDX_BASE + ring_index * QDMA_REG_PIDX_STEP,
 		cidx);
 
 	dma_wmb();
@@ -77,8 +82,9 @@ static int sgl_find_offset(struct qdma_sw_sg *sgl, unsigned int sgcnt,
 			*sg_offset = 0;
 			return ++i;
 		} else if (len > offset) {
+			/* offset into this sg entry */
 			*sg_p = sg;
-			*sg_offset = len - offset;
+			*sg_offset = sg->len - (len - offset);
 			return i;
 		}
 	}
@@ -94,7 +100,8 @@ static inline void req_submitted(struct qdma_descq *descq,
 }
 
 static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
-				struct qdma_sgt_req_cb *cb)
+				struct qdma_sgt_req_cb *cb, unsigned int budget,
+				unsigned int desc_budget)
 {
 	struct qdma_request *req = (struct qdma_request *)cb;
 	struct qdma_sw_sg *sg = req->sgl;
@@ -104,7 +111,7 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 	struct qdma_mm_desc *desc = (struct qdma_mm_desc *)descq->desc;
 	struct qdma_mm_desc *desc_start = NULL;
 	struct qdma_mm_desc *desc_end = NULL;
-	unsigned int desc_max = descq->avail;
+	unsigned int desc_max = min(descq->avail, desc_budget);
 	unsigned int data_cnt = 0;
 	unsigned int desc_cnt = 0;
 	unsigned int len = 0;
@@ -134,7 +141,8 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 	desc += descq->pidx;
 	desc_start = desc;
 
-	for (; i < sg_max && desc_cnt < desc_max; i++, sg++) {
+	for (; i < sg_max && desc_cnt < desc_max && data_cnt < budget;
+	     i++, sg++) {
 		unsigned int tlen = sg->len;
 		dma_addr_t addr = sg->dma_addr;
 		unsigned int pg_off = sg->offset;
@@ -143,10 +151,10 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 			desc_cnt, desc_max, i, len, tlen, sg_offset);
 
 		if (sg_offset) {
-			sg_offset = 0;
 			tlen -= sg_offset;
 			addr += sg_offset;
 			pg_off += sg_offset;
+			sg_offset = 0;
 		}
 
 		while (tlen) {
@@ -182,7 +190,7 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 			}
 
 			desc_cnt++;
-			if (desc_cnt == desc_max)
+			if (desc_cnt == desc_max || data_cnt >= budget)
 				break;
 		}
 	}
@@ -202,6 +210,8 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 	descq->avail -= desc_cnt;
 	cb->desc_nr += desc_cnt;
 	cb->offset += data_cnt;
+	atomic64_add(data_cnt,
+		&descq->xdev->mm_chnl[descq->conf.c2h][descq->channel].bytes);
 
 	pr_debug("descq %s, +%u,%u, avail %u, ep_addr 0x%llx + 0x%x(%u).\n",
 		descq->conf.name, desc_cnt, descq->pidx, descq->avail,
@@ -210,10 +220,7 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 	if (cb->offset == req->count)
 		req_submitted(descq, cb);
 
-	if (descq->conf.c2h)
-		descq_c2h_pidx_update(descq, descq->pidx);
-	else
-		descq_h2c_pidx_update(descq, descq->pidx);
+	/* the pidx doorbell is rung by the request thread, once per pass */
 
 	if (descq->wbthp)
 		qdma_kthread_wakeup(descq->wbthp);
@@ -222,14 +229,15 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 }
 
 static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
-				struct qdma_sgt_req_cb *cb)
+				struct qdma_sgt_req_cb *cb, unsigned int budget,
+				unsigned int desc_budget)
 {
 	struct qdma_request *req = (struct qdma_request *)cb;
 	struct qdma_sw_sg *sg = req->sgl;
 	unsigned int sg_offset = 0;
 	unsigned int sg_max = req->sgcnt;
 	struct qdma_h2c_desc *desc = (struct qdma_h2c_desc *)descq->desc + descq->pidx;
-	unsigned int desc_max = descq->avail;
+	unsigned int desc_max = min(descq->avail, desc_budget);
 	unsigned int data_cnt = 0;
 	unsigned int desc_cnt = 0;
 	int i = 0;
@@ -260,19 +268,18 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 		pr_debug("%s, req 0x%p, offset %u/%u -> sg %d, 0x%p,%u.\n",
 			descq->conf.name, req, cb->offset, req->count, rv, sg,
 			sg_offset);
-	} else {
+	} else
 		i = 0;
-		desc->flags |= S_H2C_DESC_F_SOP;
-	}
 
-	for (; i < sg_max && desc_cnt < desc_max; i++, sg++) {
+	for (; i < sg_max && desc_cnt < desc_max && data_cnt < budget;
+	     i++, sg++) {
 		unsigned int tlen = sg->len;
 		dma_addr_t addr = sg->dma_addr;
 
 		if (sg_offset) {
-			sg_offset = 0;
 			tlen -= sg_offset;
 			addr += sg_offset;
+			sg_offset = 0;
 		}
 
 		do { /* to support zero byte transfer */
@@ -280,6 +287,8 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 
 			desc->src_addr = addr;
 			desc->len = len;
+			desc->flags = (!cb->offset && !desc_cnt) ?
+					S_H2C_DESC_F_SOP : 0;
 #ifdef ER_DEBUG
 			if (descq->induce_err & (1 << len_mismatch)) {
 				desc->len = 0xFFFFFFFF;
@@ -293,7 +302,8 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 			addr += len;
 			tlen -= len;
 
-			if ((i == sg_max - 1))
+			/* a sg entry may span multiple descriptors */
+			if (i == sg_max - 1 && !tlen)
 				desc->flags |= S_H2C_DESC_F_EOP;
 
 #if 0
@@ -312,7 +322,7 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 			descq_h2c_pidx_update(descq, descq->pidx);
 
 			desc_cnt++;
-			if (desc_cnt == desc_max)
+			if (desc_cnt == desc_max || data_cnt >= budget)
 				break;
 		} while (tlen);
 	}
@@ -351,7 +361,8 @@ static void req_update_pend(struct qdma_descq *descq, unsigned int credit)
 			pr_debug("%s, cb 0x%p done, credit %u > %u.\n",
 				descq->conf.name, cb, credit, cb->desc_nr);
 			credit -= cb->desc_nr;
-			qdma_sgt_req_done(descq, cb, 0);
+			qdma_sgt_req_done(descq, cb,
+					cb->aborted ? cb->status : 0);
 		} else {
 			pr_debug("%s, cb 0x%p not done, credit %u < %u.\n",
 				descq->conf.name, cb, credit, cb->desc_nr);
@@ -387,23 +398,27 @@ static inline int get_desc_wb_size(struct qdma_descq *descq)
 	return (int)sizeof(struct qdma_desc_wb);
 }
 
+/*
+ * the rings come from and go back to the device's ring pool, except the ones
+ * mapped to user space (@cache 0) which are not handed to another queue
+ */
 static inline void desc_ring_free(struct xlnx_dma_dev *xdev, int ring_sz,
-			int desc_sz, int wb_sz, u8 *desc, dma_addr_t desc_bus)
+			int desc_sz, int wb_sz, u8 *desc, dma_addr_t desc_bus,
+			bool cache)
 {
 	unsigned int len = ring_sz * desc_sz + wb_sz;
 
 	pr_debug("free %u(0x%x)=%d*%u+%d, 0x%p, bus 0x%llx.\n",
 		len, len, desc_sz, ring_sz, wb_sz, desc, desc_bus);
 
-	dma_free_coherent(&xdev->conf.pdev->dev, ring_sz * desc_sz + wb_sz,
-			desc, desc_bus);
+	qdma_ring_pool_free(xdev, len, desc, desc_bus, cache);
 }
 
 static void *desc_ring_alloc(struct xlnx_dma_dev *xdev, int ring_sz,
 			int desc_sz, int wb_sz, dma_addr_t *bus, u8 **wb_pp)
 {
 	unsigned int len = ring_sz * desc_sz + wb_sz;
-	u8 *p = dma_alloc_coherent(&xdev->conf.pdev->dev, len, bus, GFP_ATOMIC);
+	u8 *p = qdma_ring_pool_alloc(xdev, len, bus);
 
 	if (!p) {
 		pr_info("%s, OOM, sz ring %d, desc %d, wb %d.\n",
@@ -412,7 +427,8 @@ static void *desc_ring_alloc(struct xlnx_dma_dev *xdev, int ring_sz,
 	}
 
 	*wb_pp = p + ring_sz * desc_sz;
-	memset(p, 0, len);
+	/* up to the page boundary, that much can be mapped to user space */
+	memset(p, 0, PAGE_ALIGN(len));
 
 	pr_debug("alloc %u(0x%x)=%d*%u+%d, 0x%p, bus 0x%llx, wb 0x%p.\n",
 		len, len, desc_sz, ring_sz, wb_sz, p, *bus, *wb_pp);
@@ -543,6 +559,301 @@ static int descq_mm_n_h2c_wb(struct qdma_descq *descq)
 
 /* ************** public function definitions ******************************* */
 
+/*
+ * request timeouts: the requests of a queue with a timeout are kept on
+ * descq->tmo_list in deadline order, one timer is armed for the earliest.
+ */
+static inline void req_tmo_del(struct qdma_sgt_req_cb *cb)
+{
+	/* never tracked: still all 0 from the submit */
+	if (cb->tmo_list.next)
+		list_del_init(&cb->tmo_list);
+}
+
+/* calling routine should hold the lock */
+void qdma_req_tmo_add(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb)
+{
+	struct qdma_request *req = (struct qdma_request *)cb;
+	struct qdma_sgt_req_cb *pos;
+
+	INIT_LIST_HEAD(&cb->tmo_list);
+	if (!req->timeout_ms)
+		return;
+
+	cb->deadline = jiffies + msecs_to_jiffies(req->timeout_ms);
+	/* mostly the same timeout: in order, from the tail */
+	list_for_each_entry_reverse(pos, &descq->tmo_list, tmo_list)
+		if (!time_before(cb->deadline, pos->deadline))
+			break;
+	list_add(&cb->tmo_list, &pos->tmo_list);
+
+	if (descq->tmo_list.next == &cb->tmo_list)
+		mod_timer(&descq->tmo_timer, cb->deadline);
+}
+
+/* queue stopped: the requests left are not timed any more */
+void qdma_req_tmo_clear(struct qdma_descq *descq)
+{
+	struct qdma_sgt_req_cb *cb, *tmp;
+
+	del_timer_sync(&descq->tmo_timer);
+
+	lock_descq(descq);
+	list_for_each_entry_safe(cb, tmp, &descq->tmo_list, tmo_list)
+		list_del_init(&cb->tmo_list);
+	unlock_descq(descq);
+}
+
+/*
+ * a request taken off the queue before it completes (timed out, interrupted)
+ * with descriptors outstanding: the hw owns them until they complete, in
+ * order. The request posts no more, it is completed with @error (buffers
+ * unmapped, fp_done called) once they have, see req_update_pend(), or once
+ * the queue is taken off the hw, see qdma_descq_flush_reqs().
+ * return false if none are outstanding.
+ */
+static bool req_defer(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
+			int error)
+{
+	struct qdma_request *req = (struct qdma_request *)cb;
+
+	/* st c2h: the rx buffers are not per request */
+	if (!cb->desc_nr || (descq->conf.st && descq->conf.c2h))
+		return false;
+
+	req_tmo_del(cb);
+	if (cb->aborted)
+		return true;
+	cb->aborted = 1;
+	cb->status = error;
+	/* partly posted, 1st on the work_list */
+	if (cb->offset != req->count)
+		list_move_tail(&cb->list, &descq->pend_list);
+	return true;
+}
+
+/* calling routine should hold the lock */
+bool qdma_sgt_req_defer(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
+			int error)
+{
+	if (!req_defer(descq, cb, error))
+		return false;
+	/* the descriptors may have completed already */
+	req_update_pend(descq, 0);
+	return true;
+}
+
+/*
+ * calling routine should hold the lock: a request with no descriptors
+ * outstanding is dropped, fp_done is not called.
+ */
+void qdma_sgt_req_abandon(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb)
+{
+	struct qdma_request *req = (struct qdma_request *)cb;
+
+	list_del(&cb->list);
+	req_tmo_del(cb);
+	if (cb->unmap_needed) {
+		sgl_unmap(descq->xdev->conf.pdev, req->sgl, req->sgcnt,
+			descq->conf.c2h ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+		cb->unmap_needed = 0;
+	}
+}
+
+/*
+ * calling routine should hold the lock, the contexts of the queue are
+ * cleared: the hw owns none of the descriptors any more. All the requests
+ * left are failed with @error, a deferred one with its own status.
+ */
+void qdma_descq_flush_reqs(struct qdma_descq *descq, int error)
+{
+	struct qdma_sgt_req_cb *cb, *tmp;
+
+	list_for_each_entry_safe(cb, tmp, &descq->pend_list, list)
+		qdma_sgt_req_done(descq, cb, cb->aborted ? cb->status : error);
+	list_for_each_entry_safe(cb, tmp, &descq->work_list, list)
+		qdma_sgt_req_done(descq, cb, cb->aborted ? cb->status : error);
+	descq->credit = 0;
+}
+
+/* the queue stays in error, nothing is posted any more until it is stopped */
+static void descq_err_work(struct work_struct *work)
+{
+	struct qdma_descq *descq = container_of(work, struct qdma_descq,
+						err_work);
+
+	/* may sleep (vf mailbox), not with the lock held */
+	qdma_descq_context_clear(descq->xdev, descq->qidx_hw, descq->conf.st,
+				descq->conf.c2h, 0);
+
+	lock_descq(descq);
+	qdma_descq_flush_reqs(descq, -ETIMEDOUT);
+	unlock_descq(descq);
+	wake_up_interruptible(&descq->poll_wq);
+}
+
+/*
+ * calling routine should hold the lock: the descriptors posted may never
+ * come back, the queue is failed, its contexts cleared and its requests
+ * flushed by descq_err_work().
+ */
+void qdma_descq_set_err(struct qdma_descq *descq)
+{
+	pr_info("%s: stuck, taken off the hw.\n", descq->conf.name);
+	descq->err = 1;
+	schedule_work(&descq->err_work);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+static void descq_tmo_proc(struct timer_list *t)
+#else
+static void descq_tmo_proc(unsigned long arg)
+#endif
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+	struct qdma_descq *descq = from_timer(descq, t, tmo_timer);
+#else
+	struct qdma_descq *descq = (struct qdma_descq *)arg;
+#endif
+	struct qdma_desc_wb *wb = (struct qdma_desc_wb *)descq->desc_wb;
+	struct qdma_sgt_req_cb *cb, *tmp;
+	unsigned int expired = 0;
+	unsigned int deferred = 0;
+
+	lock_descq(descq);
+	list_for_each_entry_safe(cb, tmp, &descq->tmo_list, tmo_list) {
+		struct qdma_request *req = (struct qdma_request *)cb;
+
+		if (time_before(jiffies, cb->deadline)) {
+			mod_timer(&descq->tmo_timer, cb->deadline);
+			break;
+		}
+
+		pr_info("%s: req 0x%p, %c,%u/%u,0x%llx, desc %u, timed out, %u ms.\n",
+			descq->conf.name, req, req->write ? 'W' : 'R',
+			cb->offset, req->count, req->ep_addr, cb->desc_nr,
+			req->timeout_ms);
+		expired++;
+		if (req_defer(descq, cb, -ETIMEDOUT))
+			deferred++;
+		else
+			qdma_sgt_req_done(descq, cb, -ETIMEDOUT);
+	}
+	/* not while walking the tmo_list, the completions take off theirs */
+	if (deferred) {
+		req_update_pend(descq, 0);
+		list_for_each_entry(cb, &descq->pend_list, list)
+			if (cb->aborted) {
+				qdma_descq_set_err(descq);
+				break;
+			}
+	}
+
+	if (expired) {
+		descq->tmo_cnt += expired;
+		/* where the queue got stuck */
+		qdma_descq_dump(descq, NULL, 0, 1);
+		if (wb && descq->inited)
+			pr_info("%s: hw pidx %u, cidx %u, avail %u, credit %u, deferred %u.\n",
+				descq->conf.name, wb->pidx, wb->cidx,
+				descq->avail, descq->credit, deferred);
+	}
+	unlock_descq(descq);
+}
+
+/*
+ * rate limit: the tokens are kept in 1/USEC_PER_SEC of a byte/descriptor, so
+ * a refill of rate * elapsed us is exact at any rate and any refill interval.
+ */
+#define RL_SCALE	USEC_PER_SEC
+
+/* the throttle is over, let the request thread have another look */
+static enum hrtimer_restart descq_rl_timer_fn(struct hrtimer *timer)
+{
+	struct qdma_descq *descq = container_of(timer, struct qdma_descq,
+						rl_timer);
+	/* the request threads are never freed while the module is loaded */
+	struct qdma_kthread *thp = READ_ONCE(descq->wrkthp);
+
+	if (thp)
+		qdma_kthread_wakeup(thp);
+	return HRTIMER_NORESTART;
+}
+
+static void descq_rl_refill(struct qdma_descq *descq, u64 now)
+{
+	u64 us;
+
+	if (now - descq->rl_tstamp >= NSEC_PER_SEC) {
+		/* idle a while: the buckets are full by now */
+		us = USEC_PER_SEC;
+		descq->rl_tstamp = now;
+	} else {
+		/* the remainder < 1us is kept for the next refill */
+		us = div_u64(now - descq->rl_tstamp, NSEC_PER_USEC);
+		descq->rl_tstamp += us * NSEC_PER_USEC;
+	}
+
+	if (descq->rate.bytes_ps)
+		descq->rl_tokens = min_t(s64, descq->rl_burst,
+				descq->rl_tokens + descq->rate.bytes_ps * us);
+	if (descq->rate.desc_ps)
+		descq->rl_dtokens = min_t(s64, descq->rl_dburst,
+				descq->rl_dtokens + (u64)descq->rate.desc_ps * us);
+}
+
+/* ns until the bucket is positive again */
+static u64 descq_rl_wait(s64 tokens, u64 rate)
+{
+	if (!rate || tokens > 0)
+		return 0;
+	return (div64_u64(-tokens, rate) + 1) * NSEC_PER_USEC;
+}
+
+/*
+ * request thread, descq lock held: the # of bytes and descriptors the queue
+ * may post now. Once out of tokens the queue is throttled, see
+ * descq_rl_throttled(), and the request thread is woken up when the
+ * buckets are refilled.
+ */
+bool qdma_descq_rl_budget(struct qdma_descq *descq, unsigned int *bytes,
+			unsigned int *descs)
+{
+	u64 now = ktime_to_ns(ktime_get());
+	u64 wait;
+
+	descq_rl_refill(descq, now);
+
+	wait = max(descq_rl_wait(descq->rl_tokens, descq->rate.bytes_ps),
+		   descq_rl_wait(descq->rl_dtokens, descq->rate.desc_ps));
+	if (wait) {
+		descq->rl_next = now + wait;
+		descq->rl_throttle_cnt++;
+		hrtimer_start(&descq->rl_timer, ns_to_ktime(wait),
+				HRTIMER_MODE_REL);
+		return false;
+	}
+
+	/* a part of a byte/descriptor left still allows one */
+	*bytes = descq->rate.bytes_ps ?
+		min_t(u64, div64_u64(descq->rl_tokens, RL_SCALE) + 1,
+			UINT_MAX) : UINT_MAX;
+	*descs = descq->rate.desc_ps ?
+		min_t(u64, div64_u64(descq->rl_dtokens, RL_SCALE) + 1,
+			UINT_MAX) : UINT_MAX;
+	return true;
+}
+
+/* take what was posted, an overshoot is paid back before the next post */
+void qdma_descq_rl_charge(struct qdma_descq *descq, unsigned int bytes,
+			unsigned int descs)
+{
+	if (descq->rate.bytes_ps)
+		descq->rl_tokens -= (s64)bytes * RL_SCALE;
+	if (descq->rate.desc_ps)
+		descq->rl_dtokens -= (s64)descs * RL_SCALE;
+}
+
 void qdma_descq_init(struct qdma_descq *descq, struct xlnx_dma_dev *xdev,
 			int idx_hw, int idx_sw)
 {
@@ -554,11 +865,28 @@ void qdma_descq_init(struct qdma_descq *descq, struct xlnx_dma_dev *xdev,
 	INIT_LIST_HEAD(&descq->work_list);
 	INIT_LIST_HEAD(&descq->pend_list);
 	INIT_LIST_HEAD(&descq->intr_list);
+	INIT_LIST_HEAD(&descq->tmo_list);
 	INIT_WORK(&descq->work, intr_work);
+	INIT_WORK(&descq->err_work, descq_err_work);
+	init_waitqueue_head(&descq->poll_wq);
 	descq->xdev = xdev;
 	descq->channel = 0;
 	descq->qidx_hw = qdev->qbase + idx_hw;
 	descq->conf.qidx = idx_sw;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+	hrtimer_setup(&descq->rl_timer, descq_rl_timer_fn, CLOCK_MONOTONIC,
+			HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&descq->rl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	descq->rl_timer.function = descq_rl_timer_fn;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+	timer_setup(&descq->tmo_timer, descq_tmo_proc, 0);
+#else
+	init_timer(&descq->tmo_timer);
+	descq->tmo_timer.data = (unsigned long)descq;
+	descq->tmo_timer.function = descq_tmo_proc;
+#endif
 }
 
 void qdma_descq_cleanup(struct qdma_descq *descq)
@@ -570,6 +898,7 @@ void qdma_descq_cleanup(struct qdma_descq *descq)
 		descq->online = 0;
 		qdma_descq_context_clear(descq->xdev, descq->qidx_hw,
 					descq->conf.st, descq->conf.c2h, 0);
+		qdma_descq_flush_reqs(descq, -ECANCELED);
 	}
 
 	desc_free_irq(descq);
@@ -577,6 +906,49 @@ void qdma_descq_cleanup(struct qdma_descq *descq)
 	qdma_descq_free_resource(descq);
 
 	unlock_descq(descq);
+
+	/* with no requests left, nothing arms these again */
+	qdma_req_tmo_clear(descq);
+	cancel_work_sync(&descq->err_work);
+}
+
+/* the rings kept over a restart fit the queue config. as it is now? */
+static bool descq_rings_reusable(struct qdma_descq *descq)
+{
+	if (descq->ring_rngsz != descq->conf.rngsz)
+		return false;
+
+	if (!descq->conf.st || !descq->conf.c2h)
+		return true;
+
+	/* the freelist is there unless user space brings its own buffers */
+	return descq->desc_wrb &&
+		descq->ring_rngsz_wrb == descq->conf.rngsz_wrb &&
+		descq->ring_wb_entry_len == descq->wb_entry_len &&
+		descq->ring_c2h_bufsz == descq->conf.c2h_bufsz &&
+		!descq->flq.sdesc == descq->user_owned;
+}
+
+/* reset the kept rings to the state of freshly allocated ones */
+static int descq_rings_reset(struct qdma_descq *descq)
+{
+	/* st c2h: the descriptors hold the rx buffers, rewritten below */
+	if (descq->flq.sdesc)
+		memset(descq->desc_wb, 0, get_desc_wb_size(descq));
+	else
+		memset(descq->desc, 0, descq->ring_rngsz *
+			get_desc_size(descq) + get_desc_wb_size(descq));
+
+	if (!descq->desc_wrb)
+		return 0;
+
+	memset(descq->desc_wrb, 0, descq->ring_rngsz_wrb *
+		descq->ring_wb_entry_len + sizeof(struct qdma_c2h_wrb_wb));
+	descq->color = 1;
+	descq->desc_wrb_cur = descq->desc_wrb;
+	descq->cidx_wrb_pend = 0;
+
+	return descq->flq.sdesc ? descq_flq_reset(descq) : 0;
 }
 
 int qdma_descq_alloc_resource(struct qdma_descq *descq)
@@ -584,7 +956,19 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 	struct xlnx_dma_dev *xdev = descq->xdev;
 	int rv;
 
+	/* kept over a restart */
+	if (descq->desc) {
+		if (descq_rings_reusable(descq) && !descq_rings_reset(descq)) {
+			pr_debug("%s: rings reused, rng %u,%u.\n",
+				descq->conf.name, descq->ring_rngsz,
+				descq->ring_rngsz_wrb);
+			goto alloc_irq;
+		}
+		qdma_descq_free_resource(descq);
+	}
+
 	/* descriptor ring */
+	descq->ring_rngsz = descq->conf.rngsz;
 	descq->desc = desc_ring_alloc(xdev, descq->conf.rngsz,
 				get_desc_size(descq), get_desc_wb_size(descq),
 				&descq->desc_bus, &descq->desc_wb);
@@ -604,6 +988,9 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 		flq->pg_order = flq->pg_shift - PAGE_SHIFT;
 
 		/* writeback ring */
+		descq->ring_rngsz_wrb = descq->conf.rngsz_wrb;
+		descq->ring_wb_entry_len = descq->wb_entry_len;
+		descq->ring_c2h_bufsz = descq->conf.c2h_bufsz;
 		descq->desc_wrb = desc_ring_alloc(xdev,
 						  descq->conf.rngsz_wrb,
 						  descq->wb_entry_len,
@@ -618,10 +1005,12 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 		}
 		descq->desc_wrb_cur = descq->desc_wrb;
 
-		/* freelist / rx buffers */
-		rv = descq_flq_alloc_resource(descq);
-		if (rv < 0)
-			goto err_out;
+		/* freelist / rx buffers, user space brings its own */
+		if (!descq->user_owned) {
+			rv = descq_flq_alloc_resource(descq);
+			if (rv < 0)
+				goto err_out;
+		}
 	}
 
 	pr_debug("%s: %u/%u, rng %u,%u, desc 0x%p, wb 0x%p.\n",
@@ -629,6 +1018,7 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 		descq->conf.rngsz, descq->conf.rngsz_wrb, descq->desc,
 		descq->desc_wrb);
 
+alloc_irq:
 	/* interrupt vectors */
 	desc_alloc_irq(descq);
 
@@ -652,8 +1042,9 @@ void qdma_descq_free_resource(struct qdma_descq *descq)
 		pr_debug("%s: desc 0x%p, wrb 0x%p.\n",
 			descq->conf.name, descq->desc, descq->desc_wrb);
 
-		desc_ring_free(descq->xdev, descq->conf.rngsz, desc_sz, wb_sz,
-				descq->desc, descq->desc_bus);
+		desc_ring_free(descq->xdev, descq->ring_rngsz, desc_sz, wb_sz,
+				descq->desc, descq->desc_bus,
+				!descq->user_owned);
 
 		descq->desc_wb = NULL;
 		descq->desc = NULL;
@@ -662,10 +1053,11 @@ void qdma_descq_free_resource(struct qdma_descq *descq)
 
 	if (descq->desc_wrb) {
 		descq_flq_free_resource(descq);
-		desc_ring_free(descq->xdev, descq->conf.rngsz_wrb,
-			descq->wb_entry_len,
+		desc_ring_free(descq->xdev, descq->ring_rngsz_wrb,
+			descq->ring_wb_entry_len,
 			sizeof(struct qdma_c2h_wrb_wb),
-			descq->desc_wrb, descq->desc_wrb_bus);
+			descq->desc_wrb, descq->desc_wrb_bus,
+			!descq->user_owned);
 
 		descq->desc_wrb_wb = NULL;
 		descq->desc_wrb = NULL;
@@ -680,6 +1072,8 @@ void qdma_descq_config(struct qdma_descq *descq, struct qdma_queue_conf *qconf,
 		int len;
 
 		memcpy(&descq->conf, qconf, sizeof(struct qdma_queue_conf));
+		descq->irq2poll_cnt = 0;
+		descq->poll2irq_cnt = 0;
 		//descq->conf.st = qconf->st;
 		//descq->conf.c2h = qconf->c2h;
 
@@ -716,7 +1110,93 @@ void qdma_descq_config(struct qdma_descq *descq, struct qdma_queue_conf *qconf,
 		descq->conf.pfetch_en = qconf->pfetch_en;
 		descq->conf.cmpl_udd_en = qconf->cmpl_udd_en;
 		descq->conf.cmpl_desc_sz = qconf->cmpl_desc_sz;
+
+		descq->conf.mm_chnl_fixed = qconf->mm_chnl_fixed;
+		descq->conf.mm_channel = qconf->mm_channel;
+		descq->conf.qos_prio = qconf->qos_prio;
+		descq->conf.qos_weight = qconf->qos_weight;
 	}
+
+	if (descq->conf.qos_prio >= QDMA_QOS_PRIO_MAX)
+		descq->conf.qos_prio = QDMA_QOS_PRIO_MAX - 1;
+}
+
+/*
+ * mm channel (engine) assignment at queue start: unless fixed by the queue
+ * config, the channel of the queue's direction with the least load is
+ * picked. The load is the # of queues started on the channel plus its share
+ * of the traffic posted since the last assignment, counted in queues.
+ */
+void qdma_descq_mm_channel_get(struct qdma_descq *descq)
+{
+	struct xlnx_dma_dev *xdev = descq->xdev;
+	struct qdma_mm_chnl_stat *chnl = xdev->mm_chnl[descq->conf.c2h];
+	unsigned int nr = min_t(unsigned int, xdev->mm_channel_max,
+				QDMA_MM_CHANNEL_MAX);
+	u64 recent[QDMA_MM_CHANNEL_MAX];
+	u64 total = 0;
+	u64 load_min = U64_MAX;
+	unsigned int qtotal = 0;
+	unsigned int best = 0;
+	unsigned long flags;
+	int i;
+
+	if (descq->conf.st || descq->mm_chnl_held || !nr)
+		return;
+
+	if (descq->conf.mm_chnl_fixed && descq->conf.mm_channel >= nr)
+		pr_warn("%s, mm channel %u >= %u, auto assigned.\n",
+			descq->conf.name, descq->conf.mm_channel, nr);
+
+	spin_lock_irqsave(&xdev->lock, flags);
+	for (i = 0; i < nr; i++) {
+		u64 bytes = atomic64_read(&chnl[i].bytes);
+
+		recent[i] = bytes - chnl[i].bytes_snap;
+		chnl[i].bytes_snap = bytes;
+		total += recent[i];
+		qtotal += chnl[i].qcnt;
+	}
+
+	if (descq->conf.mm_chnl_fixed && descq->conf.mm_channel < nr) {
+		best = descq->conf.mm_channel;
+	} else {
+		for (i = 0; i < nr; i++) {
+			/* in 1/16 of a queue */
+			u64 load = chnl[i].qcnt * 16ULL;
+
+			if (total)
+				load += div64_u64(recent[i] * 16, total) *
+					max(qtotal, 1U);
+			if (load < load_min) {
+				load_min = load;
+				best = i;
+			}
+		}
+	}
+	chnl[best].qcnt++;
+	spin_unlock_irqrestore(&xdev->lock, flags);
+
+	descq->channel = best;
+	descq->mm_chnl_held = 1;
+
+	pr_debug("%s, mm channel %u%s.\n", descq->conf.name, best,
+		descq->conf.mm_chnl_fixed ? " (fixed)" : "");
+}
+
+void qdma_descq_mm_channel_put(struct qdma_descq *descq)
+{
+	struct xlnx_dma_dev *xdev = descq->xdev;
+	unsigned long flags;
+
+	if (!descq->mm_chnl_held)
+		return;
+
+	spin_lock_irqsave(&xdev->lock, flags);
+	xdev->mm_chnl[descq->conf.c2h][descq->channel].qcnt--;
+	spin_unlock_irqrestore(&xdev->lock, flags);
+
+	descq->mm_chnl_held = 0;
 }
 
 int qdma_descq_config_complete(struct qdma_descq *descq)
@@ -776,29 +1256,105 @@ int qdma_descq_prog_hw(struct qdma_descq *descq)
 	/* update pidx/cidx */
 	if (descq->conf.st && descq->conf.c2h) {
 		descq_wrb_cidx_update(descq, 0);
-		descq_c2h_pidx_update(descq, descq->conf.rngsz - 1);
+		/* user space posts the rx buffers itself */
+		if (!descq->user_owned)
+			descq_c2h_pidx_update(descq, descq->conf.rngsz - 1);
 	}
 
 	return rv;
 }
 
-void qdma_descq_service_wb(struct qdma_descq *descq, int budget)
+/*
+ * adaptive interrupt/poll: a queue that completes intr_poll_th or more
+ * entries in one interrupt is handed to its writeback thread with the
+ * completion interrupt masked. Once a polling pass completes less than
+ * intr_irq_th entries the interrupt is re-armed.
+ * descq lock held.
+ */
+static void descq_intr_adapt(struct qdma_descq *descq, unsigned int done)
+{
+	struct qdma_dev_conf *conf = &descq->xdev->conf;
+	bool st_c2h = descq->conf.st && descq->conf.c2h;
+
+	if (!descq->polling) {
+		if (!conf->intr_poll_th || done < conf->intr_poll_th)
+			return;
+
+		/* the next doorbell write goes out with the interrupt masked */
+		descq->polling = 1;
+		descq->irq2poll_cnt++;
+		pr_debug("%s, %u done, irq -> poll.\n", descq->conf.name, done);
+		qdma_kthread_wakeup(descq->wbthp);
+		return;
+	}
+
+	if (done >= conf->intr_irq_th)
+		return;
+
+	/*
+	 * mm & st h2c only arm the interrupt on the pidx update, wait until
+	 * nothing is outstanding so no completion is left without one.
+	 */
+	if (!st_c2h && descq->pidx != descq->cidx)
+		return;
+
+	descq->polling = 0;
+	descq->poll2irq_cnt++;
+	pr_debug("%s, %u done, poll -> irq.\n", descq->conf.name, done);
+
+	/* st c2h: re-arm, fires right away if entries came in meanwhile */
+	if (st_c2h)
+		descq_wrb_cidx_update(descq, descq->cidx_wrb_pend);
+}
+
+int qdma_descq_service_wb(struct qdma_descq *descq, int budget)
 {
+	unsigned int cidx;
+	int rv;
+
 	lock_descq(descq);
-	if (descq->conf.st && descq->conf.c2h)
-		descq_process_completion_st_c2h(descq, budget);
-	else
-		descq_mm_n_h2c_wb(descq);
+	if (descq->user_owned) {
+		unlock_descq(descq);
+		return 0;
+	}
+
+	if (descq->conf.st && descq->conf.c2h) {
+		cidx = descq->cidx_wrb;
+		rv = descq_process_completion_st_c2h(descq, budget);
+		cidx = ring_idx_delta(descq->cidx_wrb, cidx,
+					descq->conf.rngsz_wrb);
+	} else {
+		cidx = descq->cidx;
+		rv = descq_mm_n_h2c_wb(descq);
+		cidx = ring_idx_delta(descq->cidx, cidx, descq->conf.rngsz);
+	}
+
+	if (descq->xdev->conf.intr_adaptive && descq->conf.irq_en &&
+	    descq->wbthp)
+		descq_intr_adapt(descq, cidx);
 	unlock_descq(descq);
+
+	/* c2h data received or h2c descriptors freed */
+	if (cidx)
+		wake_up_interruptible(&descq->poll_wq);
+
+	return rv;
 }
 
+/*
+ * post descriptors for the request, stops once @budget bytes or @desc_budget
+ * descriptors are posted
+ */
 ssize_t qdma_descq_proc_sgt_request(struct qdma_descq *descq,
-					struct qdma_sgt_req_cb *cb)
+					struct qdma_sgt_req_cb *cb,
+					unsigned int budget,
+					unsigned int desc_budget)
 {
 	if(!descq->conf.st) /* MM H2C/C2H */
-		return descq_mm_proc_request(descq, cb);
+		return descq_mm_proc_request(descq, cb, budget, desc_budget);
 	else if (descq->conf.st && !descq->conf.c2h) /* ST H2C */
-		return descq_proc_st_h2c_request(descq, cb);
+		return descq_proc_st_h2c_request(descq, cb, budget,
+						desc_budget);
 	else	/* ST C2H - should not happen - handled separately */
 		return -1;
 }
@@ -813,14 +1369,24 @@ void qdma_sgt_req_done(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
 			req, cb, req->fp_done, error);
 
 	list_del(&cb->list);
+	req_tmo_del(cb);
 	if (cb->unmap_needed) {
 		sgl_unmap(descq->xdev->conf.pdev, req->sgl, req->sgcnt,
 			descq->conf.c2h ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
 		cb->unmap_needed = 0;
 	}
 
+	if (cb->t_submit) {
+		u32 lat = qdma_req_tstamp() - cb->t_submit;
+
+		descq->lat_cnt++;
+		descq->lat_sum += lat;
+		if (lat > descq->lat_max)
+			descq->lat_max = lat;
+	}
+
 	if (req->fp_done) {
-		if (cb->offset != req->count) {
+		if (!error && cb->offset != req->count) {
 			pr_info("req not completed %u != %u.\n",
 				cb->offset, req->count);
 			error = -EINVAL;
@@ -985,6 +1551,52 @@ int qdma_descq_dump(struct qdma_descq *descq, char *buf, int buflen, int detail)
 	if (cur >= end)
 		goto handle_truncation;
 
+	if (!descq->conf.st) {
+		cur += snprintf(cur, end - cur, "\tmm channel %u%s\n",
+			descq->channel,
+			descq->conf.mm_chnl_fixed ? " (fixed)" : "");
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
+	if (!descq->conf.st || !descq->conf.c2h) {
+		cur += snprintf(cur, end - cur,
+			"\tqos prio %u, weight %u, deficit %d, req %lu, lat avg %llu, max %llu us\n",
+			descq->conf.qos_prio, descq->conf.qos_weight,
+			descq->qos_deficit, descq->lat_cnt,
+			descq->lat_cnt ? div64_u64(descq->lat_sum << 10,
+					descq->lat_cnt * 1000ULL) : 0ULL,
+			div_u64((u64)descq->lat_max << 10, 1000));
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
+	if (descq->tmo_cnt) {
+		cur += snprintf(cur, end - cur, "\treq timed out %lu\n",
+				descq->tmo_cnt);
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
+	if (descq_rl_en(descq)) {
+		cur += snprintf(cur, end - cur,
+			"\trate %llu B/s, %u desc/s, burst %u B, %u desc, throttled %lu\n",
+			descq->rate.bytes_ps, descq->rate.desc_ps,
+			descq->rate.burst_bytes, descq->rate.burst_desc,
+			descq->rl_throttle_cnt);
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
+	if (descq->xdev->conf.intr_adaptive && descq->conf.irq_en) {
+		cur += snprintf(cur, end - cur,
+			"\t%s, irq->poll %lu, poll->irq %lu\n",
+			descq->polling ? "polling" : "irq",
+			descq->irq2poll_cnt, descq->poll2irq_cnt);
+		if (cur >= end)
+			goto handle_truncation;
+	}
+
 	if (descq->conf.st && descq->conf.c2h) {
 		cur += snprintf(cur, end - cur,
 			"\twrb desc 0x%p/0x%llx, %u",
@@ -1069,6 +1681,196 @@ int qdma_queue_avail_desc(unsigned long dev_hndl, unsigned long id)
 	return avail;
 }
 
+int qdma_queue_set_rate(unsigned long dev_hndl, unsigned long id,
+			struct qdma_queue_rate *rate, char *buf, int buflen)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, buf, buflen, 1);
+	struct qdma_kthread *thp;
+	u64 burst;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	if (descq->conf.st && descq->conf.c2h) {
+		pr_info("%s, st c2h, not rate limited.\n", descq->conf.name);
+		if (buf && buflen)
+			snprintf(buf, buflen, "%s, st c2h not supported.\n",
+				descq->conf.name);
+		return -EOPNOTSUPP;
+	}
+
+	lock_descq(descq);
+	descq->rate = *rate;
+	if (descq->rate.bytes_ps && !descq->rate.burst_bytes) {
+		burst = max_t(u64, div_u64(descq->rate.bytes_ps, 100),
+				64 * 1024);
+		descq->rate.burst_bytes = min_t(u64, burst, UINT_MAX);
+	}
+	if (descq->rate.desc_ps && !descq->rate.burst_desc)
+		descq->rate.burst_desc = max(descq->rate.desc_ps / 100, 16U);
+
+	descq->rl_burst = (s64)descq->rate.burst_bytes * RL_SCALE;
+	descq->rl_dburst = (s64)descq->rate.burst_desc * RL_SCALE;
+	descq->rl_tokens = descq->rl_burst;
+	descq->rl_dtokens = descq->rl_dburst;
+	descq->rl_tstamp = ktime_to_ns(ktime_get());
+	descq->rl_next = 0;
+	thp = descq->wrkthp;
+	unlock_descq(descq);
+
+	if (!descq_rl_en(descq))
+		hrtimer_cancel(&descq->rl_timer);
+	/* a throttled queue may go on right away */
+	if (thp)
+		qdma_kthread_wakeup(thp);
+
+	if (buf && buflen)
+		snprintf(buf, buflen,
+			"%s, rate %llu B/s, %u desc/s, burst %u B, %u desc.\n",
+			descq->conf.name, descq->rate.bytes_ps,
+			descq->rate.desc_ps, descq->rate.burst_bytes,
+			descq->rate.burst_desc);
+	return 0;
+}
+
+unsigned int qdma_queue_poll(unsigned long dev_hndl, unsigned long id,
+			struct file *filp, struct poll_table_struct *wait)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, NULL, 0, 1);
+	unsigned int mask = 0;
+
+	if (!descq)
+		return POLLERR;
+
+	poll_wait(filp, &descq->poll_wq, wait);
+
+	lock_descq(descq);
+	if (!descq->online || descq->err || descq->user_owned)
+		mask = POLLERR;
+	else if (descq->conf.st && descq->conf.c2h) {
+		/* received data not claimed by the pending reads yet */
+		if (descq->flq.pkt_dlen)
+			mask = POLLIN | POLLRDNORM;
+	} else if (descq->avail)
+		mask = descq->conf.c2h ? (POLLIN | POLLRDNORM) :
+					(POLLOUT | POLLWRNORM);
+	unlock_descq(descq);
+
+	/* poll mode: the completion thread polls the queue for the waiter */
+	if (!mask && descq->wbthp && !descq_irq_en(descq))
+		qdma_kthread_wakeup(descq->wbthp);
+
+	return mask;
+}
+
+/*
+ * kernel bypass
+ */
+static inline unsigned int descq_pidx_reg(struct qdma_descq *descq)
+{
+	return (descq->conf.c2h ? QDMA_REG_C2H_PIDX_BASE :
+				QDMA_REG_H2C_PIDX_BASE) +
+		descq->conf.qidx * QDMA_REG_PIDX_STEP;
+}
+
+static inline unsigned int descq_wrb_cidx_reg(struct qdma_descq *descq)
+{
+	return QDMA_REG_WRB_CIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP;
+}
+
+void qdma_descq_user_info(struct qdma_descq *descq,
+			struct qdma_queue_user_info *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	info->qidx_hw = descq->qidx_hw;
+	info->st = descq->conf.st;
+	info->rngsz = descq->conf.rngsz;
+	info->desc_sz = get_desc_size(descq);
+	info->ring_len = info->rngsz * info->desc_sz + get_desc_wb_size(descq);
+	info->db_off = descq_pidx_reg(descq) & ~PAGE_MASK;
+
+	if (descq->conf.st && descq->conf.c2h) {
+		info->cmpl_rngsz = descq->conf.rngsz_wrb;
+		info->cmpl_sz = descq->wb_entry_len;
+		info->cmpl_len = info->cmpl_rngsz * info->cmpl_sz +
+				sizeof(struct qdma_c2h_wrb_wb);
+		info->c2h_bufsz = descq->conf.c2h_bufsz;
+		info->cmpl_db_off = descq_wrb_cidx_reg(descq) & ~PAGE_MASK;
+		info->cmpl_db_flags = descq_wrb_cidx_flags(descq);
+	}
+}
+
+/*
+ * dma_mmap_coherent() maps from vm_pgoff into the buffer, the cdev uses the
+ * file offset to pick the region only: map from 0 and restore vm_pgoff.
+ */
+static int descq_mmap_coherent(struct device *dev, struct vm_area_struct *vma,
+			void *cpu_addr, dma_addr_t dma_addr, size_t size)
+{
+	unsigned long pgoff = vma->vm_pgoff;
+	int rv;
+
+	vma->vm_pgoff = 0;
+	rv = dma_mmap_coherent(dev, vma, cpu_addr, dma_addr, size);
+	vma->vm_pgoff = pgoff;
+	return rv;
+}
+
+int qdma_queue_user_mmap(unsigned long dev_hndl, unsigned long id,
+			enum qdma_queue_user_region region,
+			struct vm_area_struct *vma)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, NULL, 0, 1);
+	struct pci_dev *pdev;
+	struct qdma_queue_user_info info;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	resource_size_t bar;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	/* the rings stay until qdma_queue_user_stop() */
+	if (!descq->user_owned || !descq->online)
+		return -EINVAL;
+
+	pdev = descq->xdev->conf.pdev;
+	qdma_descq_user_info(descq, &info);
+	/* the file stays open while it or any of its mappings is around */
+	descq->user_mapping = vma->vm_file->f_mapping;
+
+	switch (region) {
+	case QDMA_QUEUE_USER_RING:
+		if (len > PAGE_ALIGN(info.ring_len))
+			return -EINVAL;
+		return descq_mmap_coherent(&pdev->dev, vma, descq->desc,
+					descq->desc_bus, info.ring_len);
+	case QDMA_QUEUE_USER_CMPL:
+		if (!info.cmpl_len || len > PAGE_ALIGN(info.cmpl_len))
+			return -EINVAL;
+		return descq_mmap_coherent(&pdev->dev, vma, descq->desc_wrb,
+					descq->desc_wrb_bus, info.cmpl_len);
+	case QDMA_QUEUE_USER_DB:
+		/* the queue's pidx/cidx registers share one page */
+		if (len != PAGE_SIZE)
+			return -EINVAL;
+		bar = pci_resource_start(pdev, descq->xdev->conf.bar_num_config);
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+		return io_remap_pfn_range(vma, vma->vm_start,
+				(bar + (descq_pidx_reg(descq) & PAGE_MASK)) >>
+					PAGE_SHIFT,
+				PAGE_SIZE, vma->vm_page_prot);
+	default:
+		return -EINVAL;
+	}
+}
+
 #ifdef ERR_DEBUG
 int qdma_queue_set_err_indcution(unsigned long dev_hndl, unsigned long id,
                                  u64 err_sel, u64 err_mask, char *buf,
@@ -1111,6 +1913,9 @@ int qdma_queue_packet_write(unsigned long dev_hndl, unsigned long id,
 		return -EINVAL;
 	}
 
+	if (descq->user_owned)
+		return -EBUSY;
+
 	memset(cb, 0, QDMA_REQ_OPAQUE_SIZE);
 	init_waitqueue_head(&cb->wq);
 
@@ -1134,7 +1939,9 @@ int qdma_queue_packet_write(unsigned long dev_hndl, unsigned long id,
 		goto unmap_sgl;
 	}
 
+	cb->t_submit = qdma_req_tstamp();
 	list_add_tail(&cb->list, &descq->work_list);
+	qdma_req_tmo_add(descq, cb);
 	unlock_descq(descq);
 
 	pr_debug("%s: cb 0x%p submitted.\n", descq->conf.name, cb);
@@ -15,10 +15,15 @@
 
 #include <linux/spinlock_types.h>
 #include <linux/types.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
 
 #include "qdma_compat.h"
 #include "libqdma_export.h"
 #include "qdma_regs.h"
+#include "qdma_mbox.h"
 #ifdef ERR_DEBUG
 #include "qdma_nl.h"
 #endif
@@ -74,13 +79,29 @@ struct qdma_descq {
 	u8 inited:1;	/* resource/context initialized */
 	u8 online:1;	/* online */
 	u8 color:1;	/* st c2h only */
+	u8 polling:1;	/* intr_adaptive: completion interrupt masked, the
+			   writeback thread polls the queue */
+	u8 user_owned:1; /* kernel bypass: rings and doorbells are driven
+			    from user space, see qdma_queue_user_start() */
+	u8 mm_chnl_held:1; /* counted in xdev->mm_chnl[][channel] */
 
 	unsigned int qidx_hw;
 
+	/*
+	 * shadow of the contexts programmed (hw[] and cr[] are not), served
+	 * by qdma_queue_dump() instead of reading them back from the hw
+	 */
+	struct hw_descq_context ctxt;
+	u8 ctxt_valid;
+
 	struct work_struct work;
 	struct list_head intr_list;
 	int intr_id;
 
+	/* intr_adaptive: # of switches between interrupt and polling */
+	unsigned long irq2poll_cnt;
+	unsigned long poll2irq_cnt;
+
 	struct qdma_kthread *wrkthp;
 	struct list_head wrkthp_list;
 	struct list_head work_list;
@@ -89,6 +110,39 @@ struct qdma_descq {
 	struct list_head wbthp_list;
 	struct list_head pend_list;
 
+	/* poll()/epoll waiters, woken up by the completion processing */
+	wait_queue_head_t poll_wq;
+
+	/* qos: bytes the queue may still post, request latency in 1024ns */
+	int qos_deficit;
+	unsigned long lat_cnt;
+	u64 lat_sum;
+	u32 lat_max;
+
+	/*
+	 * rate limit: token buckets, in 1/USEC_PER_SEC of a byte/descriptor,
+	 * see qdma_queue_set_rate()
+	 */
+	struct qdma_queue_rate rate;
+	s64 rl_tokens;
+	s64 rl_dtokens;
+	s64 rl_burst;
+	s64 rl_dburst;
+	u64 rl_tstamp;		/* ns, last refill */
+	u64 rl_next;		/* ns, throttled until */
+	unsigned long rl_throttle_cnt;
+	struct hrtimer rl_timer;
+
+	/*
+	 * request timeouts: the requests with a timeout_ms, in deadline
+	 * order, one timer for the earliest.
+	 */
+	struct list_head tmo_list;
+	struct timer_list tmo_timer;
+	unsigned long tmo_cnt;
+	/* takes a stuck queue off the hw, see qdma_descq_set_err() */
+	struct work_struct err_work;
+
 	unsigned int avail;
 	unsigned int pidx;
 	unsigned int cidx;
@@ -98,6 +152,22 @@ struct qdma_descq {
 
 	u8 *desc_wb;
 
+	/*
+	 * the sizes the rings were allocated with, conf.* may change while
+	 * the queue is stopped. The rings of a restarted queue are reused if
+	 * these still match, see qdma_queue_restart().
+	 */
+	unsigned int ring_rngsz;
+	unsigned int ring_rngsz_wrb;
+	unsigned int ring_c2h_bufsz;
+	unsigned char ring_wb_entry_len;
+
+	/*
+	 * kernel bypass: the user mappings of the rings and the doorbells,
+	 * zapped by qdma_queue_user_stop()
+	 */
+	struct address_space *user_mapping;
+
 	/* ST C2H */
 	unsigned char fl_pg_order;
 	unsigned char wb_entry_len;
@@ -138,6 +208,25 @@ struct qdma_descq {
 #define unlock_descq(descq)	spin_unlock_bh(&(descq)->lock)
 #endif
 
+/* completion interrupt armed by the pidx/cidx doorbell writes? */
+static inline unsigned int descq_irq_en(struct qdma_descq *descq)
+{
+	return descq->conf.irq_en && !descq->polling && !descq->user_owned;
+}
+
+/* rate limited? */
+static inline bool descq_rl_en(struct qdma_descq *descq)
+{
+	return descq->rate.bytes_ps || descq->rate.desc_ps;
+}
+
+/* out of tokens, until the rate limit timer fires */
+static inline bool descq_rl_throttled(struct qdma_descq *descq)
+{
+	return descq_rl_en(descq) && descq->rl_next &&
+		ktime_to_ns(ktime_get()) < descq->rl_next;
+}
+
 static inline unsigned int ring_idx_delta(unsigned int new, unsigned int old,
 					unsigned int rngsz)
 {
@@ -171,15 +260,19 @@ int qdma_descq_config_complete(struct qdma_descq *descq);
 
 void qdma_descq_cleanup(struct qdma_descq *descq);
 
+/* reuses the rings kept over a restart if their sizes did not change */
 int qdma_descq_alloc_resource(struct qdma_descq *descq);
 
 void qdma_descq_free_resource(struct qdma_descq *descq);
 
 int qdma_descq_prog_hw(struct qdma_descq *descq);
 
+void qdma_descq_mm_channel_get(struct qdma_descq *descq);
+void qdma_descq_mm_channel_put(struct qdma_descq *descq);
+
 int qdma_descq_context_cleanup(struct qdma_descq *descq);
 
-void qdma_descq_service_wb(struct qdma_descq *descq, int budget);
+int qdma_descq_service_wb(struct qdma_descq *descq, int budget);
 
 int qdma_descq_rxq_read(struct qdma_descq *descq, struct qdma_request *req);
 
@@ -193,7 +286,10 @@ int qdma_descq_dump_wrb(struct qdma_descq *descq, int start, int end, char *buf,
 
 int qdma_descq_dump_state(struct qdma_descq *descq, char *buf, int buflen);
 
-void intr_cidx_update(struct qdma_descq *descq, unsigned int sw_cidx);
+void intr_cidx_update(struct xlnx_dma_dev *xdev, unsigned int ring_index,
+			unsigned int sw_cidx);
+void qdma_descq_user_info(struct qdma_descq *descq,
+			struct qdma_queue_user_info *info);
 /*
  * qdma_sgt_req_cb fits in qdma_request.opaque
  */
@@ -206,16 +302,41 @@ struct qdma_sgt_req_cb {
 	unsigned int sg_offset;
 	unsigned int sg_idx;
 	int status;
+	u32 t_submit;		/* in 1024ns, for the latency stats */
 	u8 done;
 	u8 unmap_needed:1;
+	u8 aborted:1;		/* completes with status, see
+				   qdma_sgt_req_defer() */
+	struct list_head tmo_list;	/* descq->tmo_list */
+	unsigned long deadline;		/* in jiffies */
 };
 #define qdma_req_cb_get(req)	(struct qdma_sgt_req_cb *)((req)->opaque)
 
 ssize_t qdma_descq_proc_sgt_request(struct qdma_descq *descq,
-		struct qdma_sgt_req_cb *cb);
+		struct qdma_sgt_req_cb *cb, unsigned int budget,
+		unsigned int desc_budget);
+
+bool qdma_descq_rl_budget(struct qdma_descq *descq, unsigned int *bytes,
+			unsigned int *descs);
+void qdma_descq_rl_charge(struct qdma_descq *descq, unsigned int bytes,
+			unsigned int descs);
+
+/* a timestamp for the request latency stats, in 1024ns */
+static inline u32 qdma_req_tstamp(void)
+{
+	return (u32)(ktime_to_ns(ktime_get()) >> 10);
+}
 
 void qdma_sgt_req_done(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
 			int error);
+void qdma_sgt_req_abandon(struct qdma_descq *descq,
+			struct qdma_sgt_req_cb *cb);
+bool qdma_sgt_req_defer(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
+			int error);
+void qdma_req_tmo_add(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb);
+void qdma_req_tmo_clear(struct qdma_descq *descq);
+void qdma_descq_set_err(struct qdma_descq *descq);
+void qdma_descq_flush_reqs(struct qdma_descq *descq, int error);
 
 int sgl_map(struct pci_dev *pdev, struct qdma_sw_sg *sg, unsigned int sgcnt,
 		enum dma_data_direction dir);
@@ -224,6 +345,7 @@ void sgl_unmap(struct pci_dev *pdev, struct qdma_sw_sg *sg, unsigned int sgcnt,
 
 void descq_flq_free_resource(struct qdma_descq *descq);
 int descq_flq_alloc_resource(struct qdma_descq *descq);
+int descq_flq_reset(struct qdma_descq *descq);
 int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget);
 int descq_st_c2h_read(struct qdma_descq *descq, struct qdma_request *req,
 			bool update, bool refill);
@@ -240,18 +362,18 @@ static inline void descq_h2c_pidx_update(struct qdma_descq *descq,
 		__write_reg(descq->xdev,
 			QDMA_REG_H2C_PIDX_BASE +
 			descq->xdev->conf.qsets_max * QDMA_REG_PIDX_STEP,
-			pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT));
+			pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT));
 		pr_info("Inducing err %d", qid_range);
 	} else
 #endif
 	{
 	pr_debug("%s: pidx %u -> 0x%x, reg 0x%x.\n", descq->conf.name, pidx,
-		pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT),
+		pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT),
 		QDMA_REG_H2C_PIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP);
 
 	__write_reg(descq->xdev,
 		QDMA_REG_H2C_PIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP,
-		pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT));
+		pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT));
 	}
 	dma_wmb();
 }
@@ -264,22 +386,31 @@ static inline void descq_c2h_pidx_update(struct qdma_descq *descq,
 		__write_reg(descq->xdev,
 			QDMA_REG_C2H_PIDX_BASE +
 			descq->xdev->conf.qsets_max * QDMA_REG_PIDX_STEP,
-			pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT));
+			pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT));
 		pr_info("Inducing err %d", qid_range);
 	} else
 #endif
 	{
 	pr_debug("%s: pidx 0x%x -> 0x%x, reg 0x%x.\n", descq->conf.name, pidx,
-		pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT),
+		pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT),
 		QDMA_REG_C2H_PIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP);
 
 	__write_reg(descq->xdev,
 		QDMA_REG_C2H_PIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP,
-		pidx | (descq->conf.irq_en << S_WRB_PIDX_UPD_EN_INT));
+		pidx | (descq_irq_en(descq) << S_WRB_PIDX_UPD_EN_INT));
 	}
 	dma_wmb();
 }
 
+/* wrb cidx doorbell bits other than the cidx and the interrupt enable */
+static inline unsigned int descq_wrb_cidx_flags(struct qdma_descq *descq)
+{
+	return (descq->conf.cmpl_stat_en << S_WRB_CIDX_UPD_EN_STAT_DESC) |
+		(V_WRB_CIDX_UPD_TRIG_MODE(descq->conf.cmpl_trig_mode)) |
+		(V_WRB_CIDX_UPD_TIMER_IDX(descq->conf.cmpl_timer_idx)) |
+		(V_WRB_CIDX_UPD_TIMER_IDX(descq->conf.cmpl_cnt_th_idx));
+}
+
 static inline void descq_wrb_cidx_update(struct qdma_descq *descq,
 					unsigned int cidx)
 {
@@ -293,11 +424,8 @@ static inline void descq_wrb_cidx_update(struct qdma_descq *descq,
 	pr_debug("%s: cidx update 0x%x, reg 0x%x.\n", descq->conf.name, cidx,
 		QDMA_REG_WRB_CIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP);
 
-	cidx |= (descq->conf.irq_en << S_WRB_CIDX_UPD_EN_INT) |
-		(descq->conf.cmpl_stat_en << S_WRB_CIDX_UPD_EN_STAT_DESC) |
-		(V_WRB_CIDX_UPD_TRIG_MODE(descq->conf.cmpl_trig_mode)) |
-		(V_WRB_CIDX_UPD_TIMER_IDX(descq->conf.cmpl_timer_idx)) |
-		(V_WRB_CIDX_UPD_TIMER_IDX(descq->conf.cmpl_cnt_th_idx));
+	cidx |= (descq_irq_en(descq) << S_WRB_CIDX_UPD_EN_INT) |
+		descq_wrb_cidx_flags(descq);
 
 	pr_debug("%s: cidx update 0x%x, reg 0x%x.\n", descq->conf.name, cidx,
 		QDMA_REG_WRB_CIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP);
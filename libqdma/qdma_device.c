@@ -267,14 +267,27 @@ void qdma_device_cleanup(struct xlnx_dma_dev *xdev)
 	}
 #endif
 
+	/*
+	 * a queue still driven from user space is taken away from its owner,
+	 * its user mappings are torn down before the rings are freed.
+	 */
 	for (i = 0, descq = qdev->h2c_descq; i < qdev->qmax; i++, descq++) {
-		if (descq->enabled) {
+		if (descq->user_owned) {
+			pr_warn("%s still owned by user space.\n",
+				descq->conf.name);
+			qdma_queue_user_stop((unsigned long int)xdev, i);
+		} else if (descq->enabled) {
 			qdma_queue_stop((unsigned long int)xdev, i, NULL, 0);
 		}
 	}
 
 	for (i = 0, descq = qdev->c2h_descq; i < qdev->qmax; i++, descq++) {
-		if (descq->enabled) {
+		if (descq->user_owned) {
+			pr_warn("%s still owned by user space.\n",
+				descq->conf.name);
+			qdma_queue_user_stop((unsigned long int)xdev,
+					i + qdev->qmax);
+		} else if (descq->enabled) {
 			qdma_queue_stop((unsigned long int)xdev,
 					i + qdev->qmax, NULL, 0);
 		}
@@ -15,6 +15,7 @@
 #include "qdma_intr.h"
 
 #include <linux/kernel.h>
+#include <linux/rculist.h>
 #include "qdma_descq.h"
 #include "qdma_device.h"
 #include "qdma_regs.h"
@@ -205,10 +206,13 @@ static irqreturn_t error_intr_handler(int irq_index, int irq, void *dev_id)
 
 static void data_intr_aggregate(struct xlnx_dma_dev *xdev, int vidx, int irq)
 {
-	struct qdma_descq *descq = NULL;
-	u32 counter = 0;
+	struct qdma_dev *qdev = xdev_2_qdev(xdev);
 	struct intr_coal_conf *coal_entry = (xdev->intr_coal_list + vidx - xdev->dvec_start_idx);
 	struct qdma_intr_ring *ring_entry;
+	unsigned int cidx_start;
+	u8 color_start;
+	unsigned int qidx_sw;
+	u8 err = 0;
 
 	if(!coal_entry) {
 		pr_err("Failed to locate the coalescing entry for vector = %d\n", vidx);
@@ -229,49 +233,75 @@ static void data_intr_aggregate(struct xlnx_dma_dev *xdev, int vidx, int irq)
 		return;
 	}
 
-	counter = coal_entry->cidx;
-	ring_entry = (coal_entry->intr_ring_base + counter);
-	if(!ring_entry) {
-		pr_err("Failed to locate the ring entry for vector = %d\n", vidx);
-		return;
-	}
+	/*
+	 * drain the ring first: a queue may show up many times in one burst,
+	 * only mark it in the vector's bitmap, it is serviced once afterwards
+	 * by data_intr_aggregate_service().
+	 * bit index: h2c 0 ~ qmax - 1, c2h qmax ~ 2 * qmax - 1, i.e., the
+	 * offset into qdev->h2c_descq.
+	 */
+	cidx_start = coal_entry->cidx;
+	color_start = coal_entry->color;
+	ring_entry = coal_entry->intr_ring_base + coal_entry->cidx;
 	while(ring_entry->coal_color == coal_entry->color) {
 		pr_debug("IRQ[%d]: IVE[%d], Qid = %d, e_color = %d, c_color = %d, intr_type = %d, error_int =%d\n",
 			irq, vidx, ring_entry->qid, coal_entry->color,
 			ring_entry->coal_color, ring_entry->intr_type,
 			ring_entry->error_int);
 
-		descq = qdma_device_get_descq_by_hw_qid(xdev, ring_entry->qid,
-							ring_entry->intr_type);
-		if (!descq) {
-			pr_err("IRQ[%d]: IVE[%d], Qid = %d error_int = %d: desc not found\n",
-				irq, vidx, ring_entry->qid,
-				ring_entry->error_int);
-			return;
-		}
-
-		if(ring_entry->error_int) {
+		qidx_sw = ring_entry->qid - qdev->qbase;
+		if (ring_entry->error_int) {
 			pr_err("IRQ[%d]: IVE[%d], Qid = %d error_int = %d: interrupt raised due to error\n",
 				irq, vidx, ring_entry->qid,
 				ring_entry->error_int);
-			err_stat_handler(xdev);
+			err = 1;
+		} else if (ring_entry->qid < qdev->qbase ||
+			   qidx_sw >= qdev->qmax) {
+			pr_err("IRQ[%d]: IVE[%d], Qid = %d: desc not found\n",
+				irq, vidx, ring_entry->qid);
 		} else {
-			schedule_work(&descq->work);
+			if (ring_entry->intr_type)
+				qidx_sw += qdev->qmax;
+			set_bit(qidx_sw, coal_entry->qbitmap);
 		}
 
+		/* the color flips each time this vector's ring wraps around */
 		if(++coal_entry->cidx == coal_entry->intr_rng_num_entries) {
-			counter = 0;
-			xdev->intr_coal_list->color = (xdev->intr_coal_list->color)? 0: 1;
 			coal_entry->cidx = 0;
+			coal_entry->color = coal_entry->color ? 0 : 1;
 		}
-		else
-			counter++;
 
-		ring_entry = (coal_entry->intr_ring_base + counter);
+		ring_entry = coal_entry->intr_ring_base + coal_entry->cidx;
 	}
 
-	if(descq)
-		intr_cidx_update(descq, coal_entry->cidx);
+	if (err)
+		err_stat_handler(xdev);
+
+	/*
+	 * one ring cidx update for the whole burst, also when it only had
+	 * error or unknown entries. A burst of a whole ring ends where it
+	 * started, with the color flipped.
+	 */
+	if (coal_entry->cidx != cidx_start || coal_entry->color != color_start)
+		intr_cidx_update(xdev, coal_entry->ring_index,
+				coal_entry->cidx);
+}
+
+static void data_intr_aggregate_service(struct xlnx_dma_dev *xdev, int vidx)
+{
+	struct qdma_dev *qdev = xdev_2_qdev(xdev);
+	struct intr_coal_conf *coal_entry = (xdev->intr_coal_list + vidx - xdev->dvec_start_idx);
+	struct qdma_descq *descq;
+	unsigned int i;
+
+	for_each_set_bit(i, coal_entry->qbitmap, qdev->qmax * 2) {
+		clear_bit(i, coal_entry->qbitmap);
+		descq = qdev->h2c_descq + i;
+
+		if (!xdev->conf.intr_inline ||
+		    qdma_descq_service_wb(descq, xdev->conf.intr_budget) > 0)
+			schedule_work(&descq->work);
+	}
 }
 
 static void data_intr_direct(struct xlnx_dma_dev *xdev, int vidx, int irq)
@@ -282,6 +312,28 @@ static void data_intr_direct(struct xlnx_dma_dev *xdev, int vidx, int irq)
 		schedule_work(&descq->work);
 }
 
+/*
+ * service the queues directly in the threaded irq, this saves the hop through
+ * the system workqueue (which may run on another cpu). A queue with more than
+ * conf.intr_budget completions pending is handed over to intr_work() for the
+ * rest, so one busy queue cannot starve the others on the same vector.
+ *
+ * intr_list is walked under rcu here: the irq thread cannot take xdev->lock
+ * with irqs disabled and then lock_descq() (bh). qdma_queue_stop() waits on
+ * synchronize_irq() after unlinking the queue.
+ */
+static void data_intr_inline(struct xlnx_dma_dev *xdev, int vidx, int irq)
+{
+	struct qdma_descq *descq;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(descq, &xdev->intr_list[vidx], intr_list) {
+		if (qdma_descq_service_wb(descq, xdev->conf.intr_budget) > 0)
+			schedule_work(&descq->work);
+	}
+	rcu_read_unlock();
+}
+
 static irqreturn_t data_intr_handler(int vector_index, int irq, void *dev_id)
 {
 	struct xlnx_dma_dev *xdev = dev_id;
@@ -290,12 +342,19 @@ static irqreturn_t data_intr_handler(int vector_index, int irq, void *dev_id)
 	pr_debug("Data IRQ fired on PF#%d: index=%d, vector=%d\n",
 		xdev->func_id, vector_index, irq);
 
-	spin_lock_irqsave(&xdev->lock, flags);
-	if (xdev->intr_coal_en)
+	if (xdev->intr_coal_en) {
+		spin_lock_irqsave(&xdev->lock, flags);
 		data_intr_aggregate(xdev, vector_index, irq);
-	else
+		spin_unlock_irqrestore(&xdev->lock, flags);
+		/* the bitmap is only touched by this vector's irq thread */
+		data_intr_aggregate_service(xdev, vector_index);
+	} else if (xdev->conf.intr_inline) {
+		data_intr_inline(xdev, vector_index, irq);
+	} else {
+		spin_lock_irqsave(&xdev->lock, flags);
 		data_intr_direct(xdev, vector_index, irq);
-	spin_unlock_irqrestore(&xdev->lock, flags);
+		spin_unlock_irqrestore(&xdev->lock, flags);
+	}
 
 	return IRQ_HANDLED;
 }
@@ -351,6 +410,7 @@ void intr_ring_teardown(struct xlnx_dma_dev *xdev)
 						sizeof(struct qdma_intr_ring),
 						(u8 *)ring_entry->intr_ring_base,
 						ring_entry->intr_ring_bus);
+			kfree(ring_entry->qbitmap);
 #ifndef __QDMA_VF__
 			pr_debug("Clearing intr_ctxt for ring_index =%d\n", ring_index);
 			/* clear interrupt context (0x8) */
@@ -402,15 +462,91 @@ static irqreturn_t irq_top(int irq, void *dev_id)
 }
 
 
+/*
+ * per-vector book-keeping, sized to the # of vectors actually enabled
+ */
+static void intr_vec_free(struct xlnx_dma_dev *xdev)
+{
+	kfree(xdev->msix);
+	kfree(xdev->intr_list);
+	kfree(xdev->intr_list_cnt);
+	kfree(xdev->intr_vec_map);
+
+	xdev->msix = NULL;
+	xdev->intr_list = NULL;
+	xdev->intr_list_cnt = NULL;
+	xdev->intr_vec_map = NULL;
+	xdev->num_vecs = 0;
+}
+
+static int intr_vec_alloc(struct xlnx_dma_dev *xdev)
+{
+	int n = xdev->num_vecs;
+
+	xdev->msix = kcalloc(n, sizeof(struct msix_entry), GFP_KERNEL);
+	xdev->intr_list = kcalloc(n, sizeof(struct list_head), GFP_KERNEL);
+	xdev->intr_list_cnt = kcalloc(n, sizeof(int), GFP_KERNEL);
+	xdev->intr_vec_map = kcalloc(n, sizeof(struct intr_vec_map_type),
+				GFP_KERNEL);
+	if (!xdev->msix || !xdev->intr_list || !xdev->intr_list_cnt ||
+	    !xdev->intr_vec_map) {
+		pr_err("%s, %d vectors OOM.\n", xdev->conf.name, n);
+		intr_vec_free(xdev);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * spread the data vectors over the cpus local to the device. The queues on a
+ * vector get their request thread on the same cpu (qdma_thread_add_work()),
+ * the irq thread follows the hard irq affinity, so submission and completion
+ * of a queue stay on one cpu.
+ */
+static void intr_set_affinity(struct xlnx_dma_dev *xdev)
+{
+	int i, cpu;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0)
+	int node = dev_to_node(&xdev->conf.pdev->dev);
+#endif
+
+	for (i = 0; i < xdev->num_vecs; i++) {
+		xdev->intr_vec_map[i].cpu = -1;
+		if (xdev->intr_vec_map[i].intr_type != INTR_TYPE_DATA)
+			continue;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0)
+		cpu = cpumask_local_spread(i - xdev->dvec_start_idx, node);
+#else
+		cpu = (i - xdev->dvec_start_idx) % num_online_cpus();
+#endif
+		if (irq_set_affinity_hint(xdev->msix[i].vector,
+					cpumask_of(cpu)) < 0) {
+			pr_info("%s vector %d, cpu %d affinity hint failed.\n",
+				xdev->conf.name, xdev->msix[i].vector, cpu);
+			continue;
+		}
+		xdev->intr_vec_map[i].cpu = cpu;
+
+		pr_debug("%s vector %d -> cpu %d.\n",
+			xdev->conf.name, xdev->msix[i].vector, cpu);
+	}
+}
+
 void intr_teardown(struct xlnx_dma_dev *xdev)
 {
 	int i = xdev->num_vecs;
 
-	while (--i >= 0)
+	while (--i >= 0) {
+		irq_set_affinity_hint(xdev->msix[i].vector, NULL);
 		free_irq(xdev->msix[i].vector, xdev);
+	}
 
 	if (xdev->num_vecs)
 		pci_disable_msix(xdev->conf.pdev);
+
+	intr_vec_free(xdev);
 }
 
 int intr_setup(struct xlnx_dma_dev *xdev)
@@ -423,16 +559,40 @@ int intr_setup(struct xlnx_dma_dev *xdev)
 		return 0;
 	}
 
+	if(xdev->func_id == 0)
+		xdev->dvec_start_idx = 2;
+	else
+		xdev->dvec_start_idx = 1;
+
 	xdev->num_vecs = pci_msix_vec_count(xdev->conf.pdev);
 
-	if (!xdev->num_vecs) {
+	if (xdev->num_vecs <= 0) {
 		pr_info("MSI-X not supported, running in polled mode\n");
+		xdev->num_vecs = 0;
+		return 0;
+	}
+
+	if (xdev->num_vecs <= xdev->dvec_start_idx) {
+		pr_info("%s, %d MSI-X vectors, none left for data, running in polled mode\n",
+			xdev->conf.name, xdev->num_vecs);
+		xdev->num_vecs = 0;
 		return 0;
 	}
 
+	/* use all the vectors the function advertises, unless capped */
+	if (xdev->conf.msix_qvec_max &&
+	    xdev->num_vecs > xdev->dvec_start_idx + xdev->conf.msix_qvec_max)
+		xdev->num_vecs = xdev->dvec_start_idx + xdev->conf.msix_qvec_max;
+
 	if (xdev->num_vecs > XDEV_NUM_IRQ_MAX)
 		xdev->num_vecs = XDEV_NUM_IRQ_MAX;
 
+	xdev->conf.msix_qvec_max = xdev->num_vecs - xdev->dvec_start_idx;
+
+	rv = intr_vec_alloc(xdev);
+	if (rv < 0)
+		goto exit;
+
 	for (i = 0; i < xdev->num_vecs; i++) {
 		xdev->msix[i].entry = i;
 		INIT_LIST_HEAD(&xdev->intr_list[i]);
@@ -498,10 +658,7 @@ int intr_setup(struct xlnx_dma_dev *xdev)
 		}
 	}
 
-	if(xdev->func_id == 0)
-		xdev->dvec_start_idx = 2;
-	else
-		xdev->dvec_start_idx = 1;
+	intr_set_affinity(xdev);
 
 	xdev->flags |= XDEV_FLAG_IRQ;
 	return rv;
@@ -513,12 +670,13 @@ cleanup_irq:
 	pci_disable_msix(xdev->conf.pdev);
 
 exit:
+	intr_vec_free(xdev);
 	return rv;
 }
 
 int intr_ring_setup(struct xlnx_dma_dev *xdev)
 {
-
+	struct qdma_dev *qdev = xdev_2_qdev(xdev);
 	int num_entries = 0;
 	int counter = 0;
 	struct intr_coal_conf  *intr_coal_list;
@@ -573,8 +731,24 @@ int intr_ring_setup(struct xlnx_dma_dev *xdev)
 				goto err_out;
 			}
 
+			intr_coal_list_entry->qbitmap = kzalloc(
+					BITS_TO_LONGS(qdev->qmax * 2) *
+					sizeof(unsigned long), GFP_KERNEL);
+			if (!intr_coal_list_entry->qbitmap) {
+				pr_err("dev %s, qmax %u, intr qbitmap OOM.\n",
+					xdev->conf.name, qdev->qmax);
+				intr_ring_free(xdev,
+					intr_coal_list_entry->intr_rng_num_entries,
+					sizeof(struct qdma_intr_ring),
+					(u8 *)intr_coal_list_entry->intr_ring_base,
+					intr_coal_list_entry->intr_ring_bus);
+				goto err_out;
+			}
+
 			intr_coal_list_entry->vec_id =
 					xdev->msix[counter + xdev->dvec_start_idx].entry;
+			intr_coal_list_entry->ring_index = get_intr_ring_index(
+					xdev, counter + xdev->dvec_start_idx);
 			intr_coal_list_entry->pidx = 0;
 			intr_coal_list_entry->cidx = 0;
 			intr_coal_list_entry->color = 1;
@@ -604,6 +778,7 @@ err_out:
 				sizeof(struct qdma_intr_ring),
 				(u8 *)intr_coal_list_entry->intr_ring_base,
 				intr_coal_list_entry->intr_ring_bus);
+		kfree(intr_coal_list_entry->qbitmap);
 	}
 	kfree(intr_coal_list);
 	return -ENOMEM;
@@ -636,7 +811,7 @@ void qdma_queue_service(unsigned long dev_hndl, unsigned long id, int budget)
 
 static u8 get_intr_vec_index(struct xlnx_dma_dev *xdev, u8 intr_type)
 {
-	u8 i = 0;
+	int i;
 
 	for (i = 0; i < xdev->num_vecs; i++) {
 		if(xdev->intr_vec_map[i].intr_type == intr_type)
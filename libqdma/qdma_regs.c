@@ -291,6 +291,11 @@ int qdma_device_flr_quirk_set(struct pci_dev *pdev, unsigned long dev_hndl)
 	if (!dev_hndl || xdev_check_hndl(__func__, pdev, dev_hndl) < 0)
 		return -EINVAL;
 
+	/* the reset clears the indirect context masks too */
+	spin_lock(&xdev->hw_prg_lock);
+	xdev->ind_ctxt_mask_set = 0;
+	spin_unlock(&xdev->hw_prg_lock);
+
 	__write_reg(xdev, QDMA_REG_FLR_STATUS, 0x1);
 	return 0;
 }
@@ -448,40 +453,80 @@ void hw_set_fmap(struct xlnx_dma_dev *xdev, u8 func_id, unsigned int qbase,
 #endif
 }
 
-int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
-				enum ind_ctxt_cmd_op op,
-				enum ind_ctxt_cmd_sel sel, u32 *data,
-				unsigned int cnt, bool verify)
+/*
+ * an indirect context command completes within a few register reads: spin on
+ * the busy bit first, then back off with growing delays up to 500ms in total.
+ */
+#define IND_CTXT_SPIN_CNT	32
+#define IND_CTXT_DELAY_MAX_US	100
+#define IND_CTXT_TIMEOUT_US	(500 * 1000)
+
+static int hw_ind_ctxt_wait(struct xlnx_dma_dev *xdev)
+{
+	unsigned int delay = 1;
+	unsigned int waited = 0;
+	int i;
+
+	for (i = 0; i < IND_CTXT_SPIN_CNT; i++) {
+		if (!(__read_reg(xdev, QDMA_REG_IND_CTXT_CMD) &
+				IND_CTXT_CMD_BUSY_MASK))
+			return 0;
+		cpu_relax();
+	}
+
+	while (waited < IND_CTXT_TIMEOUT_US) {
+		udelay(delay);
+		waited += delay;
+		if (!(__read_reg(xdev, QDMA_REG_IND_CTXT_CMD) &
+				IND_CTXT_CMD_BUSY_MASK))
+			return 0;
+		if (delay < IND_CTXT_DELAY_MAX_US)
+			delay = min(delay << 1, (unsigned int)IND_CTXT_DELAY_MAX_US);
+	}
+
+	return -EBUSY;
+}
+
+/* one command, with hw_prg_lock held */
+static int hw_ind_ctxt_exec(struct xlnx_dma_dev *xdev,
+				struct hw_ind_ctxt_op *ctxt_op)
 {
+	unsigned int qid_hw = ctxt_op->qid_hw;
+	enum ind_ctxt_cmd_op op = ctxt_op->op;
+	enum ind_ctxt_cmd_sel sel = ctxt_op->sel;
+	u32 *data = ctxt_op->data;
+	unsigned int cnt = ctxt_op->cnt;
 	unsigned int reg;
 	u32 rd[4] = {0, 0, 0, 0};
 	u32 v;
 	int i;
 	int rv = 0;
 
-	spin_lock(&xdev->hw_prg_lock);
 	pr_debug("qid_hw 0x%x, op 0x%x, sel 0x%x, data 0x%p,%u, verify %d.\n",
-		qid_hw, op, sel, data, cnt, verify);
+		qid_hw, op, sel, data, cnt, ctxt_op->verify);
 
 	if ((op == QDMA_CTXT_CMD_WR) || (op == QDMA_CTXT_CMD_RD)) {
 		if (unlikely(!cnt || cnt > QDMA_REG_IND_CTXT_REG_COUNT)) {
 			pr_warn("Q 0x%x, op 0x%x, sel 0x%x, cnt %u/%d.\n",
 				qid_hw, op, sel, cnt,
 				QDMA_REG_IND_CTXT_REG_COUNT);
-			rv = -EINVAL;
-			goto fn_ret;
+			return -EINVAL;
 		}
 
 		if (unlikely(!data)) {
 			pr_warn("Q 0x%x, op 0x%x, sel 0x%x, data NULL.\n",
 				qid_hw, op, sel);
-			rv = -EINVAL;
-			goto fn_ret;
+			return -EINVAL;
 		}
 
-		reg = QDMA_REG_IND_CTXT_MASK_BASE;
-		for (i = 0; i < QDMA_REG_IND_CTXT_REG_COUNT; i++, reg += 4)
-			__write_reg(xdev, reg, 0xFFFFFFFF);
+		/* the masks are always all 1s, they keep their value */
+		if (!xdev->ind_ctxt_mask_set) {
+			reg = QDMA_REG_IND_CTXT_MASK_BASE;
+			for (i = 0; i < QDMA_REG_IND_CTXT_REG_COUNT;
+			     i++, reg += 4)
+				__write_reg(xdev, reg, 0xFFFFFFFF);
+			xdev->ind_ctxt_mask_set = 1;
+		}
 
 		if (op == QDMA_CTXT_CMD_WR) {
 			reg = QDMA_REG_IND_CTXT_DATA_BASE;
@@ -500,13 +545,11 @@ int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 
 	__write_reg(xdev, QDMA_REG_IND_CTXT_CMD, v);
 
-	rv = hw_monitor_reg(xdev, QDMA_REG_IND_CTXT_CMD,
-			IND_CTXT_CMD_BUSY_MASK, 0, 100, 500*1000);
+	rv = hw_ind_ctxt_wait(xdev);
 	if (rv < 0) {
 		pr_info("%s, Q 0x%x, op 0x%x, sel 0x%x, timeout.\n",
 			xdev->conf.name, qid_hw, op, sel);
-		rv = -EBUSY;
-		goto fn_ret;
+		return -EBUSY;
 	}
 
 	if (op == QDMA_CTXT_CMD_RD) {
@@ -514,11 +557,11 @@ int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 		for (i = 0; i < cnt; i++, reg += 4)
 			data[i] = __read_reg(xdev, reg);
 
-		goto fn_ret;
+		return 0;
 	}
 
-	if (!verify)
-		goto fn_ret;
+	if (!ctxt_op->verify)
+		return 0;
 
 	v = (qid_hw << IND_CTXT_CMD_QID_SHIFT) |
 		(QDMA_CTXT_CMD_RD << IND_CTXT_CMD_OP_SHIFT) |
@@ -529,12 +572,11 @@ int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 
 	__write_reg(xdev, QDMA_REG_IND_CTXT_CMD, v);
 
-	rv = hw_monitor_reg(xdev, QDMA_REG_IND_CTXT_CMD,
-			IND_CTXT_CMD_BUSY_MASK, 0, 100, 500*1000);
+	rv = hw_ind_ctxt_wait(xdev);
 	if (rv < 0) {
 		pr_warn("%s, Q 0x%x, op 0x%x, sel 0x%x, readback busy.\n",
 			xdev->conf.name, qid_hw, op, sel);
-		goto fn_ret;
+		return rv;
 	}
 
 	reg = QDMA_REG_IND_CTXT_DATA_BASE;
@@ -552,12 +594,58 @@ int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
 		rv = -EBUSY;
 	}
 
-fn_ret:
+	return rv;
+}
+
+int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid_hw,
+				enum ind_ctxt_cmd_op op,
+				enum ind_ctxt_cmd_sel sel, u32 *data,
+				unsigned int cnt, bool verify)
+{
+	struct hw_ind_ctxt_op ctxt_op = {
+		.qid_hw = qid_hw,
+		.op = op,
+		.sel = sel,
+		.data = data,
+		.cnt = cnt,
+		.verify = verify,
+	};
+	int rv;
+
+	spin_lock(&xdev->hw_prg_lock);
+	rv = hw_ind_ctxt_exec(xdev, &ctxt_op);
 	spin_unlock(&xdev->hw_prg_lock);
 
 	return rv;
 }
 
+/* max. # of commands per hw_prg_lock hold */
+#define IND_CTXT_BATCH_MAX	64
+
+int hw_indirect_ctext_prog_batch(struct xlnx_dma_dev *xdev,
+				struct hw_ind_ctxt_op *ops, unsigned int cnt,
+				unsigned int *done)
+{
+	unsigned int i = 0;
+	int rv = 0;
+
+	while (i < cnt && !rv) {
+		unsigned int end = min(cnt, i + IND_CTXT_BATCH_MAX);
+
+		spin_lock(&xdev->hw_prg_lock);
+		for (; i < end; i++) {
+			rv = hw_ind_ctxt_exec(xdev, ops + i);
+			if (rv < 0)
+				break;
+		}
+		spin_unlock(&xdev->hw_prg_lock);
+	}
+
+	if (done)
+		*done = i;
+	return rv;
+}
+
 #endif
 
 int qdma_queue_cmpl_ctrl(unsigned long dev_hndl, unsigned long id,
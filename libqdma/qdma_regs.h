@@ -195,6 +195,10 @@ enum ind_ctxt_cmd_sel {
 	QDMA_CTXT_SEL_QID2VEC,
 };
 
+#define S_DESC_CTXT_W0_PIDX		0
+#define M_DESC_CTXT_W0_PIDX		0xFFFFU
+#define S_DESC_CTXT_W0_F_IRQ_ACK	16
+
 #define S_DESC_CTXT_W1_F_QEN		0
 #define S_DESC_CTXT_W1_F_FCRD_EN	1
 #define S_DESC_CTXT_W1_F_WBI_CHK	2
@@ -514,6 +518,24 @@ int hw_indirect_ctext_prog(struct xlnx_dma_dev *xdev, unsigned int qid,
 				enum ind_ctxt_cmd_op op,
 				enum ind_ctxt_cmd_sel sel, u32 *data,
 				unsigned int cnt, bool verify);
+
+/* one indirect context command, see hw_indirect_ctext_prog() */
+struct hw_ind_ctxt_op {
+	unsigned int qid_hw;
+	enum ind_ctxt_cmd_op op;
+	enum ind_ctxt_cmd_sel sel;
+	u32 *data;
+	unsigned int cnt;
+	bool verify;
+};
+
+/*
+ * run @cnt commands in order, several per hw_prg_lock hold, stop at the
+ * first one failing. @done: # of commands done, can be NULL
+ */
+int hw_indirect_ctext_prog_batch(struct xlnx_dma_dev *xdev,
+				struct hw_ind_ctxt_op *ops, unsigned int cnt,
+				unsigned int *done);
 #endif /* #ifndef __QDMA_VF__ */
 
 
@@ -0,0 +1,275 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+#define pr_fmt(fmt)	KBUILD_MODNAME ":%s: " fmt, __func__
+
+#include "qdma_ring_pool.h"
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+
+#include "xdev.h"
+
+/* a cached ring, the book keeping is kept in the ring memory itself */
+struct qdma_ring_buf {
+	struct list_head list;
+	dma_addr_t bus;
+	unsigned int order;
+};
+
+static inline struct xlnx_dma_dev *pool_to_xdev(struct qdma_ring_pool *pool)
+{
+	return container_of(pool, struct xlnx_dma_dev, ring_pool);
+}
+
+/*
+ * give up to @nr_pages of the cached rings back, the largest first.
+ * return # of pages freed
+ */
+static unsigned long ring_pool_shrink(struct qdma_ring_pool *pool,
+				unsigned long nr_pages, bool shrinker)
+{
+	struct device *dev = &pool_to_xdev(pool)->conf.pdev->dev;
+	struct qdma_ring_buf *rb, *tmp;
+	unsigned long freed = 0;
+	LIST_HEAD(list);
+	int order;
+
+	spin_lock_bh(&pool->lock);
+	for (order = QDMA_RING_POOL_ORDERS - 1; order >= 0 && freed < nr_pages;
+		order--) {
+		struct qdma_ring_bucket *bkt = &pool->bkt[order];
+
+		while (bkt->free_cnt && freed < nr_pages) {
+			rb = list_first_entry(&bkt->free, struct qdma_ring_buf,
+						list);
+			list_move(&rb->list, &list);
+			bkt->free_cnt--;
+			freed += 1UL << order;
+		}
+	}
+	pool->cached_pages -= freed;
+	if (shrinker)
+		pool->shrunk_pages += freed;
+	spin_unlock_bh(&pool->lock);
+
+	/* not with the lock held */
+	list_for_each_entry_safe(rb, tmp, &list, list) {
+		dma_addr_t bus = rb->bus;
+
+		dma_free_coherent(dev, PAGE_SIZE << rb->order, rb, bus);
+	}
+
+	return freed;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+static inline struct qdma_ring_pool *shrinker_to_pool(struct shrinker *s)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+	return s->private_data;
+#else
+	return container_of(s, struct qdma_ring_pool, shrinker);
+#endif
+}
+
+static unsigned long ring_pool_count(struct shrinker *s,
+				struct shrink_control *sc)
+{
+	return shrinker_to_pool(s)->cached_pages;
+}
+
+static unsigned long ring_pool_scan(struct shrinker *s,
+				struct shrink_control *sc)
+{
+	unsigned long freed = ring_pool_shrink(shrinker_to_pool(s),
+						sc->nr_to_scan, true);
+
+	return freed ? freed : SHRINK_STOP;
+}
+#endif
+
+int qdma_ring_pool_init(struct xlnx_dma_dev *xdev)
+{
+	struct qdma_ring_pool *pool = &xdev->ring_pool;
+	int i;
+
+	spin_lock_init(&pool->lock);
+	for (i = 0; i < QDMA_RING_POOL_ORDERS; i++)
+		INIT_LIST_HEAD(&pool->bkt[i].free);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+	pool->shrinker = shrinker_alloc(0, "%s-ring", xdev->conf.name);
+	if (!pool->shrinker) {
+		pr_info("%s, ring pool shrinker OOM.\n", xdev->conf.name);
+		return -ENOMEM;
+	}
+	pool->shrinker->count_objects = ring_pool_count;
+	pool->shrinker->scan_objects = ring_pool_scan;
+	pool->shrinker->private_data = pool;
+	shrinker_register(pool->shrinker);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+	{
+		int rv;
+
+		pool->shrinker.count_objects = ring_pool_count;
+		pool->shrinker.scan_objects = ring_pool_scan;
+		pool->shrinker.seeks = DEFAULT_SEEKS;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+		rv = register_shrinker(&pool->shrinker, "%s-ring",
+					xdev->conf.name);
+#else
+		rv = register_shrinker(&pool->shrinker);
+#endif
+		if (rv < 0) {
+			pr_info("%s, ring pool shrinker failed %d.\n",
+				xdev->conf.name, rv);
+			return rv;
+		}
+		pool->shrinker_on = 1;
+	}
+#endif
+	return 0;
+}
+
+void qdma_ring_pool_exit(struct xlnx_dma_dev *xdev)
+{
+	struct qdma_ring_pool *pool = &xdev->ring_pool;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+	shrinker_free(pool->shrinker);
+	pool->shrinker = NULL;
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+	if (pool->shrinker_on)
+		unregister_shrinker(&pool->shrinker);
+	pool->shrinker_on = 0;
+#endif
+	qdma_ring_pool_drain(xdev);
+}
+
+void qdma_ring_pool_drain(struct xlnx_dma_dev *xdev)
+{
+	ring_pool_shrink(&xdev->ring_pool, ULONG_MAX, false);
+}
+
+void *qdma_ring_pool_alloc(struct xlnx_dma_dev *xdev, unsigned int len,
+			dma_addr_t *bus)
+{
+	struct qdma_ring_pool *pool = &xdev->ring_pool;
+	struct device *dev = &xdev->conf.pdev->dev;
+	unsigned int order = get_order(len);
+	struct qdma_ring_bucket *bkt;
+	void *p;
+
+	if (order >= QDMA_RING_POOL_ORDERS)
+		return dma_alloc_coherent(dev, PAGE_ALIGN(len), bus,
+					GFP_KERNEL);
+
+	bkt = &pool->bkt[order];
+	spin_lock_bh(&pool->lock);
+	bkt->alloc++;
+	bkt->inuse++;
+	if (bkt->free_cnt) {
+		struct qdma_ring_buf *rb = list_first_entry(&bkt->free,
+						struct qdma_ring_buf, list);
+
+		list_del(&rb->list);
+		bkt->free_cnt--;
+		bkt->hit++;
+		pool->cached_pages -= 1UL << order;
+		spin_unlock_bh(&pool->lock);
+
+		*bus = rb->bus;
+		return rb;
+	}
+	spin_unlock_bh(&pool->lock);
+
+	p = dma_alloc_coherent(dev, PAGE_SIZE << order, bus, GFP_KERNEL);
+	if (!p && pool->cached_pages) {
+		/* what is missing may be cached in the other buckets */
+		qdma_ring_pool_drain(xdev);
+		p = dma_alloc_coherent(dev, PAGE_SIZE << order, bus,
+					GFP_KERNEL);
+	}
+	if (!p) {
+		spin_lock_bh(&pool->lock);
+		bkt->inuse--;
+		bkt->fail++;
+		spin_unlock_bh(&pool->lock);
+	}
+
+	return p;
+}
+
+void qdma_ring_pool_free(struct xlnx_dma_dev *xdev, unsigned int len,
+			void *va, dma_addr_t bus, bool cache)
+{
+	struct qdma_ring_pool *pool = &xdev->ring_pool;
+	struct device *dev = &xdev->conf.pdev->dev;
+	unsigned int order = get_order(len);
+	struct qdma_ring_bucket *bkt;
+
+	if (order >= QDMA_RING_POOL_ORDERS) {
+		dma_free_coherent(dev, PAGE_ALIGN(len), va, bus);
+		return;
+	}
+
+	bkt = &pool->bkt[order];
+	if (cache) {
+		struct qdma_ring_buf *rb = va;
+
+		rb->bus = bus;
+		rb->order = order;
+
+		spin_lock_bh(&pool->lock);
+		/* the most recently used first */
+		list_add(&rb->list, &bkt->free);
+		bkt->free_cnt++;
+		bkt->inuse--;
+		pool->cached_pages += 1UL << order;
+		spin_unlock_bh(&pool->lock);
+		return;
+	}
+
+	spin_lock_bh(&pool->lock);
+	bkt->inuse--;
+	spin_unlock_bh(&pool->lock);
+
+	dma_free_coherent(dev, PAGE_SIZE << order, va, bus);
+}
+
+int qdma_ring_pool_dump(struct xlnx_dma_dev *xdev, char *buf, int buflen)
+{
+	struct qdma_ring_pool *pool = &xdev->ring_pool;
+	int len;
+	int order;
+
+	spin_lock_bh(&pool->lock);
+	len = scnprintf(buf, buflen,
+			"ring pool: %lu KB cached, %lu KB shrunk.\n",
+			pool->cached_pages << (PAGE_SHIFT - 10),
+			pool->shrunk_pages << (PAGE_SHIFT - 10));
+	for (order = 0; order < QDMA_RING_POOL_ORDERS; order++) {
+		struct qdma_ring_bucket *bkt = &pool->bkt[order];
+
+		if (!bkt->alloc && !bkt->free_cnt)
+			continue;
+		len += scnprintf(buf + len, buflen - len,
+			"\t%lu KB: in use %u, cached %u, alloc %lu, hit %lu, fail %lu.\n",
+			(PAGE_SIZE << order) >> 10, bkt->inuse,
+			bkt->free_cnt, bkt->alloc, bkt->hit, bkt->fail);
+	}
+	spin_unlock_bh(&pool->lock);
+
+	return len;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+#ifndef LIBQDMA_QDMA_RING_POOL_H_
+#define LIBQDMA_QDMA_RING_POOL_H_
+
+#include <linux/version.h>
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/shrinker.h>
+
+/*
+ * per device pool of the dma coherent memory of the descriptor and
+ * completion rings: a stopped queue's rings go back to the pool instead of
+ * dma_free_coherent(), the next queue started takes them from there.
+ * Each ring size from the global csr, times the descriptor or completion
+ * entry size, falls into one bucket of the power of 2 # of pages
+ * dma_alloc_coherent() hands out anyway. The memory is allocated for the
+ * device, i.e., on its numa node.
+ * The buffers cached are given back under memory pressure by a shrinker and
+ * once the device goes offline.
+ */
+#define QDMA_RING_POOL_ORDERS	11	/* up to 4MB with 4KB pages */
+
+struct xlnx_dma_dev;
+
+struct qdma_ring_bucket {
+	struct list_head free;	/* of struct qdma_ring_buf, in the buffers */
+	unsigned int free_cnt;
+	unsigned int inuse;
+	unsigned long alloc;	/* # of rings handed out */
+	unsigned long hit;	/* of those, from the free list */
+	unsigned long fail;	/* dma_alloc_coherent() failed */
+};
+
+struct qdma_ring_pool {
+	spinlock_t lock;
+	unsigned long cached_pages;	/* on the free lists */
+	unsigned long shrunk_pages;	/* freed by the shrinker */
+	struct qdma_ring_bucket bkt[QDMA_RING_POOL_ORDERS];
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+	struct shrinker *shrinker;
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+	struct shrinker shrinker;
+	u8 shrinker_on;
+#endif
+};
+
+int qdma_ring_pool_init(struct xlnx_dma_dev *xdev);
+void qdma_ring_pool_exit(struct xlnx_dma_dev *xdev);
+void qdma_ring_pool_drain(struct xlnx_dma_dev *xdev);
+
+/* at least @len bytes, not zeroed */
+void *qdma_ring_pool_alloc(struct xlnx_dma_dev *xdev, unsigned int len,
+			dma_addr_t *bus);
+/* @cache: 0 to free the memory right away, i.e., it was mapped to user space */
+void qdma_ring_pool_free(struct xlnx_dma_dev *xdev, unsigned int len,
+			void *va, dma_addr_t bus, bool cache);
+
+int qdma_ring_pool_dump(struct xlnx_dma_dev *xdev, char *buf, int buflen);
+
+#endif /* LIBQDMA_QDMA_RING_POOL_H_ */
@@ -176,6 +176,51 @@ int descq_flq_alloc_resource(struct qdma_descq *descq)
 return 0;
 }
 
+/*
+ * queue restart: hand all the rx buffers back to the hw as they are, still
+ * mapped. Those given away to the uld, whose replacement could not be
+ * allocated then, are allocated now.
+ */
+int descq_flq_reset(struct qdma_descq *descq)
+{
+	struct qdma_flq *flq = &descq->flq;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+	int node = dev_to_node(dev);
+	struct qdma_sw_sg *sdesc = flq->sdesc;
+	struct qdma_sdesc_info *sinfo = flq->sdesc_info;
+	struct qdma_c2h_desc *desc = flq->desc;
+	int i;
+
+	for (i = 0; i < flq->size; i++, sdesc++, sinfo++, desc++) {
+		if (sdesc->dma_addr) {
+			sdesc->len = PAGE_SIZE << flq->pg_order;
+			sdesc->offset = 0;
+			desc->dst_addr = sdesc->dma_addr;
+		} else {
+			int rv;
+
+			/* the page, if any, is no longer ours */
+			sdesc->pg = NULL;
+			rv = flq_fill_one(sdesc, desc, dev, node, flq->pg_order,
+					GFP_KERNEL);
+			if (rv < 0)
+				return rv;
+		}
+		sinfo->fbits = 0;
+		sinfo->cidx = 0;
+	}
+
+	flq->udd_cnt = 0;
+	flq->pkt_cnt = 0;
+	flq->pkt_dlen = 0;
+	flq->cidx = 0;
+	flq->pidx = 0;
+	flq->pidx_pend = 0;
+	descq->cidx_wrb_pend = 0;
+
+	return 0;
+}
+
 static int qdma_flq_refill(struct qdma_descq *descq, int idx, int count,
 			int recycle, gfp_t gfp)
 {
@@ -255,7 +300,7 @@ int descq_st_c2h_read(struct qdma_descq *descq, struct qdma_request *req,
 
 	while ((i < fsgcnt) && tsg) {
 		unsigned int flen = fsg->len;
-		unsigned char *faddr = page_address(fsg->pg);
+		unsigned char *faddr = page_address(fsg->pg) + fsg->offset;
 
 		foff = 0;
 
@@ -311,6 +356,7 @@ int descq_st_c2h_read(struct qdma_descq *descq, struct qdma_request *req,
 	cb->sg_idx = j;
 	cb->sg_offset = tsgoff;
 	cb->left -= copied;
+	cb->offset += copied;	/* bytes done, reported via fp_done */
 
 	flq->pkt_dlen -= copied;
 
@@ -620,6 +666,10 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget)
 		descq_wrb_cidx_update(descq, descq->cidx_wrb_pend);
 	}
 
+	/* budget exhausted, let the caller know there is more to do */
+	if (proc_cnt == budget && budget < pend)
+		return pend - proc_cnt;
+
 	return 0;
 }
 
@@ -643,6 +693,136 @@ int qdma_queue_c2h_peek(unsigned long dev_hndl, unsigned long id,
 	return 0;
 }
 
+/*
+ * zero copy receive: the received freelist buffers are handed to the caller
+ * and replaced with newly allocated ones. Whole buffers only, as long as
+ * they fit in sgcnt entries, len bytes and pg_max pages.
+ */
+static int descq_st_c2h_take(struct qdma_descq *descq, struct qdma_sw_sg *sgl,
+			unsigned int sgcnt, unsigned int len, unsigned int pg_max)
+{
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+	int node = dev_to_node(dev);
+	struct qdma_flq *flq = &descq->flq;
+	unsigned int pidx = flq->pidx_pend;
+	unsigned int fsgcnt = ring_idx_delta(descq->pidx, pidx, flq->size);
+	unsigned int taken = 0;
+	int i;
+
+	for (i = 0; i < fsgcnt && i < sgcnt; i++) {
+		struct qdma_sw_sg *fsg = flq->sdesc + pidx;
+		struct qdma_sdesc_info *sinfo = flq->sdesc_info + pidx;
+		struct qdma_sw_sg old = *fsg;
+		unsigned int pg_nr = (offset_in_page(old.offset) + old.len +
+					PAGE_SIZE - 1) >> PAGE_SHIFT;
+		int rv;
+
+		if (old.len > len - taken || pg_nr > pg_max)
+			break;
+
+		/* the ring stays populated: allocate the replacement first */
+		rv = flq_fill_one(fsg, flq->desc + pidx, dev, node,
+				flq->pg_order, GFP_ATOMIC);
+		if (unlikely(rv < 0)) {
+			if (rv == -ENOMEM)
+				flq->alloc_fail++;
+			else
+				flq->mapping_err++;
+			break;
+		}
+		dma_unmap_page(dev, old.dma_addr, PAGE_SIZE << flq->pg_order,
+				DMA_FROM_DEVICE);
+
+		sgl[i].next = sgl + i + 1;
+		sgl[i].pg = old.pg;
+		sgl[i].offset = old.offset;
+		sgl[i].len = old.len;
+		sgl[i].dma_addr = 0UL;
+
+		if (sinfo->f.eop)
+			descq->cidx_wrb_pend = sinfo->cidx;
+		sinfo->fbits = 0;
+		descq->avail++;
+
+		taken += old.len;
+		pg_max -= pg_nr;
+		pidx = ring_idx_incr(pidx, 1, flq->size);
+	}
+
+	if (!i)
+		return 0;
+
+	sgl[i - 1].next = NULL;
+	flq->pidx_pend = pidx;
+	flq->pkt_dlen -= taken;
+
+	descq_c2h_pidx_update(descq, ring_idx_decr(pidx, 1, flq->size));
+	descq_wrb_cidx_update(descq, descq->cidx_wrb_pend);
+
+	return i;
+}
+
+/* received data not claimed by a pending read, or the queue went down */
+static bool descq_st_c2h_takeable(struct qdma_descq *descq)
+{
+	bool rv;
+
+	lock_descq(descq);
+	rv = !descq->online || descq->err ||
+		(list_empty(&descq->pend_list) &&
+		 descq->flq.pidx_pend != descq->pidx);
+	unlock_descq(descq);
+
+	return rv;
+}
+
+int qdma_queue_c2h_pages_take(unsigned long dev_hndl, unsigned long id,
+			struct qdma_sw_sg *sgl, unsigned int sgcnt,
+			unsigned int len, unsigned int pg_max, bool wait)
+{
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(
+					(struct xlnx_dma_dev *)dev_hndl,
+					id, NULL, 0, 1);
+	int rv;
+
+	if (!descq)
+		return QDMA_ERR_INVALID_QIDX;
+
+	if (!descq->conf.st || !descq->conf.c2h ||
+	    descq->conf.fp_descq_c2h_packet)
+		return -EOPNOTSUPP;
+
+	if (descq->user_owned)
+		return -EBUSY;
+
+	if (!sgcnt || !pg_max)
+		return -EINVAL;
+
+	for (;;) {
+		rv = 0;
+		lock_descq(descq);
+		if (!descq->online || descq->err)
+			rv = -EIO;
+		else if (list_empty(&descq->pend_list) &&
+			 descq->flq.pidx_pend != descq->pidx)
+			rv = descq_st_c2h_take(descq, sgl, sgcnt, len, pg_max) ?:
+				-EAGAIN; /* 1st buffer does not fit */
+		unlock_descq(descq);
+
+		if (rv || !wait)
+			return rv ? rv : -EAGAIN;
+
+		/* poll mode: the completion thread polls for the waiter */
+		if (descq->wbthp && !descq_irq_en(descq))
+			qdma_kthread_wakeup(descq->wbthp);
+
+		rv = wait_event_interruptible(descq->poll_wq,
+					descq_st_c2h_takeable(descq));
+		if (rv)
+			return rv;
+	}
+}
+
 int qdma_queue_packet_read(unsigned long dev_hndl, unsigned long id,
 			struct qdma_request *req, struct qdma_cmpl_ctrl *cctrl)
 {
@@ -660,6 +840,9 @@ int qdma_queue_packet_read(unsigned long dev_hndl, unsigned long id,
 		return -EINVAL;
 	}
 
+	if (descq->user_owned)
+		return -EBUSY;
+
 	memset(cb, 0, QDMA_REQ_OPAQUE_SIZE);
 	init_waitqueue_head(&cb->wq);
 
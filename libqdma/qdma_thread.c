@@ -44,6 +44,10 @@ static int qdma_thread_wrk_pend(struct list_head *work_item)
 	descq = list_entry(work_item, struct qdma_descq, wrkthp_list);
 
 	lock_descq(descq);
+	if (descq->err || descq_rl_throttled(descq)) {
+		unlock_descq(descq);
+		return 0;
+	}
 	list_for_each_entry_safe(cb, tmp, &descq->work_list, list) {
 		struct qdma_request *req = (struct qdma_request *)cb;
 
@@ -54,24 +58,114 @@ static int qdma_thread_wrk_pend(struct list_head *work_item)
 	return work;
 }
 
+/*
+ * qos: the queues of a request thread are in priority order. Each pass a
+ * queue with work gets a quantum of bytes by its weight (deficit round
+ * robin), a class is served only if no higher class was left with work it
+ * could have posted but for its quantum (strict priority).
+ * A queue alone on its thread posts as much as fits.
+ * A rate limited queue posts no more than its token buckets hold, see
+ * qdma_descq_rl_budget().
+ */
 static int qdma_thread_wrk_proc(struct list_head *work_item)
 {
 	struct qdma_descq *descq;
 	struct qdma_sgt_req_cb *cb, *tmp;
+	struct qdma_kthread *thp;
+	unsigned int prio_bit;
+	unsigned int pidx;
+	unsigned int rl_bytes = UINT_MAX, rl_descs = UINT_MAX;
+	unsigned int bytes = 0, descs = 0;
+	bool rl;
+	int quantum;
+	bool qos;
 	int rv;
 
 	descq = list_entry(work_item, struct qdma_descq, wrkthp_list);
 
 	lock_descq(descq);
+	/* in error: the requests are failed by qdma_descq_set_err() */
+	if (descq->err) {
+		unlock_descq(descq);
+		return 0;
+	}
+	thp = descq->wrkthp;
+	qos = thp && thp->work_cnt > 1;
+	prio_bit = 1 << descq->conf.qos_prio;
+
+	if (qos) {
+		/* 1st queue of a pass */
+		if (work_item == thp->work_list.next)
+			thp->qos_backlog = 0;
+
+		if (list_empty(&descq->work_list)) {
+			/* idle: no credit saved up */
+			if (descq->qos_deficit > 0)
+				descq->qos_deficit = 0;
+			unlock_descq(descq);
+			return 0;
+		}
+		if (thp->qos_backlog & (prio_bit - 1)) {
+			unlock_descq(descq);
+			return 0;
+		}
+		/* credit left unused (ring full) is not carried over */
+		quantum = QDMA_QOS_QUANTUM *
+				max_t(unsigned int, descq->conf.qos_weight, 1);
+		descq->qos_deficit = min(descq->qos_deficit + quantum, quantum);
+	}
+
+	rl = descq_rl_en(descq) && !list_empty(&descq->work_list);
+	if (rl && !qdma_descq_rl_budget(descq, &rl_bytes, &rl_descs)) {
+		unlock_descq(descq);
+		return 0;
+	}
+
+	pidx = descq->pidx;
 	list_for_each_entry_safe(cb, tmp, &descq->work_list, list) {
+		unsigned int offset = cb->offset;
+		unsigned int desc_nr = cb->desc_nr;
+		unsigned int budget = rl_bytes - bytes;
+
+		if (qos && descq->qos_deficit <= 0)
+			break;
+		if (rl && (bytes >= rl_bytes || descs >= rl_descs))
+			break;
+
+		if (qos)
+			budget = min_t(unsigned int, budget,
+					descq->qos_deficit);
+
 		pr_debug("descq %s, wrk 0x%p.\n", descq->conf.name, cb);
-		rv = qdma_descq_proc_sgt_request(descq, cb);
+		rv = qdma_descq_proc_sgt_request(descq, cb, budget,
+						rl_descs - descs);
 		if (rv < 0) { /* failed, return */
 			qdma_sgt_req_done(descq, cb, rv);
+		} else {
+			bytes += cb->offset - offset;
+			descs += cb->desc_nr - desc_nr;
+			if (qos)
+				descq->qos_deficit -= cb->offset - offset;
 		}
 		if (!descq->avail)
 			break;
 	}
+
+	if (rl)
+		qdma_descq_rl_charge(descq, bytes, descs);
+
+	/* out of quantum, not of descriptors or tokens: lower classes wait */
+	if (qos && descq->qos_deficit <= 0 && descq->avail &&
+	    !list_empty(&descq->work_list))
+		thp->qos_backlog |= prio_bit;
+
+	/* mm: one doorbell write for all the requests posted in this pass */
+	if (!descq->conf.st && descq->pidx != pidx) {
+		if (descq->conf.c2h)
+			descq_c2h_pidx_update(descq, descq->pidx);
+		else
+			descq_h2c_pidx_update(descq, descq->pidx);
+	}
 	unlock_descq(descq);
 
 	return 0;
@@ -84,7 +178,11 @@ static int qdma_thread_wb_pend(struct list_head *work_item)
 	int pend = 0;
 
 	lock_descq(descq);
-	pend = !list_empty(&descq->pend_list);
+	if (descq->polling)	/* adaptive, keep polling until it switches */
+		pend = 1;
+	else if (!descq_irq_en(descq))
+		pend = !list_empty(&descq->pend_list) ||
+			waitqueue_active(&descq->poll_wq);
 	unlock_descq(descq);
 
 	return pend;
@@ -95,6 +193,9 @@ static int qdma_thread_wb_proc(struct list_head *work_item)
 	struct qdma_descq *descq;
 
 	descq = list_entry(work_item, struct qdma_descq, wbthp_list);
+	/* adaptive, serviced by the interrupt until it switches to polling */
+	if (descq_irq_en(descq))
+		return 0;
 	qdma_descq_service_wb(descq, 0);
 	return 0;
 }
@@ -133,11 +234,30 @@ void qdma_thread_remove_work(struct qdma_descq *descq)
 
 void qdma_thread_add_work(struct qdma_descq *descq)
 {
+	struct xlnx_dma_dev *xdev = descq->xdev;
 	struct qdma_kthread *rq_thread = wrk_threads;
 	struct qdma_kthread *cmpl_thread = NULL;
+	struct qdma_descq *pos;
 	unsigned int v = 0;
 	int i, idx = thread_cnt;
+	int cpu = -1;
+
+	/*
+	 * direct interrupt mode: use the request thread on the cpu the queue's
+	 * vector is steered to, so the request and the completion are
+	 * processed on the same cpu.
+	 */
+	if (xdev->num_vecs && !xdev->intr_coal_en)
+		cpu = xdev->intr_vec_map[descq->intr_id].cpu;
+
+	for (i = 0; cpu >= 0 && i < thread_cnt; i++, rq_thread++) {
+		if (rq_thread->cpu == cpu) {
+			idx = i;
+			goto add_work;
+		}
+	}
 
+	rq_thread = wrk_threads;
 	for (i = 0; i < thread_cnt; i++, rq_thread++) {
 		lock_thread(rq_thread);
 		if (idx == thread_cnt) {
@@ -152,13 +272,19 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 		unlock_thread(rq_thread);
 	}
 
+add_work:
 	rq_thread = wrk_threads + idx;
 	lock_thread(rq_thread);
-	list_add_tail(&descq->wrkthp_list, &rq_thread->work_list);
+	/* in qos priority order, after the queues of the same priority */
+	list_for_each_entry(pos, &rq_thread->work_list, wrkthp_list)
+		if (pos->conf.qos_prio > descq->conf.qos_prio)
+			break;
+	list_add_tail(&descq->wrkthp_list, &pos->wrkthp_list);
 	rq_thread->work_cnt++;
 	unlock_thread(rq_thread);
 
-	if (!descq->xdev->num_vecs) {	/* Polled mode only */
+	/* Polled mode, or adaptive which may switch to polling */
+	if (!xdev->num_vecs || xdev->conf.intr_adaptive) {
 		cmpl_thread = wb_threads + (thread_cnt - idx - 1);
 		lock_thread(cmpl_thread);
 		list_add_tail(&descq->wbthp_list, &cmpl_thread->work_list);
@@ -173,6 +299,7 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 		cmpl_thread ? cmpl_thread->work_cnt : 0);
 	descq->wrkthp = rq_thread;
 	descq->wbthp = cmpl_thread;
+	descq->polling = 0;
 	unlock_descq(descq);
 }
 
@@ -31,6 +31,8 @@ struct qdma_kthread {
 
 	unsigned int work_cnt;
 	struct list_head work_list;
+	/* request thread: qos classes left with work in the current pass */
+	unsigned int qos_backlog;
 
 	int (*finit) (struct qdma_kthread *);
 	int (*fpending) (struct list_head *);
@@ -309,6 +309,9 @@ void qdma_device_offline(struct pci_dev *pdev, unsigned long dev_hndl)
 
 	qdma_device_cleanup(xdev);
 
+	/* the queues are gone, and so are the users of the cached rings */
+	qdma_ring_pool_drain(xdev);
+
 	qdma_mbox_timer_stop(xdev);
 
 }
@@ -432,6 +435,10 @@ int qdma_device_open(const char *mod_name, struct qdma_dev_conf *conf,
 		xdev->conf.idx, dev_name(&xdev->conf.pdev->dev));
 	xdev->conf.name[rv] = '\0';
 
+	rv = qdma_ring_pool_init(xdev);
+	if (rv < 0)
+		goto unmap_bars;
+
 	rv = xdev_map_bars(xdev, pdev);
 	if (rv)
 		goto unmap_bars;
@@ -467,6 +474,7 @@ cleanup_qdma:
 unmap_bars:
 	xdev_unmap_bars(xdev, pdev);
 
+	qdma_ring_pool_exit(xdev);
 	xdev_list_remove(xdev);
 	kfree(xdev);
 
@@ -501,6 +509,7 @@ void qdma_device_close(struct pci_dev *pdev, unsigned long dev_hndl)
 	pci_release_regions(pdev);
 	pci_disable_device(pdev);
 
+	qdma_ring_pool_exit(xdev);
 	xdev_list_remove(xdev);
 
 	kfree(xdev);
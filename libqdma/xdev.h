@@ -20,6 +20,7 @@
 
 #include "libqdma_export.h"
 #include "qdma_mbox.h"
+#include "qdma_ring_pool.h"
 
 #define QDMA_CONFIG_BAR			0
 #define QDMA_MAX_BAR_LEN_MAPPED		0x4000000 /* 64MB */
@@ -35,21 +36,36 @@
 
 struct xlnx_dma_dev;
 
+/* # of mm channels (engines) per direction in the register map */
+#define QDMA_MM_CHANNEL_MAX	2
+
+/* mm channel load, for the channel assignment of the mm queues */
+struct qdma_mm_chnl_stat {
+	unsigned int qcnt;		/* # of queues started on the channel */
+	atomic64_t bytes;		/* posted for dma */
+	u64 bytes_snap;			/* bytes at the last assignment */
+};
+
 /* XDMA PCIe device specific book-keeping */
 #define XDEV_FLAG_OFFLINE	0x1
 #define XDEV_FLAG_IRQ		0x2
-#define XDEV_NUM_IRQ_MAX	8
+/* upper bound only, the vector field of the qid2vec context is 8 bits */
+#define XDEV_NUM_IRQ_MAX	256
 
 typedef irqreturn_t (*f_intr_handler)(int irq_index, int irq, void *dev_id);
 
 struct intr_coal_conf {
 	u16 vec_id;
 	u16 intr_rng_num_entries;
+	u16 ring_index;	/* addresses the ring's cidx register */
 	dma_addr_t intr_ring_bus;
 	struct qdma_intr_ring *intr_ring_base;
 	u8 color; /* color value indicates the valid entry in the interrupt ring */
 	unsigned int pidx;
 	unsigned int cidx;
+	unsigned long *qbitmap; /* queues seen in the current burst */
+	u32 ctxt[2];	/* shadow of the context programmed */
+	u8 ctxt_valid;
 };
 
 typedef enum intr_type_list {
@@ -63,6 +79,7 @@ struct intr_vec_map_type {
 	intr_type_list intr_type;
 	int intr_vec_index;
 	f_intr_handler intr_handler;
+	int cpu;	/* data vector: cpu the irq is steered to, -1 if none */
 };
 
 struct xlnx_dma_dev {
@@ -73,6 +90,7 @@ struct xlnx_dma_dev {
 
 	spinlock_t lock;		/* protects concurrent access */
 	spinlock_t hw_prg_lock;
+	u8 ind_ctxt_mask_set;		/* hw_prg_lock: masks written */
 	unsigned int flags;
 
 	/* attributes */
@@ -90,6 +108,8 @@ struct xlnx_dma_dev {
 	u8 pf_count;
 #endif
 	u8 mm_channel_max;
+	/* [c2h][channel], qcnt and bytes_snap protected by lock */
+	struct qdma_mm_chnl_stat mm_chnl[2][QDMA_MM_CHANNEL_MAX];
 
 	/* PCIe config. bar */
 	void __iomem *regs;
@@ -102,17 +122,20 @@ struct xlnx_dma_dev {
 	struct mbox_msg m_resp;
 
 	/* MSI-X interrupt allocation */
-	int num_vecs;
-	struct msix_entry msix[XDEV_NUM_IRQ_MAX];
-	struct list_head intr_list[XDEV_NUM_IRQ_MAX];
-	int intr_list_cnt[XDEV_NUM_IRQ_MAX];
+	int num_vecs;			/* all arrays below have num_vecs */
+	struct msix_entry *msix;
+	struct list_head *intr_list;
+	int *intr_list_cnt;
 	int dvec_start_idx;
-	struct intr_vec_map_type intr_vec_map[XDEV_NUM_IRQ_MAX];
+	struct intr_vec_map_type *intr_vec_map;
 
 	void *dev_priv;
 	u8 intr_coal_en;
 	struct intr_coal_conf  *intr_coal_list;
 
+	/* dma memory of the descriptor and completion rings */
+	struct qdma_ring_pool ring_pool;
+
 	unsigned int dev_ulf_extra[0];	/* for upper layer calling function */
 #ifdef ERR_DEBUG
 	spinlock_t err_lock;
@@ -19,11 +19,21 @@ static const char *progname;
 				(1 << QPARM_DIR))
 #define Q_START_ATTR_IGNORE_MASK ((1 << QPARM_MODE)  | \
                                   (1 << QPARM_DESC) | \
-                                  (1 << QPARM_WRB))
+                                  (1 << QPARM_WRB) | \
+                                  (1 << QPARM_RATE_BPS) | \
+                                  (1 << QPARM_RATE_DPS) | \
+                                  (1 << QPARM_BURST) | \
+                                  (1 << QPARM_BURST_DESC))
 #define Q_STOP_ATTR_IGNORE_MASK ~((1 << QPARM_IDX) | \
 				(1 << QPARM_DIR))
 #define Q_DEL_ATTR_IGNORE_MASK ~((1 << QPARM_IDX)  | \
 				(1 << QPARM_DIR))
+#define Q_RATE_ATTR_IGNORE_MASK ~((1 << QPARM_IDX)  | \
+				(1 << QPARM_DIR) | \
+				(1 << QPARM_RATE_BPS) | \
+				(1 << QPARM_RATE_DPS) | \
+				(1 << QPARM_BURST) | \
+				(1 << QPARM_BURST_DESC))
 #define Q_DUMP_ATTR_IGNORE_MASK ~((1 << QPARM_IDX)  | \
 				(1 << QPARM_DIR) | \
 				(1 << QPARM_DESC) | \
@@ -47,9 +57,13 @@ static const char *progname;
 #define Q_DEL_FLAG_IGNORE_MASK  ~(XNL_F_QMODE_ST | \
 					XNL_F_QMODE_MM | \
 					XNL_F_QDIR_BOTH)
-#define Q_DUMP_FLAG_IGNORE_MASK  ~(XNL_F_QMODE_ST | \
+#define Q_RATE_FLAG_IGNORE_MASK  ~(XNL_F_QMODE_ST | \
 					XNL_F_QMODE_MM | \
 					XNL_F_QDIR_BOTH)
+#define Q_DUMP_FLAG_IGNORE_MASK  ~(XNL_F_QMODE_ST | \
+					XNL_F_QMODE_MM | \
+					XNL_F_QDIR_BOTH | \
+					XNL_F_CTXT_HW)
 #define Q_DUMP_PKT_FLAG_IGNORE_MASK ~(XNL_F_QMODE_ST | \
 					XNL_F_QMODE_MM | \
 					XNL_F_QDIR_C2H)
@@ -140,17 +154,28 @@ static void __attribute__((noreturn)) usage(FILE *fp)
 	        "\t\tq start idx <N> [dir <h2c|c2h|bi>] [idx_ringsz <0:15>] [idx_bufsz <0:15>] [idx_tmr <0:15>]\n"
 		"                                    [idx_cntr <0:15>] [trigmode <every|usr_cnt|usr|usr_tmr|dis>] [wrbsz <0|1|2|3>]\n"
 	        "                                    [bypass_en] [pfetch_en] [dis_wbk] [dis_wbk_acc] [dis_wbk_pend_chk] [c2h_udd_en]\n"
-	        "                                    [dis_fetch_credit] [dis_wrb_stat] [c2h_cmpl_intr_en] - start a single queue\n"
+	        "                                    [dis_fetch_credit] [dis_wrb_stat] [c2h_cmpl_intr_en] [mm_chn <N>]\n"
+	        "                                    [qos_prio <0:3>] [qos_weight <1:255>] - start a single queue\n"
 	        "\t\tq start list <start_idx> <num_Qs> [dir <h2c|c2h|bi>] [idx_bufsz <0:15>] [idx_tmr <0:15>]\n"
 		"                                    [idx_cntr <0:15>] [trigmode <every|user|cnt|tmr|dis>] [wrbsz <0|1|2|3>]\n"
 	        "                                    [bypass_en] [pfetch_en] [dis_wbk] [dis_wbk_acc] [dis_wbk_pend_chk]\n"
-	        "                                    [dis_fetch_credit] [dis_wrb_stat] [c2h_cmpl_intr_en] - start multiple queues at once\n"
+	        "                                    [dis_fetch_credit] [dis_wrb_stat] [c2h_cmpl_intr_en] [mm_chn <N>]\n"
+	        "                                    [qos_prio <0:3>] [qos_weight <1:255>] - start multiple queues at once\n"
 	        "\t\tq stop idx <N> dir [<h2c|c2h|bi>] - stop a single queue\n"
 	        "\t\tq stop list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] - stop list of queues at once\n"
+	        "\t\tq restart idx <N> dir [<h2c|c2h|bi>] - stop and start a queue again, its rings and rx buffers\n"
+	        "                                    are reused unless the ring sizes changed\n"
+	        "\t\tq restart list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] - restart list of queues at once\n"
+	        "\t\tq rate idx <N> dir [<h2c|c2h|bi>] [rate_bps <N>] [rate_dps <N>] [burst <bytes>] [burst_desc <N>]\n"
+	        "                                    - rate limit a queue in bytes/s and descriptors/s, mm and st h2c only,\n"
+	        "                                      none given: no limit. burst defaults to 10ms worth\n"
+	        "\t\tq rate list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] [rate_bps <N>] [rate_dps <N>] [burst <bytes>] [burst_desc <N>]\n"
+	        "                                    - rate limit list of queues at once\n"
 	        "\t\tq del idx <N> dir [<h2c|c2h|bi>] - delete a queue\n"
 	        "\t\tq del list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] - delete list of queues at once\n"
-		"\t\tq dump idx <N> dir [<h2c|c2h|bi>]   dump queue param\n"
-		"\t\tq dump list <start_idx> <num_Qs> dir [<h2c|c2h|bi>]   dump queue param\n"
+		"\t\tq dump idx <N> dir [<h2c|c2h|bi>] [ctxt_hw]   dump queue param\n"
+		"\t\tq dump list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] [ctxt_hw]   dump queue param\n"
+		"\t\t                                 contexts as programmed, ctxt_hw: read from the hw\n"
 		"\t\tq dump idx <N> dir [<h2c|c2h|bi>] desc <x> <y>\n"
 		"\t\t                                 dump desc ring entry x ~ y\n"
 		"\t\tq dump list <start_idx> <num_Qs> dir [<h2c|c2h|bi>] desc <x> <y>\n"
@@ -190,6 +215,18 @@ static int arg_read_int(char *s, uint32_t *v)
     return 0;
 }
 
+static int arg_read_u64(char *s, uint64_t *v)
+{
+    char *p;
+
+    *v = strtoull(s, &p, 0);
+    if (*p) {
+        warnx("bad parameter \"%s\", integer expected", s);
+        return -EINVAL;
+    }
+    return 0;
+}
+
 static int parse_ifname(char *name, struct xcmd_info *xcmd)
 {
 	int rv;
@@ -415,6 +452,13 @@ static char *qparm_type_str[QPARM_MAX] = {
 	"idx_tmr",
 	"idx_cntr",
 	"trigmode",
+	"mm_chn",
+	"qos_prio",
+	"qos_weight",
+	"rate_bps",
+	"rate_dps",
+	"burst",
+	"burst_desc",
 #ifdef ERR_DEBUG
 	"err_no"
 #endif
@@ -433,7 +477,8 @@ static char *qflag_type_str[MAX_QFLAGS] = {
 	"dis_wbk_pend_chk",
 	"dis_wrb_stat",
 	"c2h_cmpl_intr_en",
-	"c2h_udd_en"
+	"c2h_udd_en",
+	"ctxt_hw"
 };
 
 #define IS_SIZE_IDX_VALID(x) (x < 16)
@@ -514,6 +559,7 @@ static int validate_qcmd(enum xnl_op_t qcmd, struct xcmd_q_parm *qparm)
 
 			break;
 		case XNL_CMD_Q_STOP:
+		case XNL_CMD_Q_RESTART:
 			print_ignored_params(qparm->sflags &
 					     Q_STOP_ATTR_IGNORE_MASK, 0);
 			print_ignored_params(qparm->flags &
@@ -525,6 +571,12 @@ static int validate_qcmd(enum xnl_op_t qcmd, struct xcmd_q_parm *qparm)
 			print_ignored_params(qparm->flags &
 					     Q_DEL_FLAG_IGNORE_MASK, 1);
 			break;
+		case XNL_CMD_Q_RATE:
+			print_ignored_params(qparm->sflags &
+					     Q_RATE_ATTR_IGNORE_MASK, 0);
+			print_ignored_params(qparm->flags &
+					     Q_RATE_FLAG_IGNORE_MASK, 1);
+			break;
 		case XNL_CMD_Q_WRB:
 		case XNL_CMD_Q_DUMP:
 			if ((qparm->sflags & ((1 << QPARM_DESC) |
@@ -780,6 +832,71 @@ static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
 			qparm->wrb_trig_mode = v1;
 			f_arg_set |= 1 << QPARM_WRB_TRIG_MODE;
 			i++;
+		} else if (!strcmp(argv[i], "mm_chn")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->mm_chnl = v1;
+			f_arg_set |= 1 << QPARM_MM_CHNL;
+			i++;
+		} else if (!strcmp(argv[i], "qos_prio")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+			if (v1 > 3) {
+				warnx("qos_prio %u out of range <0:3>.\n", v1);
+				return -EINVAL;
+			}
+
+			qparm->qos_prio = v1;
+			f_arg_set |= 1 << QPARM_QOS_PRIO;
+			i++;
+		} else if (!strcmp(argv[i], "qos_weight")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+			if (!v1 || v1 > 255) {
+				warnx("qos_weight %u out of range <1:255>.\n",
+					v1);
+				return -EINVAL;
+			}
+
+			qparm->qos_weight = v1;
+			f_arg_set |= 1 << QPARM_QOS_WEIGHT;
+			i++;
+		} else if (!strcmp(argv[i], "rate_bps")) {
+			get_next_arg(argc, argv, &i);
+			rv = arg_read_u64(argv[i], &qparm->rate_bps);
+			if (rv < 0)
+				return rv;
+
+			f_arg_set |= 1 << QPARM_RATE_BPS;
+			i++;
+		} else if (!strcmp(argv[i], "rate_dps")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->rate_dps = v1;
+			f_arg_set |= 1 << QPARM_RATE_DPS;
+			i++;
+		} else if (!strcmp(argv[i], "burst")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->burst = v1;
+			f_arg_set |= 1 << QPARM_BURST;
+			i++;
+		} else if (!strcmp(argv[i], "burst_desc")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->burst_desc = v1;
+			f_arg_set |= 1 << QPARM_BURST_DESC;
+			i++;
 		} else if (!strcmp(argv[i], "desc")) {
 			get_next_arg(argc, argv, &i);
 			rv = read_range(argc, argv, i, &qparm->range_start,
@@ -830,6 +947,9 @@ static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
 		} else if (!strcmp(argv[i], "c2h_udd_en")) {
 			qparm->flags |= XNL_F_CMPL_UDD_EN;
 			i++;
+		} else if (!strcmp(argv[i], "ctxt_hw")) {
+			qparm->flags |= XNL_F_CTXT_HW;
+			i++;
 		} else {
 			warnx("unknown q parameter %s.\n", argv[i]);
 			return -EINVAL;
@@ -874,6 +994,7 @@ static int parse_q_cmd(int argc, char *argv[], int i, struct xcmd_info *xcmd)
 	 * q add idx <N> mode <mm|st> [dir <h2c|c2h|bi>] [cdev <0|1>] [wrbsz <0|1|2|3>]
 	 * q start idx <N> dir <h2c|c2h|bi>
 	 * q stop idx <N> dir <h2c|c2h|bi>
+	 * q restart idx <N> dir <h2c|c2h|bi>
 	 * q del idx <N> dir <h2c|c2h|bi>
 	 * q dump idx <N> dir <h2c|c2h|bi>
 	 * q dump idx <N> dir <h2c|c2h|bi> desc <x> <y>
@@ -925,6 +1046,16 @@ static int parse_q_cmd(int argc, char *argv[], int i, struct xcmd_info *xcmd)
 		get_next_arg(argc, argv, &i);
 		rv = read_qparm(argc, argv, i, qparm, (1 << QPARM_IDX));
 
+	} else if (!strcmp(argv[i], "restart")) {
+		xcmd->op = XNL_CMD_Q_RESTART;
+		get_next_arg(argc, argv, &i);
+		rv = read_qparm(argc, argv, i, qparm, (1 << QPARM_IDX));
+
+	} else if (!strcmp(argv[i], "rate")) {
+		xcmd->op = XNL_CMD_Q_RATE;
+		get_next_arg(argc, argv, &i);
+		rv = read_qparm(argc, argv, i, qparm, (1 << QPARM_IDX));
+
 	} else if (!strcmp(argv[i], "del")) {
 		xcmd->op = XNL_CMD_Q_DEL;
 		get_next_arg(argc, argv, &i);
@@ -222,6 +222,19 @@ static int xnl_msg_add_int_attr(struct xnl_hdr *hdr, enum xnl_attr_t type,
 	return 0;
 }
 
+static int xnl_msg_add_u64_attr(struct xnl_hdr *hdr, enum xnl_attr_t type,
+				uint64_t v)
+{
+	struct nlattr *attr = (struct nlattr *)((char *)hdr + hdr->n.nlmsg_len);
+
+        attr->nla_type = (__u16)type;
+        attr->nla_len = sizeof(uint64_t) + NLA_HDRLEN;
+	memcpy(attr + 1, &v, sizeof(v));
+
+        hdr->n.nlmsg_len += NLMSG_ALIGN(attr->nla_len);
+	return 0;
+}
+
 static int xnl_msg_add_str_attr(struct xnl_hdr *hdr, enum xnl_attr_t type,
 				char *s)
 {
@@ -237,6 +250,34 @@ static int xnl_msg_add_str_attr(struct xnl_hdr *hdr, enum xnl_attr_t type,
 	return 0;
 }
 
+/* the queues a q add/start/stop failed on */
+static void print_q_status(struct xcmd_info *xcmd, int32_t *status,
+			unsigned int cnt)
+{
+	struct xcmd_q_parm *qparm = &xcmd->u.qparm;
+	int is_qp = (qparm->flags & XNL_F_QDIR_BOTH) == XNL_F_QDIR_BOTH;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		unsigned int n = is_qp ? i / 2 : i;
+		const char *dir;
+
+		if (!status[i])
+			continue;
+
+		if (is_qp)
+			dir = (i & 1) ? "H2C" : "C2H";
+		else
+			dir = (qparm->flags & XNL_F_QDIR_C2H) ? "C2H" : "H2C";
+
+		if (qparm->idx == XNL_QIDX_INVALID)
+			printf("queue #%u %s failed: %d.\n", n, dir, status[i]);
+		else
+			printf("queue %u %s failed: %d.\n", qparm->idx + n, dir,
+				status[i]);
+	}
+}
+
 static int recv_attrs(struct xnl_hdr *hdr, struct xcmd_info *xcmd)
 {
 	unsigned char *p = (unsigned char *)(hdr + 1);
@@ -266,6 +307,9 @@ static int recv_attrs(struct xnl_hdr *hdr, struct xcmd_info *xcmd)
 
 		} else if (na->nla_type == XNL_ATTR_DRV_INFO) {
 			strncpy(xcmd->drv_str, (char *)(na + 1), 128);
+		} else if (na->nla_type == XNL_ATTR_Q_STATUS) {
+			print_q_status(xcmd, (int32_t *)(na + 1),
+				(na->nla_len - NLA_HDRLEN) / sizeof(int32_t));
 		} else {
 			xcmd->attrs[na->nla_type] = *(uint32_t *)(na + 1);
 		}
@@ -343,6 +387,32 @@ static void xnl_msg_add_extra_config_attrs(struct xnl_hdr *hdr,
 	if (xcmd->u.qparm.sflags & (1 << QPARM_WRB_TRIG_MODE))
 		xnl_msg_add_int_attr(hdr,  XNL_ATTR_WRB_TRIG_MODE,
 		                     xcmd->u.qparm.wrb_trig_mode);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_MM_CHNL))
+		xnl_msg_add_int_attr(hdr,  XNL_ATTR_MM_CHANNEL,
+		                     xcmd->u.qparm.mm_chnl);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_QOS_PRIO))
+		xnl_msg_add_int_attr(hdr,  XNL_ATTR_QOS_PRIO,
+		                     xcmd->u.qparm.qos_prio);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_QOS_WEIGHT))
+		xnl_msg_add_int_attr(hdr,  XNL_ATTR_QOS_WEIGHT,
+		                     xcmd->u.qparm.qos_weight);
+}
+
+static void xnl_msg_add_rate_attrs(struct xnl_hdr *hdr,
+				struct xcmd_info *xcmd)
+{
+	if (xcmd->u.qparm.sflags & (1 << QPARM_RATE_BPS))
+		xnl_msg_add_u64_attr(hdr, XNL_ATTR_RATE_BPS,
+				     xcmd->u.qparm.rate_bps);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_RATE_DPS))
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_RATE_DPS,
+				     xcmd->u.qparm.rate_dps);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_BURST))
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_BURST_BYTES,
+				     xcmd->u.qparm.burst);
+	if (xcmd->u.qparm.sflags & (1 << QPARM_BURST_DESC))
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_BURST_DESC,
+				     xcmd->u.qparm.burst_desc);
 }
 
 static int get_cmd_resp_buf_len(struct xcmd_info *xcmd)
@@ -361,10 +431,16 @@ static int get_cmd_resp_buf_len(struct xcmd_info *xcmd)
 	        	buf_len += ((xcmd->u.intr.end_idx -
 					     xcmd->u.intr.start_idx)*row_len);
 	        	break;
+	        case XNL_CMD_Q_ADD:
+	        case XNL_CMD_Q_START:
+	        case XNL_CMD_Q_STOP:
+	        case XNL_CMD_Q_RESTART:
+			/* XNL_ATTR_Q_STATUS: one s32 per queue */
+	        	buf_len += xcmd->u.qparm.num_q * 2 * sizeof(int32_t);
+	        	break;
 	        case XNL_CMD_DEV_LIST:
 	        case XNL_CMD_Q_LIST:
 	        case XNL_CMD_Q_DUMP:
-	        case XNL_CMD_Q_ADD:
 	        	break;
 	        default:
 	        	buf_len = XNL_RESP_BUFLEN_MIN;
@@ -414,9 +490,16 @@ int xnl_send_cmd(struct xnl_cb *cb, struct xcmd_info *xcmd)
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_NUM_Q, xcmd->u.qparm.num_q);
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QFLAG, xcmd->u.qparm.flags);
 		break;
+        case XNL_CMD_Q_RATE:
+		xnl_msg_add_rate_attrs(hdr, xcmd);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_QIDX, xcmd->u.qparm.idx);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_NUM_Q, xcmd->u.qparm.num_q);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_QFLAG, xcmd->u.qparm.flags);
+		break;
         case XNL_CMD_Q_START:
         	xnl_msg_add_extra_config_attrs(hdr, xcmd);
         case XNL_CMD_Q_STOP:
+        case XNL_CMD_Q_RESTART:
         case XNL_CMD_Q_DEL:
         case XNL_CMD_Q_DUMP:
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QIDX, xcmd->u.qparm.idx);
@@ -20,6 +20,13 @@ enum q_parm_type {
 	QPARM_WRB_TMR_IDX,
 	QPARM_WRB_CNTR_IDX,
 	QPARM_WRB_TRIG_MODE,
+	QPARM_MM_CHNL,
+	QPARM_QOS_PRIO,
+	QPARM_QOS_WEIGHT,
+	QPARM_RATE_BPS,
+	QPARM_RATE_DPS,
+	QPARM_BURST,
+	QPARM_BURST_DESC,
 #ifdef ERR_DEBUG
 	QPARAM_ERR_NO,
 #endif
@@ -40,6 +47,13 @@ struct xcmd_q_parm {
 	unsigned char wrb_tmr_idx;
 	unsigned char wrb_cntr_idx;
 	unsigned char wrb_trig_mode;
+	unsigned char mm_chnl;
+	unsigned char qos_prio;
+	unsigned char qos_weight;
+	uint64_t rate_bps;
+	uint32_t rate_dps;
+	uint32_t burst;
+	uint32_t burst_desc;
 	unsigned char is_qp;
 #ifdef ERR_DEBUG
 	unsigned int err_sel[2];